@@ -2,25 +2,63 @@
 #include "uint256.h"
 #include "evm.h"
 #include "keccak256.h"
+#include "evm_code.h"
+#include "evm_deploy_coap.h"
 #include "bytecode.h"
 
 //REV reversve the byte order
 #define REV(X) ((X << 24) | ((X & 0xff00) << 8) | ((X >> 8) & 0xff00) | (X >> 24))
 
-#define DEPLOY_LENGTH 3000
-
-uint8_t deployed_contract[DEPLOY_LENGTH];
-uint64_t DeployLength = 0;
+// runtime code, executed in place from the code region
+static const uint8_t *deployed_contract;
+static uint32_t DeployLength = 0;
+// output of the call to the deployed contract
+static uint8_t call_output[128];
 static rtimer_clock_t total_time;
 
+// Set up vm to run init code that puts the runtime code it returns
+// straight into the code region
+static void deploy_begin(Machine *vm) {
+
+	init_machine(vm);
+	evm_code_begin(EVM_CODE_SLOT_RUNTIME);
+	vm->RETURN_Sink = evm_code_write;
+	vm->RETURN_Capacity = EVM_CODE_MAX_SIZE;
+	total_time = RTIMER_NOW();
+}
+
+// End of the init code of size bytes, which ended with status. Returns the
+// runtime code, NULL if the deployment failed.
+static const uint8_t *deploy_end(Machine *vm, int status, uint32_t size, const uint8_t *init_hash, uint32_t *length) {
+
+	total_time = RTIMER_NOW() - total_time;
+	vm->RETURN_Sink = NULL;
+	printf("Size of contract: %lu\n", (unsigned long)size);
+	// with the time the other processes ran in between
+	printf("Deployment time: %lu ms\n", (unsigned long)((uint64_t)total_time * 1000 / RTIMER_SECOND));
+	// a constructor that reverted leaves no contract behind
+	if (status < 0 || status == REVERT) {
+		return NULL;
+	}
+	if (evm_code_end(vm->RETURN_Length, init_hash) < 0) {
+		return NULL;
+	}
+	return evm_code_get(EVM_CODE_SLOT_RUNTIME, init_hash, length);
+}
+
 /*---------------------------------------------------------------------------*/
 PROCESS(hello_world_process, "Eth-VM");
 AUTOSTART_PROCESSES(&hello_world_process);
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(hello_world_process, ev, data)
 {
+	// the contracts run in steps, these are kept across the pauses
+	static Machine MAIN_VM;
+	static uint8_t init_hash[32];
+	static evm_deploy_t *request;
+	int status;
+
 	PROCESS_BEGIN();
-	static Machine MAIN_VM; 
 	init_machine(&MAIN_VM);
 
 	unsigned char funcation_name[] = "close(uint256,bytes)";
@@ -56,13 +94,31 @@ PROCESS_THREAD(hello_world_process, ev, data)
 	MAIN_VM.message.codesize  = sizeof(smart_contract);
 
 
-	total_time = RTIMER_NOW();
-	execute_contract( &MAIN_VM, smart_contract, sizeof(smart_contract)) ;
-	total_time = RTIMER_NOW() - total_time;
-	printf("Size of contract: %d\n", sizeof(smart_contract));
-	printf("EVM time: %lu ms\n", (uint32_t)((uint64_t)total_time * 1000 / RTIMER_SECOND));	
+	// the runtime code left by an earlier boot is reused if it was
+	// deployed from the same init code, or from the init code last
+	// received over CoAP
+	get_keccak256(smart_contract, sizeof(smart_contract), init_hash);
+	deployed_contract = evm_code_get(EVM_CODE_SLOT_RUNTIME, init_hash, &DeployLength);
+	if (deployed_contract == NULL) {
+		uint32_t received_size;
+		const uint8_t *received = evm_code_get(EVM_CODE_SLOT_INIT, NULL, &received_size);
+		if (received != NULL) {
+			uint8_t received_hash[32];
+			get_keccak256(received, received_size, received_hash);
+			deployed_contract = evm_code_get(EVM_CODE_SLOT_RUNTIME, received_hash, &DeployLength);
+		}
+	}
+	if (deployed_contract == NULL) {
+		deploy_begin(&MAIN_VM);
+		EVM_EXECUTE(&MAIN_VM, smart_contract, sizeof(smart_contract), status);
+		deployed_contract = deploy_end(&MAIN_VM, status, sizeof(smart_contract), init_hash, &DeployLength);
+	}
+	if (deployed_contract == NULL) {
+		printf("Deployment failed\n");
+		PROCESS_EXIT();
+	}
 	printf("deployed_contract : \n");
-	printf("LENGTH : %llu\n",DeployLength);
+	printf("LENGTH : %lu\n",(unsigned long)DeployLength);
 
 	printf("Deployed_contract: \n");
 	printf("-----------------------------\n");
@@ -72,8 +128,22 @@ PROCESS_THREAD(hello_world_process, ev, data)
  	printf("\n -----------------------------\n");
 
 	init_machine(&MAIN_VM);	
-	execute_contract( &MAIN_VM, deployed_contract, DEPLOY_LENGTH) ;
+	MAIN_VM.RETURN_Data = call_output;
+	MAIN_VM.RETURN_Capacity = sizeof(call_output);
+	EVM_EXECUTE(&MAIN_VM, deployed_contract, DeployLength, status);
+
+	// further contracts are deployed over CoAP, their constructor runs as
+	// soon as the last block of init code is in flash
+	evm_deploy_coap_init(&hello_world_process);
+	while (1) {
+		PROCESS_WAIT_EVENT_UNTIL(ev == evm_deploy_event);
+		request = data;
+		MAIN_VM.program = request->program;
+		deploy_begin(&MAIN_VM);
+		EVM_EXECUTE(&MAIN_VM, request->code, request->size, status);
+		deployed_contract = deploy_end(&MAIN_VM, status, request->size, request->code_hash, &DeployLength);
+		evm_deploy_done(deployed_contract != NULL ? DeployLength : 0);
+	}
 
-  
 	PROCESS_END();
 }
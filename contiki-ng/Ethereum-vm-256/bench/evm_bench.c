@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include "evm.h"
+#include "bytecode.h"
+#include "evm_profile.h"
+
+// Host benchmark of the EVM core. Every contract is deployed and then
+// called, repeat times each after one untimed run that also analyses the
+// code, and the mean time, instructions dispatched and gas of a run are
+// reported.
+//
+//   evm-bench [-n repeat] [name init.hex calldata.hex]...
+//
+// Without arguments it runs the contract of bytecode.h, once per function
+// that takes no arguments. Other contracts, e.g. PaymentChannel.sol built
+// with solc --bin, are given by the hex of their init code and of the call
+// data of the call to time.
+// Built with EVM_CFLAGS=-DEVM_CONF_PROFILE=1 it also writes the profile of
+// the calls of every contract to <name>.prof, see evm_profile_export().
+
+#define RUNTIME_MAX_SIZE 8192
+
+typedef struct bench_contract {
+    const char *name;
+    const uint8_t *init;
+    uint32_t init_size;
+    const uint8_t *data;
+    uint32_t data_size;
+} bench_contract_t;
+
+typedef struct bench_result {
+    uint64_t ns;
+    uint64_t insns;
+    uint64_t gas;
+    int status;
+} bench_result_t;
+
+static const uint8_t selectors[][4] = {
+    {0x3f, 0xad, 0x9a, 0xe0},
+    {0xbe, 0xdf, 0x0f, 0x4a},
+    {0xc7, 0x6d, 0xe3, 0xe9},
+    {0xed, 0x8d, 0xf1, 0x64},
+};
+
+static Machine vm;
+static uint8_t runtime[RUNTIME_MAX_SIZE];
+static uint32_t runtime_size;
+static uint8_t output[1024];
+
+static uint64_t now_ns(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Bytes of a file of hex digits, with or without 0x, NULL on error
+static uint8_t *read_hex(const char *path, uint32_t *size) {
+
+    FILE *file = fopen(path, "r");
+    uint8_t *bytes;
+    uint32_t capacity = 256;
+    uint32_t length = 0;
+    int high = -1;
+    int c;
+
+    if (file == NULL) {
+        perror(path);
+        return NULL;
+    }
+    bytes = malloc(capacity);
+    while (bytes != NULL && (c = fgetc(file)) != EOF) {
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        }
+        else if (c == 'x' && high == 0 && length == 0) {
+            high = -1;
+            continue;
+        }
+        else {
+            continue;
+        }
+        if (high < 0) {
+            high = digit;
+            continue;
+        }
+        if (length == capacity) {
+            capacity *= 2;
+            bytes = realloc(bytes, capacity);
+            if (bytes == NULL) {
+                break;
+            }
+        }
+        bytes[length++] = high << 4 | digit;
+        high = -1;
+    }
+    fclose(file);
+    if (bytes == NULL) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return NULL;
+    }
+    *size = length;
+    return bytes;
+}
+
+// Run the init code of contract with empty storage, its output becomes the
+// runtime code
+static void deploy(const bench_contract_t *contract, bench_result_t *result) {
+
+    init_machine(&vm);
+    evm_storage_init(&vm.STORAGE);
+    vm.RETURN_Data = runtime;
+    vm.RETURN_Capacity = sizeof(runtime);
+    vm.message.datasize = 0;
+    result->status = execute_contract(&vm, contract->init, contract->init_size);
+    runtime_size = vm.RETURN_Length;
+    result->insns += vm.stats.insns;
+    result->gas += vm.GAS_Charge;
+}
+
+static void call(const bench_contract_t *contract, bench_result_t *result) {
+
+    init_machine(&vm);
+    vm.RETURN_Data = output;
+    vm.RETURN_Capacity = sizeof(output);
+    memcpy(vm.message.data, contract->data, contract->data_size);
+    vm.message.datasize = contract->data_size;
+    result->status = execute_contract(&vm, runtime, runtime_size);
+    result->insns += vm.stats.insns;
+    result->gas += vm.GAS_Charge;
+}
+
+static void report(const char *name, const char *phase, unsigned long repeat, const bench_result_t *result) {
+
+    double ns = (double)result->ns / repeat;
+    double seconds = result->ns / 1e9;
+
+    printf("%-24s %-7s %9.0f %10.0f %9.0f %9.2f %9.2f\n", name, phase, ns,
+        (double)result->insns / repeat, (double)result->gas / repeat,
+        seconds > 0 ? result->insns / seconds / 1e6 : 0,
+        seconds > 0 ? result->gas / seconds / 1e6 : 0);
+}
+
+// Time repeat runs of step after an untimed one, -1 if it failed. A call
+// that reverts, e.g. on a require() of the contract, is timed as well.
+static int measure(void (*step)(const bench_contract_t *, bench_result_t *), const bench_contract_t *contract, unsigned long repeat, bench_result_t *result) {
+
+    uint64_t start;
+
+    memset(result, 0, sizeof(*result));
+    step(contract, result);
+    if (result->status < 0) {
+        return -1;
+    }
+    memset(result, 0, sizeof(*result));
+    start = now_ns();
+    for (unsigned long i = 0; i < repeat; i++) {
+        step(contract, result);
+    }
+    result->ns = now_ns() - start;
+    return 0;
+}
+
+#if EVM_PROFILE
+static FILE *profile_file;
+
+static int write_profile(const uint8_t *data, uint32_t offset, uint32_t length) {
+    return fwrite(data, 1, length, profile_file) == length ? 0 : -1;
+}
+
+static void save_profile(const char *name) {
+
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s.prof", name);
+    profile_file = fopen(path, "wb");
+    if (profile_file == NULL || evm_profile_export(write_profile) < 0) {
+        perror(path);
+    }
+    if (profile_file != NULL) {
+        fclose(profile_file);
+    }
+}
+#endif
+
+static int bench(const bench_contract_t *contract, unsigned long repeat) {
+
+    bench_result_t result;
+
+    if (contract->data_size > MESSAGEDATASIZE) {
+        fprintf(stderr, "%s: more than %u bytes of call data\n", contract->name, MESSAGEDATASIZE);
+        return -1;
+    }
+    if (measure(deploy, contract, repeat, &result) < 0 || result.status == REVERT) {
+        fprintf(stderr, "%s: deployment failed\n", contract->name);
+        return -1;
+    }
+    report(contract->name, "deploy", repeat, &result);
+#if EVM_PROFILE
+    evm_profile_reset();
+#endif
+    if (measure(call, contract, repeat, &result) < 0) {
+        fprintf(stderr, "%s: call failed\n", contract->name);
+        return -1;
+    }
+#if EVM_PROFILE
+    save_profile(contract->name);
+#endif
+    report(contract->name, result.status == REVERT ? "revert" : "call", repeat, &result);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    unsigned long repeat = 1000;
+    int failed = 0;
+    int arg = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        repeat = strtoul(argv[2], NULL, 0);
+        arg = 3;
+    }
+    if (repeat == 0 || (argc - arg) % 3 != 0) {
+        fprintf(stderr, "usage: %s [-n repeat] [name init.hex calldata.hex]...\n", argv[0]);
+        return 2;
+    }
+
+    printf("%-24s %-7s %9s %10s %9s %9s %9s\n", "contract", "phase", "ns/run", "insns/run", "gas/run", "Minsn/s", "Mgas/s");
+    if (arg == argc) {
+        for (unsigned i = 0; i < sizeof(selectors) / sizeof(selectors[0]); i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "bytecode.h:%02x%02x%02x%02x",
+                selectors[i][0], selectors[i][1], selectors[i][2], selectors[i][3]);
+            bench_contract_t contract = {name, smart_contract, sizeof(smart_contract), selectors[i], 4};
+            failed |= bench(&contract, repeat);
+        }
+    }
+    for (; arg < argc; arg += 3) {
+        bench_contract_t contract = {argv[arg]};
+        uint8_t *init = read_hex(argv[arg + 1], &contract.init_size);
+        uint8_t *data = read_hex(argv[arg + 2], &contract.data_size);
+        contract.init = init;
+        contract.data = data;
+        if (init == NULL || data == NULL) {
+            failed = -1;
+        }
+        else {
+            failed |= bench(&contract, repeat);
+        }
+        free(init);
+        free(data);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+#include "evm.h"
+
+// Small programs whose status, gas and output must not depend on the
+// interpreter. The Makefile builds this once per interpreter,
+// evm-check-threaded and evm-check-plain, and `make check` compares what
+// they print. No program ends with a STOP, so the last instruction of the
+// code has to run.
+// With -x it writes every program to <name>.hex instead and prints the
+// arguments for tools/evm2c; evm-check-aot runs their translation.
+
+typedef struct check_program {
+    const char *name;
+    const uint8_t *code;
+    uint32_t size;
+} check_program_t;
+
+#define PROGRAM(name, ...) \
+    static const uint8_t name[] = { __VA_ARGS__ }
+
+// GAS ends its block: what it reads leaves out the instructions after it
+PROGRAM(gas_return,
+    GAS, PUSH1, 0, MSTORE, PUSH1, 32, PUSH1, 0, RETURN);
+PROGRAM(gas_mid_block,
+    PUSH1, 1, PUSH1, 2, ADD, POP, GAS, PUSH1, 0, MSTORE,
+    PUSH1, 5, PUSH1, 6, MUL, POP, PUSH1, 32, PUSH1, 0, RETURN);
+PROGRAM(gas_in_loop,
+    PUSH1, 3,
+    JUMPDEST, PUSH1, 1, SWAP1, SUB, GAS, PUSH1, 0, MSTORE, DUP1, PUSH1, 2, JUMPI,
+    POP, PUSH1, 32, PUSH1, 0, RETURN);
+// CALL hands on all gas but what the rest of its block needs: none of it
+PROGRAM(call_identity,
+    PUSH1, 0x2a, PUSH1, 0, MSTORE,
+    PUSH1, 32, PUSH1, 32, PUSH1, 32, PUSH1, 0, PUSH1, 0, PUSH1, 4, GAS, CALL,
+    GAS, PUSH1, 64, MSTORE, PUSH1, 96, MSTORE, PUSH1, 128, PUSH1, 0, RETURN);
+PROGRAM(staticcall_sha256,
+    PUSH1, 0x2a, PUSH1, 0, MSTORE,
+    PUSH1, 32, PUSH1, 32, PUSH1, 32, PUSH1, 0, PUSH1, 2, PUSH2, 0x01, 0x00, STATICCALL,
+    GAS, PUSH1, 64, MSTORE, PUSH1, 96, MSTORE, PUSH1, 128, PUSH1, 0, RETURN);
+// init code returning one zero byte of runtime code
+PROGRAM(create_gas,
+    PUSH6, PUSH1, 1, PUSH1, 0, RETURN, STOP, PUSH1, 0, MSTORE,
+    PUSH1, 6, PUSH1, 26, PUSH1, 0, CREATE, POP,
+    GAS, PUSH1, 0, MSTORE, PUSH1, 32, PUSH1, 0, RETURN);
+// four more contracts than create_gas made: with the default table of
+// four the oldest one kept makes room for the last
+PROGRAM(create_evicts,
+    PUSH6, PUSH1, 1, PUSH1, 0, RETURN, STOP, PUSH1, 0, MSTORE,
+    PUSH1, 6, PUSH1, 26, PUSH1, 0, CREATE, PUSH1, 32, MSTORE,
+    PUSH1, 6, PUSH1, 26, PUSH1, 0, CREATE, PUSH1, 64, MSTORE,
+    PUSH1, 6, PUSH1, 26, PUSH1, 0, CREATE, PUSH1, 96, MSTORE,
+    PUSH1, 6, PUSH1, 26, PUSH1, 0, CREATE, PUSH1, 128, MSTORE,
+    PUSH1, 128, PUSH1, 32, RETURN);
+// SHA3 of a word in its page, across two pages, in an untouched page and
+// of 33 bytes: the first two digests are the same
+PROGRAM(sha3_spans,
+    PUSH1, 0x2a, PUSH1, 0, MSTORE, PUSH1, 0x2a, PUSH1, 0xf0, MSTORE,
+    PUSH1, 32, PUSH1, 0, SHA3, PUSH1, 32, PUSH1, 0xf0, SHA3,
+    PUSH1, 32, PUSH2, 0x02, 0x00, SHA3, PUSH1, 33, PUSH1, 0, SHA3,
+    PUSH1, 0xa0, MSTORE, PUSH1, 0x80, MSTORE, PUSH1, 0x60, MSTORE, PUSH1, 0x40, MSTORE,
+    PUSH1, 128, PUSH1, 0x40, RETURN);
+// the immediate of a long PUSH fills all four limbs, a selector is shifted
+// out of it
+PROGRAM(push_long,
+    PUSH9, 1, 2, 3, 4, 5, 6, 7, 8, 9, PUSH1, 0, MSTORE,
+    PUSH17, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, PUSH1, 32, MSTORE,
+    PUSH32, 0xa9, 0x05, 0x9c, 0xbb, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+    DUP1, PUSH1, 64, MSTORE, PUSH1, 0xe0, SHR, PUSH1, 96, MSTORE,
+    PUSH1, 0xe0, PUSH1, 1, SHL, PUSH32, 0xff, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, DIV, PUSH1, 128, MSTORE,
+    PUSH1, 160, PUSH1, 0, RETURN);
+// PC gives the offset in the code, also after a jump
+PROGRAM(pc_offsets,
+    PC, PUSH1, 0, MSTORE, PUSH1, 9, JUMP, INVALID, INVALID,
+    JUMPDEST, PC, PUSH1, 32, MSTORE, PUSH1, 64, PUSH1, 0, RETURN);
+
+static const check_program_t programs[] = {
+    { "gas_return", gas_return, sizeof(gas_return) },
+    { "gas_mid_block", gas_mid_block, sizeof(gas_mid_block) },
+    { "gas_in_loop", gas_in_loop, sizeof(gas_in_loop) },
+    { "call_identity", call_identity, sizeof(call_identity) },
+    { "staticcall_sha256", staticcall_sha256, sizeof(staticcall_sha256) },
+    { "create_gas", create_gas, sizeof(create_gas) },
+    { "create_evicts", create_evicts, sizeof(create_evicts) },
+    { "sha3_spans", sha3_spans, sizeof(sha3_spans) },
+    { "push_long", push_long, sizeof(push_long) },
+    { "pc_offsets", pc_offsets, sizeof(pc_offsets) },
+};
+
+static Machine vm;
+static uint8_t output[256];
+
+// Write every program to <name>.hex and print "<name> <name>.hex" for each
+static int write_hex(void) {
+
+    for (unsigned i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        const check_program_t *program = &programs[i];
+        char path[64];
+        FILE *file;
+
+        snprintf(path, sizeof(path), "%s.hex", program->name);
+        file = fopen(path, "w");
+        if (file == NULL) {
+            perror(path);
+            return 1;
+        }
+        for (uint32_t j = 0; j < program->size; j++) {
+            fprintf(file, "%02x", program->code[j]);
+        }
+        fprintf(file, "\n");
+        fclose(file);
+        printf("%s %s ", program->name, path);
+    }
+    printf("\n");
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc > 1 && strcmp(argv[1], "-x") == 0) {
+        return write_hex();
+    }
+    for (unsigned i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        const check_program_t *program = &programs[i];
+        int status;
+
+        init_machine(&vm);
+        vm.GAS_Limit = 1000000;
+        vm.RETURN_Data = output;
+        vm.RETURN_Capacity = sizeof(output);
+        vm.message.datasize = 0;
+        status = execute_contract(&vm, program->code, program->size);
+        printf("%-20s status %d gas %lu output ", program->name, status, (unsigned long)vm.GAS_Charge);
+        for (uint32_t j = 0; j < vm.RETURN_Length; j++) {
+            printf("%02x", output[j]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "evm.h"
+#include "evm_storage.h"
+#include "cfs/cfs-coffee.h"
+
+// Coffee backend of the contract storage, on the Coffee of the native
+// platform over its RAM flash: slots written by two contracts whose
+// addresses differ only above bit 64 are read back after reopening, then
+// one of them is rewritten until its log has been compacted several times
+// and compared with what was written. Built by `make check` with
+// EVM_CONF_STORAGE_PERSISTENT=1, returns 1 on a mismatch.
+
+#define SLOTS 40
+#define ROUNDS 300
+
+static evm_storage_t storage;
+static evm_journal_t journal;
+
+static void store(uint64_t slot, uint64_t value) {
+    uint256_t key;
+    uint256_t word;
+    clear256(&key);
+    clear256(&word);
+    LOWER(LOWER(key)) = slot;
+    LOWER(LOWER(word)) = value;
+    evm_storage_store(&storage, &journal, &key, &word);
+}
+
+static uint64_t load(uint64_t slot) {
+    uint256_t key;
+    uint256_t word;
+    clear256(&key);
+    LOWER(LOWER(key)) = slot;
+    evm_storage_load(&storage, &key, &word);
+    return LOWER(LOWER(word));
+}
+
+// what a call does once it has finished successfully
+static void finish(void) {
+    evm_storage_flush(&storage, &journal);
+    journal.length = 0;
+}
+
+// leave address for the other one and come back, dropping the table
+static void reopen(const uint256_t *address, const uint256_t *other) {
+    evm_storage_open(&storage, other);
+    evm_storage_open(&storage, address);
+}
+
+int main(void) {
+
+    uint256_t a;
+    uint256_t b;
+    uint64_t model[SLOTS] = {0};
+    uint32_t seed = 7;
+    int compactions = 0;
+    int mismatches = 0;
+
+    clear256(&a);
+    clear256(&b);
+    LOWER(LOWER(a)) = 0x1234;
+    LOWER(LOWER(b)) = 0x1234;
+    UPPER(LOWER(b)) = 7;
+    cfs_coffee_format();
+    evm_storage_init(&storage);
+
+    evm_storage_open(&storage, &a);
+    store(1, 11);
+    store(2, 22);
+    finish();
+    evm_storage_open(&storage, &b);
+    store(1, 99);
+    finish();
+    reopen(&a, &b);
+    printf("a: slot1 %lu slot2 %lu\n", (unsigned long)load(1), (unsigned long)load(2));
+    mismatches += load(1) != 11 || load(2) != 22;
+    reopen(&b, &a);
+    printf("b: slot1 %lu slot2 %lu\n", (unsigned long)load(1), (unsigned long)load(2));
+    mismatches += load(1) != 99 || load(2) != 0;
+
+    // three slots a call, a fifth of them deleted
+    reopen(&a, &b);
+    model[1] = 11;
+    model[2] = 22;
+    for (int round = 0; round < ROUNDS; round++) {
+        char generation = storage.name[EVM_STORAGE_NAME_LENGTH - 2];
+        for (int i = 0; i < 3; i++) {
+            seed = seed * 1103515245 + 12345;
+            int slot = (seed >> 16) % SLOTS;
+            uint64_t value = (seed >> 8) % 5 == 0 ? 0 : seed;
+            store(slot, value);
+            model[slot] = value;
+        }
+        finish();
+        compactions += storage.name[EVM_STORAGE_NAME_LENGTH - 2] != generation;
+        if (round % 37 == 0) {
+            reopen(&a, &b);
+        }
+    }
+    reopen(&a, &b);
+    for (int slot = 0; slot < SLOTS; slot++) {
+        mismatches += load(slot) != model[slot];
+    }
+    printf("churn: %d calls, %d compactions, %d mismatches\n", ROUNDS, compactions, mismatches);
+    return mismatches != 0 || compactions == 0;
+}
@@ -0,0 +1,158 @@
+#include "evm.h"
+#include "evm_secp256k1.h"
+#include "evm_sha256.h"
+#include "evm_ripemd160.h"
+
+// Known answers of the native precompiles, and of divmod256() over random
+// words, in the configuration the EVM is built with. `make check` runs
+// this, it returns 1 if any is wrong.
+
+static int failures;
+
+static void hex_decode(const char *hex, uint8_t *bytes) {
+    for (size_t i = 0; hex[2 * i] != '\0'; i++) {
+        unsigned value;
+        sscanf(&hex[2 * i], "%2x", &value);
+        bytes[i] = value;
+    }
+}
+
+static void expect(const char *name, const uint8_t *got, uint32_t length, const char *hex) {
+
+    uint8_t want[64];
+
+    hex_decode(hex, want);
+    if (memcmp(got, want, length) == 0) {
+        printf("%-24s ok\n", name);
+        return;
+    }
+    printf("%-24s FAILED, got ", name);
+    for (uint32_t i = 0; i < length; i++) {
+        printf("%02x", got[i]);
+    }
+    printf("\n");
+    failures++;
+}
+
+// The signature of the ecrecover tests of the Ethereum test suite
+static void check_ecrecover(void) {
+
+    uint8_t hash[32];
+    uint8_t r[32];
+    uint8_t s[32];
+    uint8_t public_key[64];
+    uint8_t digest[32];
+
+    hex_decode("456e9aea5e197a1f1af7a3e85a3212fa4049a3ba34c2289b4c860fc0b0c64ef3", hash);
+    hex_decode("9242685bf161793cc25603c231bc2f568eb630ea16aa137d2664ac8038825608", r);
+    hex_decode("4f8ae3bd7535248d0bd448298cc2e2071e56992d0774dc340c368ae950852ada", s);
+    // v = 28
+    if (evm_secp256k1_recover(hash, r, s, 1, public_key) < 0) {
+        printf("%-24s FAILED, no key\n", "ecrecover");
+        failures++;
+        return;
+    }
+    get_keccak256(public_key, sizeof(public_key), digest);
+    expect("ecrecover", digest + 12, 20, "7156526fbd7a3c72969b54f64e42c10fbb768c8a");
+}
+
+// "abc" and a million times "a", the latter fed in pieces that do not
+// line up with the blocks
+static void check_hashes(void) {
+
+    static uint8_t a[1000];
+    evm_sha256_t sha256;
+    evm_ripemd160_t ripemd160;
+    uint8_t digest[32];
+
+    evm_sha256_init(&sha256, 1);
+    evm_sha256_update(&sha256, (const uint8_t *)"abc", 3);
+    evm_sha256_final(&sha256, digest);
+    expect("sha256 abc", digest, 32, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    evm_ripemd160_init(&ripemd160);
+    evm_ripemd160_update(&ripemd160, (const uint8_t *)"abc", 3);
+    evm_ripemd160_final(&ripemd160, digest);
+    expect("ripemd160 abc", digest, 20, "8eb208f7e05d987a9b044a8e98c6b087f15a0bfc");
+
+    memset(a, 'a', sizeof(a));
+    evm_sha256_init(&sha256, 1);
+    evm_ripemd160_init(&ripemd160);
+    for (int i = 0; i < 1000; i++) {
+        evm_sha256_update(&sha256, a, 999);
+        evm_ripemd160_update(&ripemd160, a, 999);
+    }
+    evm_sha256_update(&sha256, a, 1000);
+    evm_ripemd160_update(&ripemd160, a, 1000);
+    evm_sha256_final(&sha256, digest);
+    expect("sha256 million a", digest, 32, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    evm_ripemd160_final(&ripemd160, digest);
+    expect("ripemd160 million a", digest, 20, "52783243c1697bdbe16d37f97f68f08325dc1528");
+}
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ull;
+
+static uint32_t random32(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t)(random_state >> 16);
+}
+
+// A word of a random length whose 32-bit limbs are often 0, 1, all ones
+// or only the top bit, which hit the corrections of the quotient digits
+static void random_word(uint256_t *word) {
+
+    static const uint32_t special[] = { 0, 1, 0xffffffff, 0x80000000 };
+    uint8_t bytes[32];
+    int limbs = 1 + random32() % 8;
+
+    memset(bytes, 0, sizeof(bytes));
+    for (int i = 32 - 4 * limbs; i < 32; i += 4) {
+        uint32_t limb = random32() % 2 ? special[random32() % 4] : random32();
+        bytes[i] = limb >> 24;
+        bytes[i + 1] = limb >> 16;
+        bytes[i + 2] = limb >> 8;
+        bytes[i + 3] = limb;
+    }
+    readu256BE(bytes, word);
+}
+
+// q * b + m == a and m < b
+static void check_divmod(void) {
+
+    int wrong = 0;
+
+    for (int i = 0; i < 100000; i++) {
+        uint256_t a;
+        uint256_t b;
+        uint256_t q;
+        uint256_t m;
+        uint256_t product;
+
+        random_word(&a);
+        random_word(&b);
+        if (zero256(&b)) {
+            continue;
+        }
+        divmod256(&a, &b, &q, &m);
+        mul256(&q, &b, &product);
+        add256(&product, &m, &product);
+        if (!equal256(&product, &a) || !gt256(&b, &m)) {
+            wrong++;
+        }
+    }
+    if (wrong == 0) {
+        printf("%-24s ok\n", "divmod256");
+        return;
+    }
+    printf("%-24s FAILED for %d of 100000\n", "divmod256", wrong);
+    failures++;
+}
+
+int main(void) {
+
+    check_ecrecover();
+    check_hashes();
+    check_divmod();
+    return failures != 0;
+}
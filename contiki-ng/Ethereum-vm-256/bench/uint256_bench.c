@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "uint256.h"
+
+// Host benchmark of the uint256_t arithmetic the EVM opcodes use. The
+// Makefile builds it once per backend, uint256-bench-64 with 64-bit halves
+// and uint256-bench-32 with 32-bit limbs (EVM_CONF_UINT256_LIMB32), so
+// that `make compare` runs both on the same operands.
+//
+//   uint256-bench-32 [-n repeat]
+
+#define OPERANDS 64
+
+typedef void (*binary_op_t)(uint256_t *, uint256_t *, uint256_t *);
+
+static uint256_t operand[OPERANDS];
+static uint256_t small[OPERANDS];
+static uint256_t power[OPERANDS];
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Operands from a fixed seed: full words, 64-bit values as most amounts
+// and indices are, and powers of two as DIV by 2^224 for the selector
+static void make_operands(void) {
+
+    uint32_t seed = 1;
+    uint8_t bytes[32];
+
+    for (int i = 0; i < OPERANDS; i++) {
+        for (int j = 0; j < 32; j++) {
+            seed = seed * 1103515245 + 12345;
+            bytes[j] = (uint8_t)(seed >> 16);
+        }
+        readu256BE(bytes, &operand[i]);
+        clear256(&small[i]);
+        LOWER(LOWER(small[i])) = UPPER(UPPER(operand[i]));
+        clear256(&power[i]);
+        LOWER(LOWER(power[i])) = 1;
+        shiftl256(&power[i], (uint32_t)i * 4, &power[i]);
+    }
+}
+
+static void report(const char *name, uint64_t start, uint32_t count) {
+    printf("%-16s %9.1f\n", name, (double)(now_ns() - start) / count);
+}
+
+static void bench_binary(const char *name, binary_op_t op, uint256_t *left, uint256_t *right, uint32_t repeat) {
+
+    uint256_t result;
+    uint64_t start = now_ns();
+
+    for (uint32_t n = 0; n < repeat; n++) {
+        for (int i = 0; i < OPERANDS; i++) {
+            op(&left[i], &right[(i + n) % OPERANDS], &result);
+            sink += LOWER(LOWER(result));
+        }
+    }
+    report(name, start, repeat * OPERANDS);
+}
+
+static void bench_shift(const char *name, void (*op)(uint256_t *, uint32_t, uint256_t *), uint32_t repeat) {
+
+    uint256_t result;
+    uint64_t start = now_ns();
+
+    for (uint32_t n = 0; n < repeat; n++) {
+        for (int i = 0; i < OPERANDS; i++) {
+            op(&operand[i], (uint32_t)(i + n) % 256, &result);
+            sink += LOWER(LOWER(result));
+        }
+    }
+    report(name, start, repeat * OPERANDS);
+}
+
+static void bench_divmod(const char *name, uint256_t *left, uint256_t *right, uint32_t repeat) {
+
+    uint256_t quotient, remainder;
+    uint64_t start = now_ns();
+
+    for (uint32_t n = 0; n < repeat; n++) {
+        for (int i = 0; i < OPERANDS; i++) {
+            uint256_t *divisor = &right[(i + n) % OPERANDS];
+            if (!zero256(divisor)) {
+                divmod256(&left[i], divisor, &quotient, &remainder);
+                sink += LOWER(LOWER(quotient)) + LOWER(LOWER(remainder));
+            }
+        }
+    }
+    report(name, start, repeat * OPERANDS);
+}
+
+// EXP: square and multiply over a 256-bit exponent
+static void bench_exp(uint32_t repeat) {
+
+    uint256_t result, base;
+    uint64_t start = now_ns();
+
+    for (uint32_t n = 0; n < repeat; n++) {
+        clear256(&result);
+        LOWER(LOWER(result)) = 1;
+        copy256(&base, &operand[n % OPERANDS]);
+        for (int bit = 0; bit < 256; bit++) {
+            if ((LOWER(LOWER(operand[(n + 1) % OPERANDS])) >> (bit % 64)) & 1) {
+                mul256(&result, &base, &result);
+            }
+            mul256(&base, &base, &base);
+        }
+        sink += LOWER(LOWER(result));
+    }
+    report("exp", start, repeat);
+}
+
+int main(int argc, char **argv) {
+
+    uint32_t repeat = 20000;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        repeat = strtoul(argv[2], NULL, 0);
+    }
+    else if (argc > 1) {
+        fprintf(stderr, "usage: %s [-n repeat]\n", argv[0]);
+        return 1;
+    }
+    make_operands();
+    printf("%d-bit limbs\n", EVM_UINT256_LIMB32 ? 32 : 64);
+    printf("%-16s %9s\n", "operation", "ns/op");
+    bench_binary("add", add256, operand, operand, repeat);
+    bench_binary("sub", minus256, operand, operand, repeat);
+    bench_binary("mul", mul256, operand, operand, repeat);
+    bench_binary("mul 64-bit", mul256, operand, small, repeat);
+    bench_shift("shl", shiftl256, repeat);
+    bench_shift("shr", shiftr256, repeat);
+    bench_divmod("div", operand, operand, repeat / 10);
+    bench_divmod("div 64-bit", operand, small, repeat / 10);
+    bench_divmod("div 2^k", operand, power, repeat / 10);
+    bench_exp(repeat / 100);
+    return 0;
+}
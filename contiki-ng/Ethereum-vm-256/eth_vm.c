@@ -1,16 +1,32 @@
 #include "evm.h"
 #include <math.h>
+#include <inttypes.h>
 #include "keccak256.h"
+#include "evm_analysis.h"
+#include "evm_aot.h"
+#include "evm_call.h"
+#include "evm_ngram.h"
+#include "evm_precompile.h"
+#include "evm_profile.h"
+// The IoT opcodes reach the board through Contiki. Without it (host
+// library, bench/) LED does nothing and TIMESTAMP reads the host clock.
+#ifdef CONTIKI
+#include "contiki.h"
 #include "dev/leds.h"
-#include "dev/cc2538-sensors.h"
+#else
+#include <time.h>
+#endif
 
 // #define CC2538_CHIP 
+#ifdef CC2538_CHIP
+#include "dev/cc2538-sensors.h"
+#endif
 
 void print256(uint256_t * number_1 ){
-    printf("%016llX\n", UPPER(UPPER_P(number_1 )));
-    printf("%016llX\n", UPPER(LOWER_P(number_1)));
-    printf("%016llX\n", LOWER(UPPER_P(number_1 )));
-    printf("%016llX\n", LOWER(LOWER_P(number_1)));
+    printf("%016" PRIX64 "\n", UPPER(UPPER_P(number_1 )));
+    printf("%016" PRIX64 "\n", UPPER(LOWER_P(number_1)));
+    printf("%016" PRIX64 "\n", LOWER(UPPER_P(number_1 )));
+    printf("%016" PRIX64 "\n", LOWER(LOWER_P(number_1)));
 }
 
 uint64_t swapLong(uint64_t *X) {
@@ -21,7 +37,7 @@ uint64_t swapLong(uint64_t *X) {
     return x;
 }
 
-static struct GAS_price GAS_TABLE = {  
+static const struct GAS_price GAS_TABLE = {  
     .stepGas0 = 0,
     .stepGas1 = 1,
     .stepGas2 = 2,
@@ -31,6 +47,7 @@ static struct GAS_price GAS_TABLE = {
     .stepGas10 = 10,
     .sha3Gas = 30,
     .sha3WordGas = 6,
+    .expByteGas = 10,
     .sloadGas = 50,
     .sstoreSetGas = 20000,
     .sstoreResetGas = 5000,
@@ -40,6 +57,7 @@ static struct GAS_price GAS_TABLE = {
     .logDataGas = 8,
     .logTopicGas = 375,
     .createGas = 32000,
+    .createDataGas = 200,
     .memoryGas = 3,
     .quadCoeffDiv = 512,
     .copyGas = 3,
@@ -48,62 +66,636 @@ static struct GAS_price GAS_TABLE = {
     .callNewAccount = 25000,
 };
 
-
-static rtimer_clock_t time;
-
+// Forget the SHA3 digests of the previous call
+static void keccak_memo_forget(Machine *machine_state) {
+#if EVM_KECCAK_MEMO
+    for (int i = 0; i < EVM_KECCAK_MEMO; i++) {
+        machine_state->KECCAK_Memo[i].length = 0;
+    }
+    machine_state->KECCAK_Clock = 0;
+#endif
+}
 
 void init_machine(Machine * state) {
     state->PC = 0;
     state->SP = 0;
+    state->SP_Base = 0;
     state->GAS_Charge = 0;
+    state->GAS_Limit = GAS_LIMIT;
+    state->SLICE_End = UINT32_MAX;
+    state->MEM_Words = 0;
+    state->DEPTH = 0;
+    state->STATIC = 0;
+    state->SELF.storage = &state->STORAGE;
+    state->ACCOUNT = &state->SELF;
+    state->message.data_memory = NULL;
+    state->RETURN_Length = 0;
+    state->JOURNAL.length = 0;
+    state->JOURNAL.frame = 0;
+    memset(&state->stats, 0, sizeof(state->stats));
+    // drop the pages of the previous call
+    evm_memory_free(&state->MEM);
+    evm_memory_free(&state->RETURNDATA_Pages);
+    state->RETURNDATA_Length = 0;
+    keccak_memo_forget(state);
 }
 
-int max_mem_offset = 0;
-int max_storage_counter = 0;
-int max_sp = 0;
+#if EVM_PRINT_STATS
+static void print_statistics(Machine *machine_state) {
+    printf("Stack Pointer :  %u \n",machine_state->stats.max_sp);
+    printf("Stack usage :  %u \n",machine_state->stats.max_sp * 256);
+    printf("Memory usage :  %lu \n", (unsigned long)machine_state->stats.max_mem_offset);
+    printf("Storage usage  :  %lu \n", (unsigned long)machine_state->stats.storage_writes * 256);
+#if EVM_NGRAM_STATS
+    evm_ngram_report(EVM_NGRAM_REPORT_TOP);
+#endif
+#if EVM_PROFILE
+    evm_profile_report(EVM_PROFILE_REPORT_TOP);
+#endif
+}
+#endif
 
-void execute_contract(Machine *machine_state, const uint8_t *s_contract, uint32_t size) {
+// A PUSH at pc whose immediate runs past the end of the code: the missing
+// bytes read as zero
+static void push_truncated(Machine *machine_state, const uint8_t *s_contract, uint32_t size, uint32_t pc) {
+
+    uint8_t word[32] = {0};
+    int length = OPCODE_INFO[s_contract[pc]].imm;
+
+    for (int i = 0; i < length && pc + 1 + i < size; i++) {
+        word[32 - length + i] = s_contract[pc + 1 + i];
+    }
+    readu256BE(word, stack_new(machine_state));
+}
+
+// Plain interpreter over the bytecode, from PC. Returns 0 or RETURN on
+// success, REVERT or -1 on failure, EVM_PAUSED at the end of a step.
+static int execute_bytecode(Machine *machine_state, const uint8_t *s_contract, uint32_t size) {
 
-    
     //Execute smart contract till end of bytecode / exit or error 
-    while(machine_state->PC  < size - 1 )
+    while(machine_state->PC  < size )
     {
+        // end of a step of execute_contract_step()
+        if (machine_state->GAS_Charge >= machine_state->SLICE_End && machine_state->DEPTH == 0) {
+            return EVM_PAUSED;
+        }
         // GAS can be emmited for off-chain
-        if(machine_state->GAS_Charge > GAS_LIMIT)
+        machine_state->GAS_Charge += OPCODE_INFO[s_contract[machine_state->PC]].gas;
+        if(machine_state->GAS_Charge > machine_state->GAS_Limit)
 	{
              printf("Run out of GAS!\n");
-             break;
+             return -1;
+        }
+        // the handlers rely on this check of the stack
+        if (opcode_check(machine_state, s_contract[machine_state->PC]) < 0) {
+            return -1;
         }
+        if (machine_state->PC + OPCODE_INFO[s_contract[machine_state->PC]].imm >= size) {
+            // the last instruction of the code
+            push_truncated(machine_state, s_contract, size, machine_state->PC);
+            return 0;
+        }
+#if EVM_NGRAM_STATS
+        evm_ngram_record(s_contract[machine_state->PC]);
+#endif
+#if EVM_COUNT_INSNS
+        machine_state->stats.insns++;
+#endif
+#if EVM_PROFILE
+        uint32_t pc = machine_state->PC;
+        uint32_t start = evm_profile_now();
+#endif
         //decode the next instruction
         int status = decode_instruction(machine_state, s_contract[machine_state->PC] , s_contract );
+#if EVM_PROFILE
+        evm_profile_record(s_contract[pc], pc, evm_profile_now() - start);
+#endif
         //check for stack pointer
-        if (machine_state->SP > max_sp)
+        if (machine_state->SP > machine_state->stats.max_sp)
 	{
-            max_sp = machine_state->SP; 
+            machine_state->stats.max_sp = machine_state->SP; 
         }
-        if (status == RETURN)
+        if (status == RETURN || status == REVERT)
         {
             // printf("return!\n");
-            break;
+            return status;
         }
         if (status < 0)
         {
             printf("ERROR!\n");
-            break;
+            return status;
         }
         machine_state->PC ++;
-        if(s_contract[machine_state->PC] == STOP)
+        if(machine_state->PC < size && s_contract[machine_state->PC] == STOP)
 	{
             break;
         }
     }
+    return 0;
+}
+
+// Run the code of the current frame from its PC with the analysis in
+// program. Returns 0 or RETURN on success, REVERT or -1 on failure,
+// EVM_PAUSED if the outermost frame reached SLICE_End.
+static int interpret(Machine *machine_state, const uint8_t *s_contract, uint32_t size) {
+
+#if EVM_AOT && !EVM_NGRAM_STATS && !EVM_PROFILE
+    if (machine_state->program != NULL && machine_state->program->aot != NULL) {
+        return machine_state->program->aot->run(machine_state, s_contract);
+    }
+#endif
+#if EVM_THREADED && !EVM_NGRAM_STATS && !EVM_PROFILE
+    // the plain interpreter only runs bytecode that could not be pre-decoded
+    if (machine_state->program != NULL && machine_state->program->insn_count != 0) {
+        return execute_program(machine_state, machine_state->program, s_contract);
+    }
+#endif
+    return execute_bytecode(machine_state, s_contract, size);
+}
+
+// Run code in the current frame. Returns 0 or RETURN on success, REVERT
+// or -1 on failure.
+static int run_code(Machine *machine_state, const uint8_t *s_contract, uint32_t size) {
+
+    int status;
+
+    if (size == 0) {
+        return 0;
+    }
+    // Analyse once per code hash: JUMPDEST bitmap and pre-decoded stream.
+    // A caller already holding the analysis passes it in program.
+    if (machine_state->program == NULL) {
+        machine_state->program = evm_program_load(s_contract, size);
+    }
+    status = interpret(machine_state, s_contract, size);
+    evm_program_release(machine_state->program);
+    machine_state->program = NULL;
+    return status;
+}
+
+// Set up the call execute_contract() makes without running any of it
+void execute_contract_begin(Machine *machine_state, const uint8_t *s_contract, uint32_t size) {
+
+    machine_state->PC = 0;
+    machine_state->message.codesize = size;
+    machine_state->message.data_memory = NULL;
+    if (!equal256(&machine_state->SELF.address, &machine_state->message.address) ||
+        machine_state->SELF.nonce == 0) {
+        machine_state->SELF.address = machine_state->message.address;
+        machine_state->SELF.nonce = 1;
+    }
+    machine_state->SELF.code = s_contract;
+    machine_state->SELF.code_size = size;
+    machine_state->SELF.storage = &machine_state->STORAGE;
+    machine_state->ACCOUNT = &machine_state->SELF;
+#if EVM_STORAGE_PERSISTENT
+    evm_storage_open(&machine_state->STORAGE, &machine_state->message.address);
+#endif
+    evm_call_mark(machine_state, &machine_state->MARK);
+    keccak_memo_forget(machine_state);
+    if (size != 0 && machine_state->program == NULL) {
+        machine_state->program = evm_program_load(s_contract, size);
+    }
+}
+
+// Run the call set up by execute_contract_begin() for about gas more gas,
+// 0 for no limit. Returns EVM_PAUSED if it is not over yet, otherwise what
+// execute_contract() returns. Nested frames always run to their end, so a
+// step can take longer when the contract calls another one.
+int execute_contract_step(Machine *machine_state, uint32_t gas) {
+
+    const uint8_t *s_contract = machine_state->SELF.code;
+    uint32_t size = machine_state->SELF.code_size;
+    uint64_t end = (uint64_t)machine_state->GAS_Charge + gas;
+    int status = 0;
+
+    machine_state->SLICE_End = gas != 0 && end < UINT32_MAX ? (uint32_t)end : UINT32_MAX;
+    if (size != 0) {
+#if EVM_PROFILE
+        uint32_t start = evm_profile_begin();
+        status = interpret(machine_state, s_contract, size);
+        evm_profile_end(start, status != EVM_PAUSED);
+#else
+        status = interpret(machine_state, s_contract, size);
+#endif
+        if (status == EVM_PAUSED) {
+            return status;
+        }
+    }
+    evm_program_release(machine_state->program);
+    machine_state->program = NULL;
+    // the output was copied, give the pages back to the pool
+    evm_memory_free(&machine_state->MEM);
+    evm_call_finish(machine_state, &machine_state->MARK, status);
+#if EVM_PRINT_STATS
     // End of smart contract execution print stats
-    printf("Stack Pointer :  %u \n",max_sp);
-    printf("Stack usage :  %u \n",max_sp * 256);
-    printf("Memory usage :  %u \n",max_mem_offset) ;
-    printf("Storage usage  :  %u \n",max_storage_counter * 256);
-   
+    print_statistics(machine_state);
+#endif
+    return status;
+}
+
+// Returns 0 or RETURN if the call succeeded, REVERT or -1 if it failed and
+// left the storage as it was
+int execute_contract(Machine *machine_state, const uint8_t *s_contract, uint32_t size) {
+
+    int status;
+
+    execute_contract_begin(machine_state, s_contract, size);
+    status = execute_contract_step(machine_state, 0);
+    return status;
+}
+// Charge dynamic gas, -1 once the call runs out of gas
+static int use_gas(Machine *machine_state, uint64_t gas) {
+    if (gas > GAS_LIMIT || machine_state->GAS_Charge + gas > machine_state->GAS_Limit) {
+        machine_state->GAS_Charge = machine_state->GAS_Limit + 1;
+        printf("Run out of GAS!\n");
+        return -1;
+    }
+    machine_state->GAS_Charge += gas;
+    return 0;
+}
+
+static uint64_t memory_cost(uint64_t words) {
+    return GAS_TABLE.memoryGas * words + words * words / GAS_TABLE.quadCoeffDiv;
+}
+
+// Charge memory expansion for an access of length bytes at offset.
+// Accesses past EVM_MEMORY_SIZE fail, so callers need no bounds checks.
+static int use_memory(Machine *machine_state, uint64_t offset, uint64_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (offset + length < offset || offset + length > UINT32_MAX) {
+        return use_gas(machine_state, (uint64_t)GAS_LIMIT + 1);
+    }
+    if (offset + length > EVM_MEMORY_SIZE) {
+        printf("Memory: access beyond %u bytes\n", EVM_MEMORY_SIZE);
+        return -1;
+    }
+    uint64_t words = (offset + length + 31) / 32;
+    if (words <= machine_state->MEM_Words) {
+        return 0;
+    }
+    if (use_gas(machine_state, memory_cost(words) - memory_cost(machine_state->MEM_Words)) < 0) {
+        return -1;
+    }
+    machine_state->MEM_Words = words;
+    return 0;
+}
+
+static uint64_t words(uint64_t length) {
+    return (length + 31) / 32;
+}
+
+// Copy the output of RETURN/REVERT into the caller's buffer or sink. A
+// nested frame leaves it in its memory for the calling frame.
+static int set_return_data(Machine *machine_state, uint64_t offset, uint64_t length) {
+
+    machine_state->RETURN_Length = 0;
+    if (machine_state->DEPTH > 0) {
+        machine_state->RETURN_Offset = offset;
+        machine_state->RETURN_Length = length;
+        return 0;
+    }
+    if (length > machine_state->RETURN_Capacity) {
+        printf("RETURN: %llu bytes do not fit the return buffer\n", (unsigned long long)length);
+        return -1;
+    }
+    if (machine_state->RETURN_Sink != NULL) {
+        uint8_t chunk[64];
+        for (uint32_t done = 0; done < length; done += sizeof(chunk)) {
+            uint32_t size = length - done < sizeof(chunk) ? length - done : sizeof(chunk);
+            evm_memory_read(&machine_state->MEM, offset + done, chunk, size);
+            if (machine_state->RETURN_Sink(chunk, done, size) < 0) {
+                return -1;
+            }
+        }
+    }
+    else if (length > 0) {
+        evm_memory_read(&machine_state->MEM, offset, machine_state->RETURN_Data, length);
+    }
+    machine_state->RETURN_Length = length;
+    return 0;
+}
+
+// Size of the call data; that of the outermost call is cut to the
+// MESSAGEDATASIZE bytes of message.data
+static uint64_t calldata_size(Machine *machine_state) {
+    if (machine_state->message.data_memory == NULL && machine_state->message.datasize > MESSAGEDATASIZE) {
+        return MESSAGEDATASIZE;
+    }
+    return machine_state->message.datasize;
+}
+
+// length bytes of call data at offset, the range lies within calldata_size()
+static void read_calldata(Machine *machine_state, uint64_t offset, uint8_t *out, uint32_t length) {
+    if (machine_state->message.data_memory != NULL) {
+        evm_memory_read(machine_state->message.data_memory, machine_state->message.data_offset + offset, out, length);
+    }
+    else {
+        memcpy(out, &machine_state->message.data[offset], length);
+    }
+}
+
+// Copy length bytes of the output of the last nested call, from offset
+// on, to dest in memory
+static int copy_return_data(Machine *machine_state, uint64_t dest, uint64_t offset, uint64_t length) {
+    return evm_memory_copy(&machine_state->MEM, dest, &machine_state->RETURNDATA_Pages,
+                           machine_state->RETURNDATA_Offset + offset, length);
+}
+
+static int keccak_memory(void *context, const uint8_t *data, uint32_t length) {
+    keccak_update(context, data, length);
+    return 0;
+}
+
+// The digest of a 32- or 64-byte input, from the memo if the call hashed it
+// before: a function often derives the same mapping slot several times.
+// The limbs of a uint256_t are the digest words keccak256.c gives, most
+// significant first, so it writes into digest directly.
+static void keccak_words(Machine *machine_state, const uint8_t *input, uint8_t length, uint256_t *digest) {
+#if EVM_KECCAK_MEMO
+    evm_keccak_memo_t *memo = machine_state->KECCAK_Memo;
+    evm_keccak_memo_t *oldest = memo;
+
+    machine_state->KECCAK_Clock++;
+    for (int i = 0; i < EVM_KECCAK_MEMO; i++) {
+        if (memo[i].length == length && memcmp(memo[i].input, input, length) == 0) {
+            memo[i].used = machine_state->KECCAK_Clock;
+            *digest = memo[i].hash;
+            return;
+        }
+        if (memo[i].length == 0 || (oldest->length != 0 && memo[i].used < oldest->used)) {
+            oldest = &memo[i];
+        }
+    }
+#endif
+    if (length == 32) {
+        keccak256_32(input, (uint64_t *)digest);
+    }
+    else {
+        keccak256_64(input, (uint64_t *)digest);
+    }
+#if EVM_KECCAK_MEMO
+    memcpy(oldest->input, input, length);
+    oldest->hash = *digest;
+    oldest->used = machine_state->KECCAK_Clock;
+    oldest->length = length;
+#endif
+}
+
+// The low 160 bits of a stack item, an address
+static void stack_address(const uint256_t *item, uint256_t *address) {
+    *address = *item;
+    UPPER(UPPER_P(address)) = 0;
+    LOWER(UPPER_P(address)) &= 0xFFFFFFFF;
+}
+
+// GAS_Limit of a callee that asks for requested gas: it gets all but one
+// 64th of what is left at most
+static uint32_t callee_gas_limit(Machine *machine_state, uint64_t requested) {
+
+    uint32_t left = machine_state->GAS_Limit - machine_state->GAS_Charge;
+    uint32_t most = left - left / 64;
+
+    return machine_state->GAS_Charge + (requested < most ? requested : most);
+}
+
+// Run a precompile as the callee of a call that asks for requested gas,
+// on the input at in_offset. Its output becomes the return data. -1 if it
+// failed, which uses all the gas the callee was given.
+static int run_precompile(Machine *machine_state, const evm_precompile_t *precompile, uint64_t requested, uint64_t in_offset, uint64_t in_length) {
+
+    uint32_t given = callee_gas_limit(machine_state, requested) - machine_state->GAS_Charge;
+    uint32_t gas = precompile->gas(in_length);
+    int32_t length;
+
+    evm_memory_free(&machine_state->RETURNDATA_Pages);
+    machine_state->RETURNDATA_Offset = 0;
+    machine_state->RETURNDATA_Length = 0;
+    if (gas > given) {
+        machine_state->GAS_Charge += given;
+        return -1;
+    }
+    length = precompile->run(&machine_state->MEM, in_offset, in_length, &machine_state->RETURNDATA_Pages);
+    if (length < 0) {
+        evm_memory_free(&machine_state->RETURNDATA_Pages);
+        machine_state->GAS_Charge += given;
+        return -1;
+    }
+    machine_state->GAS_Charge += gas;
+    machine_state->RETURNDATA_Length = length;
+    return 0;
+}
+
+// Address of the contract made by CREATE number nonce of sender, the low
+// 160 bits of keccak256(rlp([sender, nonce]))
+static void create_address(const uint256_t *sender, uint32_t nonce, uint256_t *address) {
+
+    uint8_t rlp[2 + 20 + 5];
+    uint8_t word[32];
+    int length = 22;
+
+    writeu256BE((uint256_t *)sender, word);
+    rlp[1] = 0x80 + 20;
+    memcpy(&rlp[2], &word[12], 20);
+    if (nonce == 0) {
+        rlp[length++] = 0x80;
+    }
+    else if (nonce < 0x80) {
+        rlp[length++] = nonce;
+    }
+    else {
+        int bytes = nonce > 0xFFFFFF ? 4 : nonce > 0xFFFF ? 3 : nonce > 0xFF ? 2 : 1;
+        rlp[length++] = 0x80 + bytes;
+        while (bytes-- > 0) {
+            rlp[length++] = nonce >> (8 * bytes);
+        }
+    }
+    rlp[0] = 0xC0 + length - 1;
+    get_keccak256(rlp, length, word);
+    memset(word, 0, 12);
+    readu256BE(word, address);
+}
+
+// CALL, CALLCODE, DELEGATECALL and STATICCALL: run the code of a contract
+// in a nested frame, or a precompile, and push 1 if it succeeded, 0 if it failed or reverted. There are no
+// balances, a value is only handed on as CALLVALUE.
+static int op_call(Machine *machine_state, uint8_t op_code) {
+
+    int in = OPCODE_INFO[op_code].in;
+    uint256_t address;
+    uint256_t value = {0};
+    evm_account_t *target;
+    const evm_precompile_t *precompile;
+    evm_call_frame_t *frame;
+    uint32_t charged;
+    int status = -1;
+
+    uint256_t *gas = stack_top(machine_state);
+    uint64_t requested = zero128(&UPPER_P(gas)) && UPPER(LOWER_P(gas)) == 0 ? LOWER(LOWER_P(gas)) : UINT64_MAX;
+    stack_address(stack_at(machine_state, 1), &address);
+    if (in == 7) {
+        value = *stack_at(machine_state, 2);
+    }
+    uint64_t in_offset = LOWER(LOWER_P(stack_at(machine_state, in - 4)));
+    uint64_t in_length = LOWER(LOWER_P(stack_at(machine_state, in - 3)));
+    uint64_t out_offset = LOWER(LOWER_P(stack_at(machine_state, in - 2)));
+    uint64_t out_length = LOWER(LOWER_P(stack_at(machine_state, in - 1)));
+    stack_drop(machine_state, in);
+
+    if (use_memory(machine_state, in_offset, in_length) < 0 ||
+        use_memory(machine_state, out_offset, out_length) < 0) {
+        return -1;
+    }
+    if (!zero256(&value)) {
+        if (machine_state->STATIC && op_code == CALL) {
+            printf("CALL: value in a static call\n");
+            return -1;
+        }
+        if (use_gas(machine_state, GAS_TABLE.valueTransferGas) < 0) {
+            return -1;
+        }
+    }
+
+    target = evm_account_find(machine_state, &address);
+    if (target == NULL && (precompile = evm_precompile_find(&address)) != NULL) {
+        status = run_precompile(machine_state, precompile, requested, in_offset, in_length);
+    }
+    else if (target == NULL || target->code_size == 0) {
+        // no code to run, the call succeeds without output
+        evm_memory_free(&machine_state->RETURNDATA_Pages);
+        machine_state->RETURNDATA_Length = 0;
+        status = 0;
+    }
+    else if ((frame = evm_call_enter(machine_state)) != NULL) {
+        charged = machine_state->GAS_Charge;
+        machine_state->GAS_Limit = callee_gas_limit(machine_state, requested);
+        if (!zero256(&value)) {
+            // the stipend comes on top and is not paid by the caller
+            machine_state->GAS_Limit += GAS_TABLE.callStipend;
+        }
+        if (op_code == DELEGATECALL) {
+            machine_state->message.caller = frame->message.caller;
+            machine_state->message.call_value = frame->message.call_value;
+        }
+        else {
+            machine_state->message.caller = frame->message.address;
+            machine_state->message.call_value = value;
+        }
+        if (op_code == CALL || op_code == STATICCALL) {
+            // CALLCODE and DELEGATECALL run the code on the caller's storage
+            machine_state->message.address = address;
+            machine_state->ACCOUNT = target;
+            frame->callee = target;
+        }
+        machine_state->message.datasize = in_length;
+        machine_state->message.data_memory = &frame->MEM;
+        machine_state->message.data_offset = in_offset;
+        machine_state->message.codesize = target->code_size;
+        machine_state->STATIC = frame->STATIC || op_code == STATICCALL;
+
+        status = run_code(machine_state, target->code, target->code_size);
+        evm_call_leave(machine_state, frame, status);
+        // the output of a reverted call is handed back as well
+        if (!zero256(&value)) {
+            uint32_t used = machine_state->GAS_Charge - charged;
+            machine_state->GAS_Charge -= used < GAS_TABLE.callStipend ? used : GAS_TABLE.callStipend;
+        }
+    }
+    if (status >= 0 && out_length > 0 &&
+        copy_return_data(machine_state, out_offset, 0,
+                         out_length < machine_state->RETURNDATA_Length ? out_length : machine_state->RETURNDATA_Length) < 0) {
+        return -1;
+    }
+
+    uint256_t *success = stack_new(machine_state);
+    clear256(success);
+    LOWER(LOWER_P(success)) = EVM_CALL_OK(status);
+    return 0;
+}
+
+// CREATE: run the init code in a nested frame as a new contract, whose
+// code is what it returns. Pushes the address of the contract, 0 if it
+// could not be made.
+static int op_create(Machine *machine_state) {
+
+    uint256_t value;
+    uint256_t address;
+    evm_account_t *account;
+    evm_call_frame_t *frame;
+    uint8_t *init;
+    int status = -1;
+
+    if (machine_state->STATIC) {
+        printf("CREATE: in a static call\n");
+        return -1;
+    }
+    value = *stack_top(machine_state);
+    uint64_t offset = LOWER(LOWER_P(stack_at(machine_state, 1)));
+    uint64_t length = LOWER(LOWER_P(stack_at(machine_state, 2)));
+    stack_drop(machine_state, 3);
+    if (use_memory(machine_state, offset, length) < 0) {
+        return -1;
+    }
+
+    create_address(&machine_state->message.address, machine_state->ACCOUNT->nonce++, &address);
+    evm_memory_free(&machine_state->RETURNDATA_Pages);
+    machine_state->RETURNDATA_Length = 0;
+    if (evm_account_find(machine_state, &address) == NULL &&
+        (frame = evm_call_enter(machine_state)) != NULL) {
+        machine_state->GAS_Limit = callee_gas_limit(machine_state, UINT64_MAX);
+        account = evm_account_create(machine_state, &address);
+        init = account != NULL ? evm_account_code_alloc(account, length) : NULL;
+        if (init != NULL) {
+            evm_memory_read(&frame->MEM, offset, init, length);
+            machine_state->message.caller = frame->message.address;
+            machine_state->message.call_value = value;
+            machine_state->message.address = address;
+            machine_state->message.datasize = 0;
+            machine_state->message.data_memory = NULL;
+            machine_state->message.codesize = length;
+            machine_state->ACCOUNT = account;
+            frame->callee = account;
+            machine_state->STATIC = 0;
+            status = run_code(machine_state, init, length);
+        }
+        if (EVM_CALL_OK(status)) {
+            // the runtime code takes the place of the init code
+            uint32_t size = machine_state->RETURN_Length;
+            uint8_t *runtime = evm_account_code_alloc(account, size);
+            if (runtime == NULL || use_gas(machine_state, (uint64_t)GAS_TABLE.createDataGas * size) < 0) {
+                status = -1;
+            }
+            else {
+                evm_memory_read(&machine_state->MEM, machine_state->RETURN_Offset, runtime, size);
+                account->code = runtime;
+                account->code_size = size;
+                machine_state->RETURN_Length = 0;
+            }
+        }
+        evm_call_leave(machine_state, frame, status);
+    }
+
+    uint256_t *created = stack_new(machine_state);
+    clear256(created);
+    if (EVM_CALL_OK(status)) {
+        *created = address;
+    }
+    return 0;
 }
+
+// A jump must land on a JUMPDEST opcode, never inside PUSH data
+static bool valid_jump(Machine *machine_state, uint256_t *destination, const uint8_t *s_contract) {
+    if (zero128(&UPPER_P(destination)) && UPPER(LOWER_P(destination)) == 0 &&
+        evm_jumpdest_valid(machine_state->program, s_contract, machine_state->message.codesize,
+                           LOWER(LOWER_P(destination)))) {
+        return true;
+    }
+    printf("Invalid jump destination: 0x%llX\n", (unsigned long long)LOWER(LOWER_P(destination)));
+    return false;
+}
+
 //each word-machine parse through the decode state
 int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int8_t *s_contract) { 
     switch (op_code_exc )
@@ -127,9 +719,13 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
                 snprintf(tmp_buf, TMP_BUF_SZ, "\"On-Chip Temp (mC)\":%d",
                     cc2538_temp_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED));
                 puts (tmp_buf);
-                uint256_t temperature;
+                uint256_t temperature = {0};
                 LOWER(LOWER(temperature)) = cc2538_temp_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
                 stack_push(machine_state, temperature);
+            	#else
+                // 0 without a sensor, the opcode always pushes one item
+                uint256_t temperature = {0};
+                stack_push(machine_state, temperature);
             	#endif
 		break;
         }
@@ -137,7 +733,9 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case LED: {
 		
             // printf ("LED sensor\n");
+#ifdef CONTIKI
             leds_on(LEDS_YELLOW);
+#endif
             break; 
 		
         }
@@ -145,9 +743,15 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         //****<< ORIGINAL OPCODES >>****
 	case STOP: { 
 		
+	    if (machine_state->DEPTH > 0) {
+	        // ends a nested frame without output
+	        return RETURN;
+	    }
+#if EVM_PRINT_STATS
 	    printf("STOP..\n");
             // printf("Stack output:  %llu \n", stack_peek(machine_state));
-            printf("GAS spend:  %lu \n", machine_state->GAS_Charge);
+            printf("GAS spend:  %lu \n", (unsigned long)machine_state->GAS_Charge);
+#endif
 	    shutdown_machine(machine_state);
 	    break;
 		
@@ -163,17 +767,8 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case PUSH8: { // Push x bits into the stack 
 		
             // printf( "PC:%li - PUSH \n",machine_state->PC); 
-            if (op_code_exc < 0) {	
-                    printf( "malformed op_code: {PUSH}\n");
-                    break;
-            }
             int numberOfBytes = (int)op_code_exc - (int)PUSH1 + 1;
-            
-            if (machine_state->SP + numberOfBytes >= STACK_SPACE){ 
-                    stack_overflow_err();
-                    return -1;
-            }
-            
+
             machine_state->SP++;
 
             uint64_t element_upp_upp = 0; 
@@ -197,7 +792,6 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
             UPPER(LOWER(machine_state->STACK[machine_state->SP])) = element_upp_low;
             UPPER(UPPER(machine_state->STACK[machine_state->SP])) = element_upp_upp;
 
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
 	    break;
 		
 	} 
@@ -209,52 +803,7 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case PUSH13:
         case PUSH14:
         case PUSH15:
-        case PUSH16: { 
-		
-            if (op_code_exc < 0) {	
-                    printf( "malformed op_code: {PUSH}\n");
-                    break;
-            }
-            int push_code = (int)op_code_exc - (int)PUSH1 ;  
-
-            int numberOfBytes = push_code + 1;
-
-            if (machine_state->SP + numberOfBytes >= STACK_SPACE){ 
-                    stack_overflow_err();
-                    return -1;
-            }
-
-            machine_state->SP++;
-
-            uint64_t element_upp_upp = 0; 
-            uint64_t element_upp_low = 0; 
-            uint64_t element_low_upp = 0; 
-            uint64_t element_low_low = 0; 
-            
-            
-            int size_low_up = push_code - 8;
-            int i;
-            // printf("size_low_up = %d\n",  size_low_up); 
-            for(i = 0; i <= size_low_up; i++)
-            {
-                machine_state->PC ++;
-                element_low_upp = ( element_low_upp  << 8 ) | (uint64_t) s_contract[ machine_state->PC];
-            }
-            for(i = 0; i < 8; i++)
-            {
-                machine_state->PC ++;
-                element_low_low = ( element_low_low  << 8 ) | (uint64_t) s_contract[ machine_state->PC];           
-            }
-            
-            LOWER(LOWER(machine_state->STACK[machine_state->SP])) = element_low_low;
-            LOWER(UPPER(machine_state->STACK[machine_state->SP])) = element_low_upp;
-            UPPER(LOWER(machine_state->STACK[machine_state->SP])) = element_upp_low;
-            UPPER(UPPER(machine_state->STACK[machine_state->SP])) = element_upp_upp;
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
-	    break;
-		
-	}
-		    
+        case PUSH16:
         case PUSH17:
         case PUSH18:
         case PUSH19:
@@ -262,62 +811,7 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case PUSH21:
         case PUSH22:
         case PUSH23:
-        case PUSH24: {
-		
-            if (op_code_exc < 0) {	
-                    printf( "malformed op_code: {PUSH}\n");
-                    break;
-            }
-            int push_code = (int)op_code_exc - (int)PUSH1 ;  
-
-            int numberOfBytes = push_code + 1;
-
-            if (machine_state->SP + numberOfBytes >= STACK_SPACE){ 
-                    stack_overflow_err();
-                    return -1;
-            }
-
-            machine_state->SP++;
-
-            uint64_t element_upp_upp = 0; 
-            uint64_t element_upp_low = 0; 
-            uint64_t element_low_upp = 0; 
-            uint64_t element_low_low = 0; 
-            
-            
-            int size_low_up = push_code - 16;
-            int i;
-            // printf("size_low_up = %d\n",  size_low_up); 
-            for(i = 0; i <= size_low_up; i++)
-            {
-                machine_state->PC ++;
-                 element_upp_low  = ( element_upp_low  << 8 ) | (uint64_t) s_contract[ machine_state->PC];
-            }
-            for(i = 0; i < 8; i++)
-            {
-                machine_state->PC ++;
-                element_low_upp = ( element_low_upp  << 8 ) | (uint64_t) s_contract[ machine_state->PC];           
-            }
-            for(i = 0; i < 8; i++)
-            {
-                machine_state->PC ++;
-                element_low_low = ( element_low_low  << 8 ) | (uint64_t) s_contract[ machine_state->PC];           
-            }
-                        
-            // printf("element upp upp %016llX\n", element_upp_upp);
-            // printf("element upp low %016llX\n", element_upp_low);
-            // printf("element low upp %016llX\n", element_low_upp);
-            // printf("element low low %016llX\n", element_low_low);
-            
-            LOWER(LOWER(machine_state->STACK[machine_state->SP])) = element_low_low;
-            LOWER(UPPER(machine_state->STACK[machine_state->SP])) = element_low_upp;
-            UPPER(LOWER(machine_state->STACK[machine_state->SP])) = element_upp_low;
-            UPPER(UPPER(machine_state->STACK[machine_state->SP])) = element_upp_upp;
-
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
-	    break;
-		
-	} 
+        case PUSH24:
         case PUSH25:
         case PUSH26:
         case PUSH27:
@@ -326,508 +820,331 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case PUSH30:
         case PUSH31:
         case PUSH32: {
-		
-            if (op_code_exc < 0) {	
-                    printf( "malformed op_code: {PUSH}\n");
-                    break;
-            }
-            int push_code = (int)op_code_exc - (int)PUSH1 ;  
 
-            int numberOfBytes = push_code + 1;
+            // right-aligned in a big-endian word, as push_code_bytes() does
+            int numberOfBytes = (int)op_code_exc - (int)PUSH1 + 1;
+            uint8_t word[32] = {0};
 
-            if (machine_state->SP + numberOfBytes >= STACK_SPACE){ 
-                    stack_overflow_err();
-                    return -1;
-            }
-            machine_state->SP++;
+            memcpy(word + 32 - numberOfBytes, &s_contract[machine_state->PC + 1], numberOfBytes);
+            readu256BE(word, stack_new(machine_state));
+            machine_state->PC += numberOfBytes;
+            break;
 
-            uint64_t element_upp_upp = 0; 
-            uint64_t element_upp_low = 0; 
-            uint64_t element_low_upp = 0; 
-            uint64_t element_low_low = 0; 
-            
-            
-            int size_low_up = push_code - 24;
-            int i;
-            // printf("size_low_up = %d\n",  size_low_up); 
-            for(i = 0; i <= size_low_up; i++)
-            {
-                machine_state->PC ++;
-                 element_upp_upp  = ( element_upp_upp  << 8 ) | (uint64_t) s_contract[ machine_state->PC];
-            }
-            for(i = 0; i < 8; i++)
-            {
-                machine_state->PC ++;
-                 element_upp_low  = ( element_upp_low  << 8 ) | (uint64_t) s_contract[ machine_state->PC];
-            }
-            for(i = 0; i < 8; i++)
-            {
-                machine_state->PC ++;
-                element_low_upp = ( element_low_upp  << 8 ) | (uint64_t) s_contract[ machine_state->PC];           
-            }
-            for(i = 0; i < 8; i++)
-            {
-                machine_state->PC ++;
-                element_low_low = ( element_low_low  << 8 ) | (uint64_t) s_contract[ machine_state->PC];           
-            }
-                        
-            // printf("element upp upp %016llX\n", element_upp_upp);
-            // printf("element upp low %016llX\n", element_upp_low);
-            // printf("element low upp %016llX\n", element_low_upp);
-            // printf("element low low %016llX\n", element_low_low);
-            
-            LOWER(LOWER(machine_state->STACK[machine_state->SP])) = element_low_low;
-            LOWER(UPPER(machine_state->STACK[machine_state->SP])) = element_low_upp;
-            UPPER(LOWER(machine_state->STACK[machine_state->SP])) = element_upp_low;
-            UPPER(UPPER(machine_state->STACK[machine_state->SP])) = element_upp_upp;
+        }
 
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
-	    break;
-		
-	}
-		    
 	case ADD: { // Add top two values of the stack 
 		
-            uint256_t target = {0};
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
+            uint256_t *number_1 = stack_top(machine_state);
+            uint256_t *number_2 = stack_at(machine_state, 1);
 
-            add256( &number_1, &number_2, &target);
-            stack_push(machine_state, target);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            add256(number_1, number_2, number_2);
+            stack_drop(machine_state, 1);
 	    break;
 	} 
 		
 	case MUL: { // Multiply top two values of the stack
         
-	    uint256_t target = {0};
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
+            uint256_t *number_1 = stack_top(machine_state);
+            uint256_t *number_2 = stack_at(machine_state, 1);
 
-            mul256( &number_1, &number_2, &target);        
-            stack_push(machine_state,target);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas5;
+            mul256(number_1, number_2, number_2);
+            stack_drop(machine_state, 1);
 	    break;
 		
         }
 		    
 	case SUB: { // Subtract top two values of the stack
 		
-            uint256_t target = {0};
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
+            uint256_t *number_1 = stack_top(machine_state);
+            uint256_t *number_2 = stack_at(machine_state, 1);
 
-            minus256( &number_1, &number_2, &target);            
-            stack_push(machine_state, target);
+            minus256(number_1, number_2, number_2);
+            stack_drop(machine_state, 1);
             break;
         }
 	    
-	case DIV: { // Divide (unsign) top two values of the stack 
+	case DIV: // Divide (unsign) top two values of the stack 
+	case SDIV: { // SDIV top two values of the stack
 		
-            uint256_t target = {0};                      
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
-            if( zero256(&number_2)){
-                printf("divide by zero\n");
+            uint256_t modulo;
+            uint256_t *number_1 = stack_top(machine_state);
+            uint256_t *number_2 = stack_at(machine_state, 1);
+            // division by zero gives zero
+            if (zero256(number_2)) {
+                clear256(number_2);
             }
-            else{
-                divmod256( &number_1, &number_2, &target, NULL);            
+            else {
+                divmod256(number_1, number_2, number_2, &modulo);
             }
-            stack_push(machine_state, target);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas5;
+            stack_drop(machine_state, 1);
             break;
 		
         }
 
-	case SDIV: { // SDIV top two values of the stack
-		
-            uint256_t target = {0};
-            uint256_t modulo = {0};                      
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
-
-            divmod256( &number_1, &number_2, &target, &modulo);            
-            stack_push(machine_state, target);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas5;
-            break;
-		
-        }
-
-	case MOD: { // Modulo using top two of the stack
-		
-            uint256_t target = {0};
-            uint256_t modulo = {0};                      
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
-
-            divmod256( &number_1, &number_2, &target, &modulo);            
-            stack_push(machine_state, modulo);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas5;
-            break;
-		
-        } 
-	
+	case MOD: // Modulo using top two of the stack
 	case SMOD: { // SMOD
 		
-            uint256_t target = {0};
-            uint256_t modulo = {0};                      
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
-
-            divmod256( &number_1, &number_2, &target, &modulo);            
-            stack_push(machine_state, modulo);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas5;
+            uint256_t target;
+            uint256_t *number_1 = stack_top(machine_state);
+            uint256_t *number_2 = stack_at(machine_state, 1);
+            if (zero256(number_2)) {
+                clear256(number_2);
+            }
+            else {
+                divmod256(number_1, number_2, &target, number_2);
+            }
+            stack_drop(machine_state, 1);
             break;
 		
         } 
 	
 	case ADDMOD: {	//Add two values and modulo N (take the three values from strack)	
 		
-            uint256_t  div = {0};
-            uint256_t  modulo = {0}; 
-            uint256_t  sum = {0};                     
-            uint256_t  number_1 = stack_pop(machine_state);
-            uint256_t  number_2 = stack_pop(machine_state);
-            uint256_t  modulo_N = stack_pop(machine_state);
-
-            add256( &number_1, &number_2, &sum);
-            divmod256( &sum, &modulo_N, &div, &modulo);         
-            stack_push(machine_state, modulo);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas5;
+            uint256_t div;
+            uint256_t sum;
+            uint256_t *number_1 = stack_top(machine_state);
+            uint256_t *number_2 = stack_at(machine_state, 1);
+            uint256_t *modulo_N = stack_at(machine_state, 2);
+
+            if (zero256(modulo_N)) {
+                clear256(modulo_N);
+            }
+            else {
+                add256(number_1, number_2, &sum);
+                divmod256(&sum, modulo_N, &div, modulo_N);
+            }
+            stack_drop(machine_state, 2);
             break;
 		
         } 
 
 	case MULMOD: { //Multiply two values and modulo N (take the three values from strack)
 		
-            uint256_t number_1 = stack_pop(machine_state);
-            uint256_t number_2 = stack_pop(machine_state);
-            uint256_t modulo_N = stack_pop(machine_state);
-            uint256_t mul_res = {0};
-            uint256_t modulo = {0};
-            uint256_t div = {0};
-
-            mul256( &number_1, &number_2, &mul_res);
-            divmod256( &mul_res, &modulo_N, &div, &modulo);     
-            stack_push(machine_state,  modulo );
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas8;
+            uint256_t div;
+            uint256_t mul_res;
+            uint256_t *number_1 = stack_top(machine_state);
+            uint256_t *number_2 = stack_at(machine_state, 1);
+            uint256_t *modulo_N = stack_at(machine_state, 2);
+
+            if (zero256(modulo_N)) {
+                clear256(modulo_N);
+            }
+            else {
+                mul256(number_1, number_2, &mul_res);
+                divmod256(&mul_res, modulo_N, &div, modulo_N);
+            }
+            stack_drop(machine_state, 2);
             break;
 		
         }
 	
 	case EXP: { // Exponentiation modulo top two values of the stack
 
-            // very inefficient way to implement this
-            uint256_t base = stack_pop(machine_state);
-            uint64_t exponent = LOWER(LOWER( stack_pop(machine_state)));
-            uint256_t accumulator={0};
-            uint256_t result ={0};
-            uint64_t i;
-            if (exponent == 0){
-                LOWER(LOWER( result)) =0x01;
+            uint256_t base = *stack_top(machine_state);
+            uint256_t *exponent = stack_at(machine_state, 1);
+            uint32_t exponent_bits = bits256(exponent);
+            if (use_gas(machine_state, GAS_TABLE.expByteGas * ((exponent_bits + 7) / 8)) < 0) {
+                return -1;
             }
-            else{
-                for (i = 0; i < exponent; i ++){
-                    mul256( &base, &accumulator, &result);
-                    accumulator = result;
+            // square and multiply over the exponent bits, low to high
+            uint64_t limbs[4] = {
+                LOWER(LOWER_P(exponent)), UPPER(LOWER_P(exponent)),
+                LOWER(UPPER_P(exponent)), UPPER(UPPER_P(exponent))
+            };
+            clear256(exponent);
+            LOWER(LOWER_P(exponent)) = 0x01;
+            for (uint32_t i = 0; i < exponent_bits; i++) {
+                if ((limbs[i / 64] >> (i % 64)) & 1) {
+                    mul256(exponent, &base, exponent);
                 }
+                mul256(&base, &base, &base);
             }
-            stack_push(machine_state, result);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas10;
+            stack_drop(machine_state, 1);
             break;
 		
         }
 		    
         case SIGNEXTEND: { // Sign and extends using top two 
 		
-            printf("SIGNEXTEND not supported\n");
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas5;
+            uint256_t *size = stack_top(machine_state);
+            uint256_t *value = stack_at(machine_state, 1);
+            // extend the sign of byte b counted from the right, b < 31
+            if (zero128(&UPPER_P(size)) && UPPER(LOWER_P(size)) == 0 && LOWER(LOWER_P(size)) < 31) {
+                uint8_t word[32];
+                int sign = 31 - (int)LOWER(LOWER_P(size));
+                writeu256BE(value, word);
+                memset(word, word[sign] & 0x80 ? 0xff : 0x00, sign);
+                readu256BE(word, value);
+            }
+            stack_drop(machine_state, 1);
             break;
 		
         } 
 
-	case LT: { // Less Than comparison top two 
-		
-            uint256_t  top = stack_pop(machine_state);
-            uint256_t  bot = stack_pop(machine_state);
-            uint256_t zeroORone = {0};
-
-            bool bot_greater = gt256(&bot, &top);
-			if (bot_greater){
-                LOWER(LOWER(zeroORone)) = 0x01;
-				stack_push(machine_state, zeroORone);
-            }
-			else{
-				stack_push(machine_state, zeroORone);
-            }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
-            break;
-		
-        }
-		    
-	case GT: { // Greater than comparion top two 
-		
-            uint256_t  top = stack_pop(machine_state);
-            uint256_t  bot = stack_pop(machine_state);
-            uint256_t zeroORone = {0};
-
-            bool top_greater = gt256(&top, &bot);
-			if (top_greater){
-                LOWER(LOWER(zeroORone)) = 0x01;
-				stack_push(machine_state, zeroORone);
-            }
-			else{
-				stack_push(machine_state, zeroORone);
-            }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
-            break;
-		
-        } 
-		    
+	case LT: // Less Than comparison top two 
 	case SLT: { // Less Than comparison treat values by 2 compliment (note: in C values are 2complement by default)
 		
-            uint256_t  top = stack_pop(machine_state);
-            uint256_t  bot = stack_pop(machine_state);
-            uint256_t zeroORone = {0};
-
-            bool bot_greater = gt256(&bot, &top);
-			if (bot_greater){
-                LOWER(LOWER(zeroORone)) = 0x01;
-				stack_push(machine_state, zeroORone);
-            }
-			else{
-				stack_push(machine_state, zeroORone);
-            }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            uint256_t *top = stack_top(machine_state);
+            uint256_t *bot = stack_at(machine_state, 1);
+
+            bool bot_greater = gt256(bot, top);
+            clear256(bot);
+            LOWER(LOWER_P(bot)) = bot_greater;
+            stack_drop(machine_state, 1);
             break;
 		
         }
 		    
+	case GT: // Greater than comparion top two 
 	case SGT: { //Greater Than comparison treat values by 2 compliment (note: in C values are 2complement by default)
 		
-            uint256_t  top = stack_pop(machine_state);
-            uint256_t  bot = stack_pop(machine_state);
-            uint256_t zeroORone = {0};
-            bool top_greater = gt256(&top, &bot);
-			if (top_greater){
-                LOWER(LOWER(zeroORone)) = 0x01;
-				stack_push(machine_state, zeroORone);
-            }
-			else{
-				stack_push(machine_state, zeroORone);
-            }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            uint256_t *top = stack_top(machine_state);
+            uint256_t *bot = stack_at(machine_state, 1);
+
+            bool top_greater = gt256(top, bot);
+            clear256(bot);
+            LOWER(LOWER_P(bot)) = top_greater;
+            stack_drop(machine_state, 1);
             break;
 		
 	}
 		    
 	case EQ: { // Equal comparison 
 		
-            uint256_t  top = stack_pop(machine_state);
-            uint256_t  bot = stack_pop(machine_state);
-            uint256_t zeroORone = {0};
-            bool TopBotEquals = equal256(&top, &bot);
-			if (TopBotEquals){
-                LOWER(LOWER(zeroORone)) = 0x01;
-				stack_push(machine_state, zeroORone);
-            }
-			else{
-				stack_push(machine_state, zeroORone);
-            }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            uint256_t *top = stack_top(machine_state);
+            uint256_t *bot = stack_at(machine_state, 1);
+
+            bool TopBotEquals = equal256(top, bot);
+            clear256(bot);
+            LOWER(LOWER_P(bot)) = TopBotEquals;
+            stack_drop(machine_state, 1);
             break;
 		
 	} 
 	
 	case ISZERO: { // Test if top is zero
 		
-            uint256_t  top = stack_pop(machine_state);
-            uint256_t zeroORone = {0};
-            bool TopZero = zero256(&top);
-	    if (TopZero){
-                LOWER(LOWER(zeroORone)) = 0x01;
-				stack_push(machine_state, zeroORone);
-            }
-	    else{
-		stack_push(machine_state, zeroORone);
-            }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            uint256_t *top = stack_top(machine_state);
+
+            bool TopZero = zero256(top);
+            clear256(top);
+            LOWER(LOWER_P(top)) = TopZero;
             break;
 		
 	}
 		    
 	case AND: { // AND on top two values
 		
-            uint256_t top = stack_pop(machine_state);
-            uint256_t bot = stack_pop(machine_state);
-            uint256_t andRes = {0};
-            and256(&top,&bot,&andRes);
+            uint256_t *top = stack_top(machine_state);
+            uint256_t *bot = stack_at(machine_state, 1);
 
-            stack_push(machine_state, andRes);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            and256(top, bot, bot);
+            stack_drop(machine_state, 1);
             break;
 		
 	}
 		    
 	case OR: { // OR on top two values
 		
-            uint256_t top = stack_pop(machine_state);
-            uint256_t bot = stack_pop(machine_state);
-            uint256_t orRes = {0};
-            or256(&top,&bot,&orRes);
+            uint256_t *top = stack_top(machine_state);
+            uint256_t *bot = stack_at(machine_state, 1);
 
-            stack_push(machine_state, orRes);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            or256(top, bot, bot);
+            stack_drop(machine_state, 1);
             break;		
 		
 	} 
 		    
 	case XOR: { // XOR on top two values
 		
-            uint256_t top = stack_pop(machine_state);
-            uint256_t bot = stack_pop(machine_state);
-            uint256_t xorRes = {0};
-            xor256(&top,&bot,&xorRes);
-	    stack_push(machine_state, xorRes);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            uint256_t *top = stack_top(machine_state);
+            uint256_t *bot = stack_at(machine_state, 1);
+
+            xor256(top, bot, bot);
+            stack_drop(machine_state, 1);
             break;	
 		
 	} 
 
 	case NOT: { // NOT on top value 
 		
-            uint256_t top = stack_pop(machine_state);
-            not256(&top);
-			stack_push(machine_state, top);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            not256(stack_top(machine_state));
             break;	
 		
 	}
 		    
 	case BYTE: { // BYTE on top two values
 		
-            uint256_t i = stack_pop(machine_state);
-            uint256_t x = stack_pop(machine_state);
-            uint32_t shift_value = (uint32_t) LOWER(LOWER(i));
+            uint256_t *i = stack_top(machine_state);
+            uint256_t *x = stack_at(machine_state, 1);
+            uint32_t shift_value = (uint32_t) LOWER(LOWER_P(i));
             shift_value = 248 - shift_value * 8 ;
-            uint256_t target = {0};
-            shiftr256(&x,shift_value, &target);
-            uint256_t tmp0ff = {0};
-            LOWER(LOWER(tmp0ff))= 0xFF;
-            uint256_t y = {0};
-            and256(&target,&tmp0ff,&y);
-            stack_push(machine_state,y);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            shiftr256(x, shift_value, x);
+            uint64_t y = LOWER(LOWER_P(x)) & 0xFF;
+            clear256(x);
+            LOWER(LOWER_P(x)) = y;
+            stack_drop(machine_state, 1);
             break;	
 		
 	}
 		    
         case SHL: { //shift left
 		
-            uint256_t shift = stack_pop(machine_state);
-            uint256_t value = stack_pop(machine_state);
-            uint32_t shift_v = (uint32_t) LOWER(LOWER(shift));
-            uint256_t target = {0};
-            shiftl256(&value,shift_v, &target);
-            stack_push(machine_state,target); 
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            uint256_t *shift = stack_top(machine_state);
+            uint256_t *value = stack_at(machine_state, 1);
+            uint32_t shift_v = (uint32_t) LOWER(LOWER_P(shift));
+            shiftl256(value, shift_v, value);
+            stack_drop(machine_state, 1);
             break;
 		
 	}
 		    
-        case SHR: { // shift right
-		
-            uint256_t shift = stack_pop(machine_state);
-            uint256_t value = stack_pop(machine_state);
-            uint32_t shift_v = (uint32_t) LOWER(LOWER(shift));
-            uint256_t target = {0};
-            shiftr256(&value,shift_v, &target);
-            stack_push(machine_state,target);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
-            break;	
-		
-	}
-		    
+        case SHR: // shift right
         case SAR: { // shift int right
-
-	    uint256_t shift = stack_pop(machine_state);
-            uint256_t value = stack_pop(machine_state);
-            uint32_t shift_v = (uint32_t) LOWER(LOWER(shift));
-            uint256_t target = {0};
-            shiftr256(&value,shift_v, &target);
-            stack_push(machine_state,target);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+		
+            uint256_t *shift = stack_top(machine_state);
+            uint256_t *value = stack_at(machine_state, 1);
+            uint32_t shift_v = (uint32_t) LOWER(LOWER_P(shift));
+            shiftr256(value, shift_v, value);
+            stack_drop(machine_state, 1);
             break;
 		
 	}
 		    
-        case SHA3:{
-		
-            uint256_t Offset_256 = stack_pop(machine_state);
-            uint256_t Length_256 = stack_pop(machine_state);
-
-            uint64_t offset = LOWER(LOWER(Offset_256));
-            uint64_t length = LOWER(LOWER(Length_256));
-            // printf("Offset: %llu\n",offset);
-            // printf("length: %llu\n",length);
-            if( length > 256){
+        case SHA3: {
+            uint64_t offset = LOWER(LOWER_P(stack_top(machine_state)));
+            uint64_t length = LOWER(LOWER_P(stack_at(machine_state, 1)));
+            uint256_t *digest = stack_at(machine_state, 1);
+            SHA3_CTX context;
+
+            if (use_gas(machine_state, GAS_TABLE.sha3WordGas * words(length)) < 0 ||
+                use_memory(machine_state, offset, length) < 0) {
                 return -1;
             }
-            uint8_t data[length];
-
-            if (offset < 0 ||  offset > MEMORY_SPACE)
-            {
-                printf("MEM Offeset: 0x%llX is invalid\n" , offset);
-            }
-            else{
-                memcpy(&data, &machine_state->MEM[offset], sizeof( uint8_t ) * length);
-            }
-
-            // ARM stores little endian -> Reverse as uint64
-            uint64_t *ptr = (uint64_t *)& data;
-            for (int i = 0; i < 4; i++){
-                ptr[i] = swapLong(&ptr[i]);
-            }
-            uint8_t result[32];
-
-            get_keccak256(data, sizeof( uint8_t ) * 32, result);
-
-            uint64_t element_upp_upp = 0; 
-            uint64_t element_upp_low = 0; 
-            uint64_t element_low_upp = 0; 
-            uint64_t element_low_low = 0;
-            int i = 0;
-            for(i = 0; i <8; i++)
-            {
-                element_upp_upp  = ( element_upp_upp  << 8 ) | (uint64_t) result[i];
-            }
-            for(i = 8; i < 16; i++)
-            {
-                element_upp_low  = ( element_upp_low  << 8 ) | (uint64_t) result[i];
-            }
-            for(i = 16; i < 24; i++)
-            {
-                element_low_upp = ( element_low_upp  << 8 ) | (uint64_t) result[i];           
+            if (length == 32 || length == 64) {
+                uint32_t span = length;
+                const uint8_t *input = evm_memory_span(&machine_state->MEM, offset, &span);
+                uint8_t copy[64];
+                // hashed in its page, copied only if it crosses into the
+                // next one or lies in an untouched page
+                if (input == NULL || span < length) {
+                    evm_memory_read(&machine_state->MEM, offset, copy, length);
+                    input = copy;
+                }
+                keccak_words(machine_state, input, length, digest);
             }
-            for(i = 24; i < 32; i++)
-            {
-                element_low_low = ( element_low_low  << 8 ) | (uint64_t) result[i];           
+            else {
+                // absorb the memory in place, page by page
+                keccak_init(&context);
+                evm_memory_each(&machine_state->MEM, offset, length, keccak_memory, &context);
+                keccak_final_words(&context, (uint64_t *)digest);
             }
-
-            uint256_t hashTOpush = {0};
-            LOWER(LOWER(hashTOpush)) = element_low_low;
-            LOWER(UPPER(hashTOpush)) = element_low_upp;
-            UPPER(LOWER(hashTOpush)) = element_upp_low;
-            UPPER(UPPER(hashTOpush)) = element_upp_upp;
-            
-            stack_push(machine_state, hashTOpush);
+            stack_drop(machine_state, 1);
             break;
-		
         }
 
         case ADDRESS: {
             stack_push(machine_state,  machine_state->message.address);            
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
 	    break;
 		
         }
@@ -835,7 +1152,6 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case CALLER: {
 
             stack_push(machine_state,  machine_state->message.caller);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
 	    break;
 		
         }
@@ -843,41 +1159,21 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case CALLVALUE: {
 
             stack_push(machine_state,  machine_state->message.call_value);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
  	    break;
 		
         }
 		    
         case CALLDATALOAD: {
 		
-            // printf("CALLDATALOAD: CAREFULL WITH SIZE AND BYTE ORDER\n");
-            // uint256_t index = stack_pop(machine_state);
-            uint32_t offset = LOWER(LOWER(stack_pop(machine_state)));
-            uint256_t dataFROMmessage ={0};
-
-            if (offset < 0 ||  offset > MESSAGEDATASIZE)
-            {
-                printf("DATA Offeset: 0x%lX is invalid\n" , offset);
-            }
-            else if ( offset == 0){
-                uint64_t function_name = 0;
-                memcpy(&function_name, &machine_state->message.data[offset] , sizeof(uint8_t) *4 );
-                // printf("fucnction nname %llX",swapLong (&function_name));
-                UPPER(UPPER(dataFROMmessage)) = swapLong (&function_name);
-                stack_push(machine_state, dataFROMmessage);
-
-            }
-            else
-            {    
-                memcpy(&dataFROMmessage, &machine_state->message.data[offset], sizeof( uint8_t ) * 32);
-
-                UPPER(UPPER(dataFROMmessage)) = swapLong (&UPPER(UPPER(dataFROMmessage)));
-                UPPER(LOWER(dataFROMmessage)) = swapLong (&UPPER(LOWER(dataFROMmessage)));
-                LOWER(UPPER(dataFROMmessage)) = swapLong (&LOWER(UPPER(dataFROMmessage)));
-                LOWER(LOWER(dataFROMmessage)) = swapLong (&LOWER(LOWER(dataFROMmessage)));
-
-                stack_push(machine_state, dataFROMmessage);
+            uint256_t *top = stack_top(machine_state);
+            uint64_t datasize = calldata_size(machine_state);
+            uint8_t word[32] = {0};
+            // bytes past the end of the call data read as zero
+            if (zero128(&UPPER_P(top)) && UPPER(LOWER_P(top)) == 0 && LOWER(LOWER_P(top)) < datasize) {
+                uint64_t offset = LOWER(LOWER_P(top));
+                read_calldata(machine_state, offset, word, datasize - offset < 32 ? datasize - offset : 32);
             }
+            readu256BE(word, top);
             break;
 
         }
@@ -886,7 +1182,8 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
 		
             // printf("CALLDATASIZE: data size is limited \n");
             uint256_t sizeofdata = {0};
-            LOWER(LOWER(sizeofdata)) = machine_state->message.datasize ; 
+            // what CALLDATALOAD and CALLDATACOPY can read
+            LOWER(LOWER(sizeofdata)) = calldata_size(machine_state);
             stack_push(machine_state,sizeofdata);
             break;
 
@@ -894,24 +1191,39 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
 
         case CALLDATACOPY: {
             
-            // printf("CALLDATACOPY: CARE ABOUT MEM SIZE AND BYTEORDER \n");
-            uint64_t destOffset = LOWER(LOWER(stack_pop(machine_state)));
-            uint64_t offset = LOWER(LOWER(stack_pop(machine_state)));
-            uint64_t length = LOWER(LOWER(stack_pop(machine_state)));
+            uint64_t destOffset = LOWER(LOWER_P(stack_top(machine_state)));
+            uint64_t offset = LOWER(LOWER_P(stack_at(machine_state, 1)));
+            uint64_t length = LOWER(LOWER_P(stack_at(machine_state, 2)));
+            stack_drop(machine_state, 3);
             // printf("CALLDATACOPY: length(%llu)+ offdet(%llu) \n",length,destOffset);
-            if( (destOffset + length) < 0 || (destOffset + length) > MEMORY_SPACE ){
-               printf("CALLDATACOPY: length(%llu)+ offdet(%llu) out of memory bound\n",length,destOffset);
+            if (use_gas(machine_state, GAS_TABLE.copyGas * words(length)) < 0 ||
+                use_memory(machine_state, destOffset, length) < 0) {
+                return -1;
             }
-            else if  ( (offset + length) < 0 || (offset + length) > MESSAGEDATASIZE ) {
-               printf("CALLDATACOPY: length(%llu)+ msg.data [(%llu)] out of memory bound\n",length,offset);
+            // bytes past the end of the call data read as zero
+            uint64_t datasize = calldata_size(machine_state);
+            uint64_t available = 0;
+            if (offset < datasize) {
+                available = datasize - offset;
+                if (available > length) {
+                    available = length;
+                }
             }
-            else{
-                memcpy(&machine_state->MEM[destOffset] , &s_contract[ offset], sizeof( uint8_t ) * length);
-                 if (destOffset + length > max_mem_offset){
-                    max_mem_offset = destOffset + length ; 
+            for (uint64_t done = 0; done < available; ) {
+                uint8_t chunk[64];
+                uint32_t size = available - done < sizeof(chunk) ? available - done : sizeof(chunk);
+                read_calldata(machine_state, offset + done, chunk, size);
+                if (evm_memory_write(&machine_state->MEM, destOffset + done, chunk, size) < 0) {
+                    return -1;
                 }
+                done += size;
+            }
+            if (evm_memory_write(&machine_state->MEM, destOffset + available, NULL, length - available) < 0) {
+                return -1;
+            }
+            if (destOffset + length > machine_state->stats.max_mem_offset){
+                machine_state->stats.max_mem_offset = destOffset + length ; 
             }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
             break;
                 
         }
@@ -921,83 +1233,112 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
             // printf("RETURN !\n");
             uint64_t offset = LOWER(LOWER (  stack_pop(machine_state)));
             uint64_t length = LOWER(LOWER (  stack_pop(machine_state)));
-            if( (offset + length) < 0 || (offset + length) > MEMORY_SPACE ){
-               printf("MEM: length(%llu) with offdet(%llX) out of memory bound\n",length,offset);
-                length = MEMORY_SPACE - 1 ;
-                offset = 0;
+            if (use_memory(machine_state, offset, length) < 0 ||
+                set_return_data(machine_state, offset, length) < 0) {
+                return -1;
             }
-            uint8_t return_value[ offset + length ];
-            memcpy(&return_value, &machine_state->MEM[offset] , sizeof( uint8_t ) * length);
-            DeployLength = offset +length;
-
-            memcpy(&deployed_contract, &return_value , sizeof( uint8_t ) * length);
             return RETURN;
             break;
                 
         }
 
+        case EXTCODESIZE: {
+
+            uint256_t *top = stack_top(machine_state);
+            uint256_t address;
+            stack_address(top, &address);
+            evm_account_t *account = evm_account_find(machine_state, &address);
+            clear256(top);
+            LOWER(LOWER_P(top)) = account != NULL ? account->code_size : 0;
+            break;
+
+        }
+
+        case RETURNDATASIZE: {
+
+            uint256_t *top = stack_new(machine_state);
+            clear256(top);
+            LOWER(LOWER_P(top)) = machine_state->RETURNDATA_Length;
+            break;
+
+        }
+
+        case RETURNDATACOPY: {
+
+            uint64_t destOffset = LOWER(LOWER_P(stack_top(machine_state)));
+            uint64_t offset = LOWER(LOWER_P(stack_at(machine_state, 1)));
+            uint64_t length = LOWER(LOWER_P(stack_at(machine_state, 2)));
+            stack_drop(machine_state, 3);
+            // unlike call data, reading past the end is an error
+            if (offset + length < offset || offset + length > machine_state->RETURNDATA_Length) {
+                printf("RETURNDATACOPY: beyond the %lu bytes of return data\n", (unsigned long)machine_state->RETURNDATA_Length);
+                return -1;
+            }
+            if (use_gas(machine_state, GAS_TABLE.copyGas * words(length)) < 0 ||
+                use_memory(machine_state, destOffset, length) < 0 ||
+                copy_return_data(machine_state, destOffset, offset, length) < 0) {
+                return -1;
+            }
+            if (destOffset + length > machine_state->stats.max_mem_offset){
+                machine_state->stats.max_mem_offset = destOffset + length;
+            }
+            break;
+
+        }
+
+        case GAS: {
+
+            uint256_t *top = stack_new(machine_state);
+            clear256(top);
+            LOWER(LOWER_P(top)) = machine_state->GAS_Limit - machine_state->GAS_Charge;
+            break;
+
+        }
+
+        case CALL:
+        case CALLCODE:
+        case DELEGATECALL:
+        case STATICCALL: {
+            return op_call(machine_state, op_code_exc);
+        }
+
+        case CREATE: {
+            return op_create(machine_state);
+        }
+
         case BALANCE: {
             //printf("BALANCE: BALANCE of contract not available on local exc...\n");
+            clear256(stack_top(machine_state));
             break;
         }
                     
         case CODECOPY:{
                 
-            uint64_t MEMOffset = LOWER(LOWER (stack_pop(machine_state)));
-            uint64_t Offset = LOWER(LOWER (stack_pop(machine_state)));
-            uint64_t length =  LOWER(LOWER (stack_pop(machine_state)));
+            uint64_t MEMOffset = LOWER(LOWER_P(stack_top(machine_state)));
+            uint64_t Offset = LOWER(LOWER_P(stack_at(machine_state, 1)));
+            uint64_t length = LOWER(LOWER_P(stack_at(machine_state, 2)));
+            stack_drop(machine_state, 3);
             // printf("CODECOPY:  MEMOffset 0x%llX ,Offset 0x%llX , length 0x%llu  \n", MEMOffset,Offset,length);
-            if( (MEMOffset ) < 0 || (MEMOffset) > MEMORY_SPACE ){
-               printf("CODECOPY: length(%llu)+ offdet(%llXF) out of memory bound\n",length,MEMOffset);
+            if (use_gas(machine_state, GAS_TABLE.copyGas * words(length)) < 0 ||
+                use_memory(machine_state, MEMOffset, length) < 0) {
+                return -1;
             }
-            else if (length < 100){
-                if (MEMOffset + length > max_mem_offset){
-                    max_mem_offset = MEMOffset + length; 
-                }
-                int len = length ;
-                while (len > 0 ) {
-                    uint64_t element_upp_upp = 0;
-                    uint64_t element_upp_low = 0;
-                    uint64_t element_low_upp = 0;
-                    uint64_t element_low_low = 0;
-                    int i;
-                    for(i = 0; i < 8; i++)
-                    {
-                        element_upp_upp  = ( element_upp_upp  << 8 ) | (uint64_t) s_contract[ Offset];
-                        Offset++;
-                        len --;
-                    }
-
-                    for(i = 0; i < 8; i++)
-                    {
-                        element_upp_low  = ( element_upp_low  << 8 ) | (uint64_t) s_contract[ Offset];
-                        Offset++;
-                         len --;
-                    }
-                    for(i = 0; i < 8; i++)
-                    {
-                        element_low_upp  = ( element_low_upp  << 8 ) | (uint64_t) s_contract[ Offset];
-                        Offset++;
-                         len --;
-                    }
-                    for(i = 0; i < 8; i++)
-                    {
-                        element_low_low  = ( element_low_low  << 8 ) | (uint64_t) s_contract[ Offset];
-                        Offset++;
-                        len --;
-                    }
-
-                    memcpy(&machine_state->MEM[MEMOffset] , &element_upp_upp,  sizeof(element_upp_upp));
-                    memcpy(&machine_state->MEM[MEMOffset] , &element_upp_low,  sizeof(element_upp_upp));
-                    memcpy(&machine_state->MEM[MEMOffset] , &element_low_upp,  sizeof(element_upp_upp));
-                    memcpy(&machine_state->MEM[MEMOffset] , &element_low_low,  sizeof(element_upp_upp));
-
+            // bytes past the end of the code read as zero
+            uint64_t available = 0;
+            if (Offset < machine_state->message.codesize) {
+                available = machine_state->message.codesize - Offset;
+                if (available > length) {
+                    available = length;
                 }
             }
-            else{
-                memcpy(&machine_state->MEM[MEMOffset] , &s_contract[Offset],  length);
+            if ((available > 0 &&
+                 evm_memory_write(&machine_state->MEM, MEMOffset, &s_contract[Offset], available) < 0) ||
+                evm_memory_write(&machine_state->MEM, MEMOffset + available, NULL, length - available) < 0) {
+                return -1;
+            }
+            if (MEMOffset + length > machine_state->stats.max_mem_offset){
+                machine_state->stats.max_mem_offset = MEMOffset + length; 
             }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
             break;
                 
         }
@@ -1013,8 +1354,7 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case POP: { //POP the first element and discard it
         
             // printf("[DEBUG]POP Opcode: discard the first element from the stack\n");
-            stack_pop(machine_state);
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas2;
+            stack_drop(machine_state, 1);
             break;
                 
         }
@@ -1022,105 +1362,79 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
 
         case MLOAD: {
                 
-            uint64_t offset = LOWER(LOWER ( stack_pop(machine_state)));
+            uint256_t *top = stack_top(machine_state);
+            uint64_t offset = LOWER(LOWER_P(top));
             // printf("MLOAD 0x%llX\n", offset);
-            if (offset < 0 ||  offset > MEMORY_SPACE)
-            {
-                // printf("MEM Offeset: 0x%llX is invalid\n" , offset);
-            }
-            else
-            {    
-                uint256_t value= {0};
-                memcpy(&value, &machine_state->MEM[offset], sizeof( uint8_t ) * 32);
-                stack_push(machine_state, value);   
+            if (use_memory(machine_state, offset, 32) < 0) {
+                return -1;
             }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            uint8_t word[32];
+            evm_memory_read(&machine_state->MEM, offset, word, 32);
+            readu256BE(word, top);
             break;
                 
         }
 
         case MSTORE: { // Store at the memory using as offest and word top two values of the stack 
             // printf("MSTORE opcode\n");
-            uint64_t offset = LOWER(LOWER (  stack_pop(machine_state)));
-            uint256_t word = stack_pop(machine_state);
-           
-            if (offset < 0 ||  offset > MEMORY_SPACE){
-                printf("MEM Offeset: 0x%llX is invalid\n" , offset);
-            }
-            else {
-                memcpy(&machine_state->MEM[offset], &word,  sizeof( word ));  
-                if (sizeof( word ) > max_mem_offset){
-                    max_mem_offset = offset + sizeof( word ); 
-                }          
+            uint64_t offset = LOWER(LOWER_P(stack_top(machine_state)));
+            uint8_t word[32];
+            writeu256BE(stack_at(machine_state, 1), word);
+            stack_drop(machine_state, 2);
+            if (use_memory(machine_state, offset, 32) < 0 ||
+                evm_memory_write(&machine_state->MEM, offset, word, 32) < 0) {
+                return -1;
             }
-
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            if (offset + sizeof( word ) > machine_state->stats.max_mem_offset){
+                machine_state->stats.max_mem_offset = offset + sizeof( word ); 
+            }          
             break;	
                 
         }
                     
         case MSTORE8: {
                 
-             uint64_t offset = LOWER(LOWER (  stack_pop(machine_state)));
-             uint8_t word =(uint8_t)  LOWER(LOWER (  stack_pop(machine_state)));
-            if (offset < 0 ||  offset > MEMORY_SPACE)
-            {
-                printf("MEM Offeset: 0x%llX is invalid\n" , offset);
-            }
-            else
-            {
-                machine_state->MEM[offset] =  word & 0xFF;           
+            uint64_t offset = LOWER(LOWER_P(stack_top(machine_state)));
+            uint8_t word = (uint8_t)LOWER(LOWER_P(stack_at(machine_state, 1)));
+            stack_drop(machine_state, 2);
+            if (use_memory(machine_state, offset, 1) < 0 ||
+                evm_memory_write(&machine_state->MEM, offset, &word, 1) < 0) {
+                return -1;
             }
-
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
+            if (offset + 1 > machine_state->stats.max_mem_offset){
+                machine_state->stats.max_mem_offset = offset + 1; 
+            }          
             break;
                 
         }
                     
         case SSTORE: {
                 
-            uint64_t key = LOWER(LOWER ( stack_pop(machine_state)) );
-            uint256_t value = stack_pop(machine_state);
-            // printf("STORAGE key: 0x%llX \n" , key);
-            max_storage_counter ++;
-            
-            if (key < 0 ||  key > STORAGE_SPACE)
-            {
-                printf("STORAGE key: 0x%llX is invalid\n" , key);
+            if (machine_state->STATIC) {
+                printf("SSTORE: in a static call\n");
+                return -1;
             }
-            else
-            {
-                memcpy(&machine_state->STORAGE[key], &value,  sizeof( uint8_t ) * 32); 
+            uint256_t *key = stack_top(machine_state);
+            uint256_t *value = stack_at(machine_state, 1);
+            uint256_t current;
+            stack_drop(machine_state, 2);
+            machine_state->stats.storage_writes ++;
+
+            // setting a zero slot costs more than changing a live one
+            evm_storage_load(machine_state->ACCOUNT->storage, key, &current);
+            if (use_gas(machine_state, zero256(&current) && !zero256(value) ?
+                        GAS_TABLE.sstoreSetGas : GAS_TABLE.sstoreResetGas) < 0 ||
+                evm_storage_store(machine_state->ACCOUNT->storage, &machine_state->JOURNAL, key, value) < 0) {
+                return -1;
             }
-            
-            // print256(&machine_state->STORAGE[0]);
-            // print256(&machine_state->STORAGE[1]);
-            // print256(&machine_state->STORAGE[2]);
-            // print256(&machine_state->STORAGE[3]);
-
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.sstoreSetGas;
             break;
                 
         }
                     
         case SLOAD: {
                 
-            uint64_t key = LOWER(LOWER ( stack_pop(machine_state) ) ) ;
-            // printf("SLOAD key: 0x%llX\n" , key);
-            // print256(&machine_state->STORAGE[0]);
-            // print256(&machine_state->STORAGE[1]);
-            // print256(&machine_state->STORAGE[2]);
-            // print256(&machine_state->STORAGE[3]);
-            if (key < 0 ||  key > STORAGE_SPACE)
-            {
-                printf("STORAGE key: 0x%llX is invalid\n" , key);
-            }
-            else
-            {
-                uint256_t value ={0};
-                memcpy( &value,&machine_state->STORAGE[key], sizeof( uint8_t ) * 32); 
-                stack_push(machine_state, value);
-            }
+            uint256_t *key = stack_top(machine_state);
+            evm_storage_load(machine_state->ACCOUNT->storage, key, key);
             break;
                 
         }
@@ -1129,9 +1443,17 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
                 
             // printf("JUMPI:\n");
             // printf("Currnet PC:  %lu\n",machine_state->PC  );
-            uint64_t destination = LOWER(LOWER ( stack_pop(machine_state)) );
-            uint64_t cond = LOWER(LOWER ( stack_pop(machine_state) ) ) ;
-            machine_state->PC = cond ? destination : machine_state->PC ;
+            uint256_t destination = stack_pop(machine_state);
+            uint256_t cond = stack_pop(machine_state);
+            if (zero256(&cond)) {
+                break;
+            }
+            if (!valid_jump(machine_state, &destination, s_contract)) {
+                return -1;
+            }
+            machine_state->PC = LOWER(LOWER(destination));
+            // the loop steps over the JUMPDEST, charge it here
+            machine_state->GAS_Charge += OPCODE_INFO[JUMPDEST].gas;
 
             // printf("Jump PC:  %lu\n",machine_state->PC  );
             break;
@@ -1144,17 +1466,25 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
              break;
                 
         }
+
+        case PC: {
+
+            uint256_t *top = stack_new(machine_state);
+            clear256(top);
+            LOWER(LOWER_P(top)) = machine_state->PC;
+            break;
+
+        }
                     
         case JUMP: {
                 
-            uint64_t destination = LOWER(LOWER ( stack_pop(machine_state) ) );
+            uint256_t destination = stack_pop(machine_state);
             // printf("jump (%llu) destination\n", destination);
-            if (destination < 0 ){
-                // printf("jump (%llu) destination out of bound", destination);
-            }
-            else{
-                machine_state->PC = destination ;
+            if (!valid_jump(machine_state, &destination, s_contract)) {
+                return -1;
             }
+            machine_state->PC = LOWER(LOWER(destination));
+            machine_state->GAS_Charge += OPCODE_INFO[JUMPDEST].gas;
             break;
                 
         }
@@ -1176,18 +1506,10 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case  DUP15:
         case  DUP16: {
             
-            uint64_t offset = (uint64_t)op_code_exc - (uint64_t)DUP1 ;
-            // printf("DUP: to clone value at:%llu \n",offset);
-            int index_to_clone = machine_state->SP - offset;
-            // printf("DUP Index: %d , SP:%d \n",index_to_clone,  machine_state->SP);
-          
-            if (index_to_clone < 0){
-                // printf("DUP Index non valid : %d , SP:%d \n",index_to_clone,  machine_state->SP);
-            }
-            else{
-                uint256_t to_clone = machine_state->STACK[index_to_clone];
-                stack_push(machine_state, to_clone);
-            }
+            int depth = op_code_exc - DUP1;
+            uint256_t *to_clone = stack_at(machine_state, depth);
+            uint256_t *top = stack_new(machine_state);
+            *top = *to_clone;
             break;
                 
         }
@@ -1209,21 +1531,12 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case SWAP15:
         case SWAP16: {
                 
-            int SwapOffest = machine_state->SP - ( (uint64_t)op_code_exc - (uint64_t)SWAP1 + 1 );
-
-            // printf("[DEBUG] SWAP with offset(%d)\n",SwapOffest);
-            // printf("SP : %d \n",machine_state->SP);
-            // printf("SwapOffest %016llX\n", LOWER(LOWER(machine_state->STACK[SwapOffest] )));
-            if (SwapOffest < 0 || SwapOffest > STACK_SPACE){
-                printf("SWAP: offset(%d) is invalid\n",SwapOffest);
-            }
-            else{
-                // printf("SWAP\n");
-                uint256_t temp_store = machine_state->STACK[machine_state->SP];
-                machine_state->STACK[machine_state->SP] = machine_state->STACK[SwapOffest];
-                machine_state->STACK[SwapOffest] = temp_store;       
-            }
-
+            int depth = op_code_exc - SWAP1 + 1;
+            uint256_t *top = stack_top(machine_state);
+            uint256_t *other = stack_at(machine_state, depth);
+            uint256_t temp_store = *top;
+            *top = *other;
+            *other = temp_store;
             break;
         }
         
@@ -1233,7 +1546,12 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case LOG3:
         case LOG4: {
                 
+            if (machine_state->STATIC) {
+                printf("LOG: in a static call\n");
+                return -1;
+            }
             printf("LOG unsupported \n");
+            stack_drop(machine_state, OPCODE_INFO[op_code_exc].in);
             break;
                 
         }
@@ -1241,8 +1559,11 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case TIMESTAMP: {
                 
             uint256_t timestamp = {0};
-            time = RTIMER_NOW();
-            LOWER(LOWER(timestamp) ) = time;
+#ifdef CONTIKI
+            LOWER(LOWER(timestamp) ) = RTIMER_NOW();
+#else
+            LOWER(LOWER(timestamp) ) = time(NULL);
+#endif
             stack_push(machine_state, timestamp);
 
             printf("Unused opcode\n");
@@ -1253,26 +1574,18 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
                 
             uint64_t offset = LOWER(LOWER ( stack_pop(machine_state)));
             uint64_t length = LOWER(LOWER ( stack_pop(machine_state)));
-
-            if (offset < 0 ||  offset > MEMORY_SPACE)
-            {
-                printf("MEM Offeset: %llX is invalid\n" , offset);
-            }
-            else
-            {    
-                uint8_t return_value[ offset + length ];
-                memcpy(&return_value, &machine_state->MEM[offset], sizeof( uint8_t ) * length);
-
-            return RETURN;
+            if (use_memory(machine_state, offset, length) < 0 ||
+                set_return_data(machine_state, offset, length) < 0) {
+                return -1;
             }
-            machine_state->GAS_Charge = machine_state->GAS_Charge  + GAS_TABLE.stepGas3;
-            break;
+            // the storage changes of the frame are undone by its caller
+            return REVERT;
         }
                     
         case BLOCKHASH: {
                 
-            uint256_t block = {0};
-            stack_push(machine_state, block);
+            // no block chain on the device
+            clear256(stack_top(machine_state));
             break;
                 
         }
@@ -1280,7 +1593,7 @@ int decode_instruction(Machine *machine_state, u_int8_t op_code_exc, const u_int
         case INVALID: {
                 
             printf("Unused opcode\n");
-            break;
+            return -1;
                 
         }
 
@@ -1299,11 +1612,12 @@ void shutdown_machine(Machine *machine_state) {
     machine_state->PC = 0;
 	machine_state->SP = 0;
     machine_state->GAS_Charge = 0;
+    machine_state->MEM_Words = 0;
 }
 
 // Stack ops
 void stack_push(Machine *machine_state, uint256_t item) {
-	if (machine_state->SP >= STACK_SPACE){
+	if (machine_state->SP >= STACK_SPACE - 1){
 		stack_overflow_err();
     }
     else{
@@ -1315,6 +1629,12 @@ void stack_push(Machine *machine_state, uint256_t item) {
 
 uint256_t  stack_pop(Machine *machine_state) {
 	uint256_t tmp = machine_state->STACK[machine_state->SP];
+	// never reach into the stack of a calling frame
+	if (machine_state->SP <= machine_state->SP_Base) {
+		empty_stack_err("stack_pop");
+		clear256(&tmp);
+		return tmp;
+	}
 	machine_state->SP--;
 	return tmp;
 }
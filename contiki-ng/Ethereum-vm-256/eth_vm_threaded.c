@@ -0,0 +1,324 @@
+#include "evm.h"
+#include "evm_analysis.h"
+
+// Direct-threaded interpreter over the pre-decoded instruction stream.
+// Every handler ends by jumping straight to the handler of the next
+// instruction (GCC labels as values), so there is no central switch and no
+// re-reading of the bytecode. Opcodes without a handler here go through
+// decode_instruction().
+// Static gas is charged, and the gas limit and the stack checked, once per
+// basic block by its JUMPDEST or OPX_BEGINBLOCK, so the handlers neither
+// check the stack nor does decode_instruction(). Dynamic gas is charged by
+// the handlers.
+
+static void push_code_bytes(const evm_program_t *program, const uint8_t *code, const evm_insn_t *insn, uint256_t *target) {
+
+    uint8_t word[32] = {0};
+    uint32_t offset = insn[1].imm;
+
+    // right-align the immediate, bytes past the end of the code read as zero
+    for (int i = 0; i < insn->arg; i++) {
+        if (offset + i < program->code_size) {
+            word[32 - insn->arg + i] = code[offset + i];
+        }
+    }
+    readu256BE(word, target);
+}
+
+int execute_program(Machine *machine_state, const evm_program_t *program, const uint8_t *code) {
+
+    static const void *const dispatch[256] = {
+        [0 ... 255]         = &&op_generic,
+        [STOP]              = &&op_stop,
+        [ADD]               = &&op_add,
+        [SUB]               = &&op_sub,
+        [LT]                = &&op_lt,
+        [GT]                = &&op_gt,
+        [EQ]                = &&op_eq,
+        [ISZERO]            = &&op_iszero,
+        [AND]               = &&op_and,
+        [OR]                = &&op_or,
+        [XOR]               = &&op_xor,
+        [NOT]               = &&op_not,
+        [POP]               = &&op_pop,
+        [JUMP]              = &&op_jump,
+        [JUMPI]             = &&op_jumpi,
+        [PC]                = &&op_pc,
+        [JUMPDEST]          = &&op_jumpdest,
+        [PUSH1 ... PUSH2]   = &&op_push_short,
+        [PUSH3 ... PUSH4]   = &&op_push_word,
+        [PUSH5 ... PUSH32]  = &&op_push_code,
+        [DUP1 ... DUP16]    = &&op_dup,
+        [SWAP1 ... SWAP16]  = &&op_swap,
+        [OPX_BEGINBLOCK]    = &&op_beginblock,
+#if EVM_SUPERINSNS
+        [OPX_PUSH_JUMPI]    = &&op_push_jumpi,
+        [OPX_PUSH_MLOAD]    = &&op_push_mload,
+        [OPX_SELECTOR_JUMPI] = &&op_selector_jumpi,
+        [OPX_SWAP1_POP]     = &&op_swap1_pop,
+        [OPX_ISZERO_ISZERO] = &&op_iszero_iszero,
+#endif
+    };
+
+    const evm_insn_t *ip = &program->insn[machine_state->PC];
+    uint256_t *a;
+    uint256_t *b;
+    uint8_t op_code;
+    int status;
+
+#if EVM_COUNT_INSNS
+// a superinstruction counts as one
+#define DISPATCH() do { machine_state->stats.insns++; goto *dispatch[ip->handler]; } while (0)
+#else
+#define DISPATCH() goto *dispatch[ip->handler]
+#endif
+
+// step over the instruction and its operand slots
+#define STEP(slots) do { ip += (slots); DISPATCH(); } while (0)
+#define NEXT() STEP(1)
+
+#define JUMP_TO(destination) do { \
+        int target = evm_program_jump(program, (destination)); \
+        if (target < 0) { \
+            printf("Invalid jump destination: 0x%llX\n", (unsigned long long)(destination)); \
+            return -1; \
+        } \
+        ip = &program->insn[target]; \
+        DISPATCH(); \
+    } while (0)
+
+    DISPATCH();
+
+op_stop:
+    return 0;
+
+op_push_short: {
+    uint256_t *top = stack_new(machine_state);
+    clear256(top);
+    LOWER(LOWER_P(top)) = ip[1].imm;
+    if (machine_state->SP > machine_state->stats.max_sp) {
+        machine_state->stats.max_sp = machine_state->SP;
+    }
+    STEP(2);
+}
+
+op_push_word: {
+    uint256_t *top = stack_new(machine_state);
+    clear256(top);
+    LOWER(LOWER_P(top)) = (uint32_t)ip[1].imm << 16 | ip[2].imm;
+    if (machine_state->SP > machine_state->stats.max_sp) {
+        machine_state->stats.max_sp = machine_state->SP;
+    }
+    STEP(3);
+}
+
+op_push_code:
+    push_code_bytes(program, code, ip, stack_new(machine_state));
+    if (machine_state->SP > machine_state->stats.max_sp) {
+        machine_state->stats.max_sp = machine_state->SP;
+    }
+    STEP(2);
+
+op_pop:
+    stack_drop(machine_state, 1);
+    NEXT();
+
+op_dup: {
+    uint256_t *to_clone = stack_at(machine_state, ip->arg - 1);
+    uint256_t *top = stack_new(machine_state);
+    *top = *to_clone;
+    if (machine_state->SP > machine_state->stats.max_sp) {
+        machine_state->stats.max_sp = machine_state->SP;
+    }
+    NEXT();
+}
+
+op_swap: {
+    uint256_t *top = stack_top(machine_state);
+    uint256_t *other = stack_at(machine_state, ip->arg);
+    uint256_t temp_store = *top;
+    *top = *other;
+    *other = temp_store;
+    NEXT();
+}
+
+op_jumpdest:
+op_beginblock:
+    if (machine_state->GAS_Charge >= machine_state->SLICE_End && machine_state->DEPTH == 0) {
+        machine_state->PC = ip - program->insn;
+        return EVM_PAUSED;
+    }
+    // gas, need and grow of the block, see bound_blocks()
+    machine_state->GAS_Charge += ip[1].imm;
+    if (machine_state->GAS_Charge > machine_state->GAS_Limit) {
+        goto out_of_gas;
+    }
+    if (machine_state->SP - machine_state->SP_Base < ip->arg) {
+        empty_stack_err("block");
+        return -1;
+    }
+    if (machine_state->SP + ip[2].imm > STACK_SPACE - 1) {
+        stack_overflow_err();
+        return -1;
+    }
+    STEP(EVM_LEADER_SLOTS);
+
+op_jump: {
+    uint256_t *destination = stack_top(machine_state);
+    stack_drop(machine_state, 1);
+    if (!zero128(&UPPER_P(destination)) || UPPER(LOWER_P(destination)) != 0) {
+        printf("Invalid jump destination\n");
+        return -1;
+    }
+    JUMP_TO(LOWER(LOWER_P(destination)));
+}
+
+op_jumpi: {
+    uint256_t *destination = stack_top(machine_state);
+    uint256_t *cond = stack_at(machine_state, 1);
+    stack_drop(machine_state, 2);
+    if (zero256(cond)) {
+        NEXT();
+    }
+    if (!zero128(&UPPER_P(destination)) || UPPER(LOWER_P(destination)) != 0) {
+        printf("Invalid jump destination\n");
+        return -1;
+    }
+    JUMP_TO(LOWER(LOWER_P(destination)));
+}
+
+op_pc: {
+    uint256_t *top = stack_new(machine_state);
+    clear256(top);
+    LOWER(LOWER_P(top)) = ip[1].imm;
+    STEP(2);
+}
+
+// binary operators: operand a is the top, the result replaces operand b
+#define BINARY_OP() \
+    a = stack_top(machine_state); \
+    b = stack_at(machine_state, 1); \
+    stack_drop(machine_state, 1)
+
+#define SET_BOOL(word, value) do { \
+        bool result = (value); \
+        clear256(word); \
+        LOWER(LOWER_P(word)) = result; \
+    } while (0)
+
+op_add:
+    BINARY_OP();
+    add256(a, b, b);
+    NEXT();
+
+op_sub:
+    BINARY_OP();
+    minus256(a, b, b);
+    NEXT();
+
+op_lt:
+    BINARY_OP();
+    SET_BOOL(b, gt256(b, a));
+    NEXT();
+
+op_gt:
+    BINARY_OP();
+    SET_BOOL(b, gt256(a, b));
+    NEXT();
+
+op_eq:
+    BINARY_OP();
+    SET_BOOL(b, equal256(a, b));
+    NEXT();
+
+op_iszero:
+    a = stack_top(machine_state);
+    SET_BOOL(a, zero256(a));
+    NEXT();
+
+op_and:
+    BINARY_OP();
+    and256(a, b, b);
+    NEXT();
+
+op_or:
+    BINARY_OP();
+    or256(a, b, b);
+    NEXT();
+
+op_xor:
+    BINARY_OP();
+    xor256(a, b, b);
+    NEXT();
+
+op_not:
+    not256(stack_top(machine_state));
+    NEXT();
+
+#if EVM_SUPERINSNS
+op_push_jumpi:
+    a = stack_top(machine_state);
+    stack_drop(machine_state, 1);
+    if (zero256(a)) {
+        STEP(2);
+    }
+    JUMP_TO(ip[1].imm);
+
+op_push_mload:
+    a = stack_new(machine_state);
+    clear256(a);
+    LOWER(LOWER_P(a)) = ip[1].imm;
+    op_code = MLOAD;
+    // the operand slot, generic steps over the instruction
+    ip++;
+    goto generic;
+
+op_selector_jumpi:
+    // compares the top of the stack without the DUP1 copy, the stack is
+    // left as it was
+    a = stack_top(machine_state);
+    if (zero128(&UPPER_P(a)) && UPPER(LOWER_P(a)) == 0 && LOWER(LOWER_P(a)) == ((uint32_t)ip[1].imm << 16 | ip[2].imm)) {
+        JUMP_TO(ip[3].imm);
+    }
+    STEP(4);
+
+op_swap1_pop:
+    BINARY_OP();
+    *b = *a;
+    NEXT();
+
+op_iszero_iszero:
+    a = stack_top(machine_state);
+    SET_BOOL(a, !zero256(a));
+    NEXT();
+#endif /* EVM_SUPERINSNS */
+
+op_generic:
+    op_code = ip->handler;
+#if EVM_SUPERINSNS
+generic:
+#endif
+    status = decode_instruction(machine_state, op_code, code);
+    if (machine_state->SP > machine_state->stats.max_sp) {
+        machine_state->stats.max_sp = machine_state->SP;
+    }
+    if (status == RETURN || status == REVERT) {
+        return status;
+    }
+    if (status < 0) {
+        printf("ERROR!\n");
+        return status;
+    }
+    NEXT();
+
+out_of_gas:
+    printf("Run out of GAS!\n");
+    return -1;
+
+#undef SET_BOOL
+#undef BINARY_OP
+#undef JUMP_TO
+#undef NEXT
+#undef STEP
+#undef DISPATCH
+}
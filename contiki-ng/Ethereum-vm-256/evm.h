@@ -5,17 +5,94 @@
 #include <string.h>
 #include <stdint.h>
 #include "uint256.h"
-
-#define MEMORY_SPACE 8089
-#define MESSAGEDATASIZE 9
+#include "evm_memory.h"
+#include "evm_storage.h"
+
+// Bytes of call data a message holds: the selector and six words, enough
+// for close(uint256,bytes) with a 65-byte signature
+#ifdef EVM_CONF_MESSAGE_DATA_SIZE
+#define MESSAGEDATASIZE EVM_CONF_MESSAGE_DATA_SIZE
+#else
+#define MESSAGEDATASIZE 196
+#endif
 #define STACK_SPACE 96  
-#define STORAGE_SPACE 64
 #define GAS_LIMIT 16000000
 
+// Run contracts through the pre-decoded, threaded interpreter (eth_vm_threaded.c)
+#ifdef EVM_CONF_THREADED
+#define EVM_THREADED EVM_CONF_THREADED
+#else
+#define EVM_THREADED 1
+#endif
+
+// Serialise access to the state shared by all machines (analysis cache,
+// memory pool) when they run on several threads, e.g. with a pthread
+// mutex on a native gateway
+#ifdef EVM_CONF_LOCK
+#define EVM_LOCK() EVM_CONF_LOCK()
+#define EVM_UNLOCK() EVM_CONF_UNLOCK()
+#else
+#define EVM_LOCK()
+#define EVM_UNLOCK()
+#endif
+
+// Count the opcode n-grams executed by the plain interpreter, for choosing
+// superinstructions. Contracts then never run threaded.
+#ifdef EVM_CONF_NGRAM_STATS
+#define EVM_NGRAM_STATS EVM_CONF_NGRAM_STATS
+#else
+#define EVM_NGRAM_STATS 0
+#endif
+
+// Time every opcode and PC executed by the plain interpreter, see
+// evm_profile.h. Contracts then never run threaded.
+#ifdef EVM_CONF_PROFILE
+#define EVM_PROFILE EVM_CONF_PROFILE
+#else
+#define EVM_PROFILE 0
+#endif
+
+// Run the contracts translated by tools/evm2c (evm_aot_contracts.c) from
+// their translation, see evm_aot.h
+#ifdef EVM_CONF_AOT
+#define EVM_AOT EVM_CONF_AOT
+#else
+#define EVM_AOT 0
+#endif
+
+// Count the instructions dispatched in stats.insns, e.g. for the host
+// benchmark (bench/)
+#ifdef EVM_CONF_COUNT_INSNS
+#define EVM_COUNT_INSNS EVM_CONF_COUNT_INSNS
+#else
+#define EVM_COUNT_INSNS 0
+#endif
+
+// Print the resource usage of every call at its end
+#ifdef EVM_CONF_PRINT_STATS
+#define EVM_PRINT_STATS EVM_CONF_PRINT_STATS
+#else
+#define EVM_PRINT_STATS 1
+#endif
+
+// Gas a contract run by EVM_EXECUTE() uses before the process pauses
+#ifdef EVM_CONF_SLICE_GAS
+#define EVM_SLICE_GAS EVM_CONF_SLICE_GAS
+#else
+#define EVM_SLICE_GAS 5000
+#endif
+
+// Digests of 32- and 64-byte SHA3 inputs a machine remembers, the least
+// recently used forgotten first. Forgotten at the start of every call made
+// by execute_contract(). 0 for none.
+#ifdef EVM_CONF_KECCAK_MEMO
+#define EVM_KECCAK_MEMO EVM_CONF_KECCAK_MEMO
+#else
+#define EVM_KECCAK_MEMO 4
+#endif
+
 // typedef uint8_t byte;
 // typedef uint16_t word;
-extern uint8_t deployed_contract[];
-extern uint64_t DeployLength;
 
 typedef struct Message_Ext {
   uint256_t call_value;
@@ -27,18 +104,95 @@ typedef struct Message_Ext {
   
   uint8_t data[MESSAGEDATASIZE];
   uint32_t datasize;
+  // in nested calls the data is read in place from the caller's memory
+  const evm_memory_t *data_memory;
+  uint32_t data_offset;
 
   uint32_t codesize;
 }Message_Ext;
 
+// A contract that can be called: the one execute_contract() runs or one
+// made by CREATE (see evm_call.c)
+typedef struct evm_account {
+  uint256_t address;
+  const uint8_t *code;
+  uint32_t code_size;
+  uint32_t nonce;             // numbers the contracts it creates
+  evm_storage_t *storage;
+} evm_account_t;
+
+struct evm_program;
+
+// Accounts, code and storage changes at some point, to undo what a failed
+// or reverted call did (see evm_call.h)
+typedef struct evm_call_mark {
+    uint32_t serial;          // of the next contract any machine creates
+    uint16_t journal;
+} evm_call_mark_t;
+
+// A SHA3 input of one or two words and its digest (see EVM_KECCAK_MEMO)
+typedef struct evm_keccak_memo {
+  uint8_t input[64];
+  uint256_t hash;
+  uint16_t used;            // KECCAK_Clock when it was last looked up
+  uint8_t length;           // 32 or 64, 0 if the entry is free
+} evm_keccak_memo_t;
+
+// Resource usage of one execution, printed at its end
+typedef struct evm_stats {
+  int max_sp;
+  uint32_t max_mem_offset;
+  uint32_t storage_writes;
+  uint32_t insns;           // with EVM_COUNT_INSNS
+} evm_stats_t;
+
+// All state of one VM instance. Nothing is shared between instances apart
+// from the cache of code analyses, the memory page pool and the records
+// and accounts of nested calls, so several machines can be interleaved.
+// A nested call runs on the machine of its caller, see evm_call.h.
 typedef struct machine {
 	uint32_t PC;
 	int SP;
-	uint8_t MEM[MEMORY_SPACE];
+  int SP_Base;              // STACK[1..SP_Base] belongs to the calling frames
+	evm_memory_t MEM;
 	uint256_t STACK[STACK_SPACE];
-  uint256_t STORAGE[STORAGE_SPACE];
+  evm_storage_t STORAGE;
+  evm_journal_t JOURNAL;    // storage changes of the running call
 	uint32_t GAS_Charge;
+  uint32_t GAS_Limit;       // the running frame fails once GAS_Charge exceeds it
+  uint32_t MEM_Words;       // active memory in 32-byte words, for expansion gas
   Message_Ext message;
+  uint8_t DEPTH;            // 0 in the call made by execute_contract()
+  uint8_t STATIC;           // state changes are forbidden (STATICCALL)
+  evm_account_t SELF;       // the contract execute_contract() runs, with STORAGE
+  evm_account_t *ACCOUNT;   // whose storage the running frame uses
+  // code analysis of the running contract, NULL if the code is too large.
+  // May be set before execute_contract(), which then releases it.
+  const struct evm_program *program;
+  // RETURN/REVERT copy their output into RETURN_Data, a buffer of
+  // RETURN_Capacity bytes owned by the caller and kept by init_machine()
+  uint8_t *RETURN_Data;
+  uint32_t RETURN_Capacity;
+  uint32_t RETURN_Length;
+  // if set, the output is passed to RETURN_Sink piece by piece instead,
+  // e.g. evm_code_write() to put runtime code in flash
+  int (*RETURN_Sink)(const uint8_t *data, uint32_t offset, uint32_t length);
+  // a nested frame leaves its output in MEM at RETURN_Offset instead
+  uint32_t RETURN_Offset;
+  // output of the last nested call, in the pages of the callee's memory
+  evm_memory_t RETURNDATA_Pages;
+  uint32_t RETURNDATA_Offset;
+  uint32_t RETURNDATA_Length;
+  // a call run by execute_contract_step() pauses once GAS_Charge reaches
+  // SLICE_End, in its outermost frame only. The threaded interpreter then
+  // keeps the index of the next instruction in PC.
+  uint32_t SLICE_End;
+  evm_call_mark_t MARK;     // state before the call, restored if it fails
+#if EVM_KECCAK_MEMO
+  evm_keccak_memo_t KECCAK_Memo[EVM_KECCAK_MEMO];
+  uint16_t KECCAK_Clock;
+#endif
+  evm_stats_t stats;
 } Machine;
 
 
@@ -56,8 +210,25 @@ void print256(uint256_t * number_1);
 //VM functions
 void init_machine(Machine *);
 void shutdown_machine(Machine *);
+// 0 to go on, RETURN or REVERT once the frame has ended, -1 on error.
+// The stack must have passed opcode_check() for the opcode.
 int decode_instruction(Machine *, uint8_t, const uint8_t *);
-void execute_contract(Machine *, const uint8_t *, uint32_t );
+int execute_contract(Machine *, const uint8_t *, uint32_t );
+void execute_contract_begin(Machine *, const uint8_t *, uint32_t);
+int execute_contract_step(Machine *, uint32_t);
+
+// Status of execute_contract_step() when the call is not over yet
+#define EVM_PAUSED 1
+
+// Run a contract like execute_contract() from a Contiki process thread,
+// pausing the process every EVM_SLICE_GAS gas so that the other processes
+// (RPL, TSCH, CoAP) keep running. machine must be static.
+#define EVM_EXECUTE(machine, code, size, status) do { \
+        execute_contract_begin((machine), (code), (size)); \
+        while (((status) = execute_contract_step((machine), EVM_SLICE_GAS)) == EVM_PAUSED) { \
+            PROCESS_PAUSE(); \
+        } \
+    } while (0)
 
 //stuck operations
 void stack_push(Machine *, uint256_t  );
@@ -71,6 +242,30 @@ void empty_stack_err(char *);
 void size_err(char *);
 void stack_print(Machine *);
 
+// In-place stack access. STACK[SP_Base + 1] is the bottom item of the
+// running frame and STACK[SP] the top.
+// The height is checked against OPCODE_INFO before an instruction runs,
+// see opcode_check(). The instruction then reads its operands through
+// pointers and writes the result over its deepest operand.
+
+static inline uint256_t *stack_top(Machine *machine_state) {
+    return &machine_state->STACK[machine_state->SP];
+}
+
+// the item depth places below the top, stack_at(machine_state, 0) is the top
+static inline uint256_t *stack_at(Machine *machine_state, int depth) {
+    return &machine_state->STACK[machine_state->SP - depth];
+}
+
+// new top of the stack, to be written by the caller
+static inline uint256_t *stack_new(Machine *machine_state) {
+    return &machine_state->STACK[++machine_state->SP];
+}
+
+static inline void stack_drop(Machine *machine_state, int count) {
+    machine_state->SP -= count;
+}
+
 int64_t ipow(int64_t , uint8_t );
 
 
@@ -87,6 +282,7 @@ struct GAS_price
     stepGas10,
     sha3Gas  ,
     sha3WordGas  ,
+    expByteGas  ,
     sloadGas  ,
     sstoreSetGas   ,
     sstoreResetGas  ,
@@ -96,6 +292,7 @@ struct GAS_price
     logDataGas  ,
     logTopicGas  ,
     createGas  ,
+    createDataGas  ,
     memoryGas  ,
     quadCoeffDiv  ,
     copyGas  ,
@@ -158,6 +355,8 @@ enum OP_CODE{
     GASPRICE,
     EXTCODESIZE,
     EXTCODECOPY,
+    RETURNDATASIZE,
+    RETURNDATACOPY,
 
     BLOCKHASH = 0x40,
     COINBASE,
@@ -267,5 +466,40 @@ enum OP_CODE{
   };
 typedef enum OP_CODE OP_CODE;
 
+// Static opcode information (see evm_opcodes.c)
+typedef struct opcode_info {
+    uint16_t gas;   // static gas charged before the handler runs
+    uint8_t imm;    // bytes of immediate data that follow the opcode
+    uint8_t in;     // stack items the opcode reads
+    uint8_t out;    // stack items it leaves in their place
+    uint8_t flags;
+} opcode_info_t;
+
+// The basic block ends after the opcode. GAS and the calls end one too, as
+// the gas they read or hand on must not include that of the instructions
+// after them, which the block charges up front.
+#define OPCODE_ENDS_BLOCK 0x01
+// The next instruction only runs if it is jumped to, otherwise it starts
+// a new basic block
+#define OPCODE_TERMINAL 0x02
+
+extern const opcode_info_t OPCODE_INFO[256];
+
+// -1 if the stack of the running frame holds too few items for op_code or
+// no room for its results. The plain interpreter checks every instruction,
+// the threaded one every basic block.
+static inline int opcode_check(Machine *machine_state, uint8_t op_code) {
+    const opcode_info_t *info = &OPCODE_INFO[op_code];
+    if (machine_state->SP - machine_state->SP_Base < info->in) {
+        printf("[!!!] Fatal error: opcode %02X from empty stack.\n", op_code);
+        return -1;
+    }
+    if (machine_state->SP - info->in + info->out > STACK_SPACE - 1) {
+        stack_overflow_err();
+        return -1;
+    }
+    return 0;
+}
+
 #endif /* MY_HEADER_H */
 
@@ -0,0 +1,465 @@
+#include "evm_analysis.h"
+#include "evm_aot.h"
+
+static evm_program_t cache[EVM_ANALYSIS_CACHE_SIZE];
+static uint8_t cache_next;
+
+// Mark every JUMPDEST in code[offset, offset + length) that is an opcode
+// and not immediate data of a PUSH, starting with the opcode at pc.
+// Returns the offset of the first opcode after the piece.
+static uint32_t mark_jumpdests(evm_program_t *prog, const uint8_t *code, uint32_t offset, uint32_t length, uint32_t pc) {
+
+    while (pc < offset + length) {
+        uint8_t op_code = code[pc - offset];
+        if (op_code == JUMPDEST) {
+            prog->jumpdest_bitmap[pc / 32] |= (uint32_t)1 << (pc % 32);
+        }
+        pc += 1 + OPCODE_INFO[op_code].imm;
+    }
+    return pc;
+}
+
+// Store the running count of marked bits at the start of each bitmap word
+static void rank_jumpdests(evm_program_t *prog) {
+
+    uint16_t rank = 0;
+
+    for (int i = 0; i < EVM_BITMAP_WORDS; i++) {
+        prog->bitmap_rank[i] = rank;
+        rank += __builtin_popcount(prog->jumpdest_bitmap[i]);
+    }
+    prog->jumpdest_count = rank;
+}
+
+// One pass over the bytecode to build the JUMPDEST bitmap
+static void analyse_jumpdests(evm_program_t *prog, const uint8_t *code, uint32_t size) {
+
+    memset(prog->jumpdest_bitmap, 0, sizeof(prog->jumpdest_bitmap));
+    mark_jumpdests(prog, code, 0, size, 0);
+    rank_jumpdests(prog);
+}
+
+// Store in the leader of each basic block its static gas, so it is charged
+// once on entry, and the bounds of the stack over the block: the items it
+// needs on entry and the most it adds, so the stack is checked once on
+// entry. Runs before the superinstructions are fused, while every handler
+// is still an opcode. Code after a block end that is not a JUMPDEST is
+// unreachable and belongs to no block.
+static void bound_blocks(evm_program_t *prog) {
+
+    evm_insn_t *leader = NULL;
+    uint32_t gas = 0;
+    int height = 0;
+    int lowest = 0;
+    int highest = 0;
+
+    for (int i = 0; i < prog->insn_count; i += evm_insn_length(&prog->insn[i])) {
+        evm_insn_t *insn = &prog->insn[i];
+        const opcode_info_t *info = &OPCODE_INFO[insn->handler];
+        if (insn->handler == JUMPDEST || insn->handler == OPX_BEGINBLOCK) {
+            leader = insn;
+            gas = 0;
+            height = lowest = highest = 0;
+        }
+        if (leader == NULL) {
+            continue;
+        }
+        // evm_predecode() splits a block before its gas overflows
+        gas += info->gas;
+        leader[1].imm = gas;
+        height -= info->in;
+        if (height < lowest) {
+            lowest = height;
+        }
+        height += info->out;
+        if (height > highest) {
+            highest = height;
+        }
+        // a block beyond 255 items can never run: STACK_SPACE is smaller
+        leader->arg = -lowest < 255 ? -lowest : 255;
+        leader[2].imm = highest < 255 ? highest : 255;
+        if (info->flags & OPCODE_ENDS_BLOCK) {
+            leader = NULL;
+        }
+    }
+}
+
+#if EVM_SUPERINSNS
+static bool is_inline_push(const evm_insn_t *insn) {
+    return insn->handler >= PUSH1 && insn->handler <= PUSH1 + EVM_PUSH_INLINE_BYTES - 1;
+}
+
+// A push of one operand slot, a jump destination or a memory offset
+static bool is_short_push(const evm_insn_t *insn) {
+    return insn->handler == PUSH1 || insn->handler == PUSH2;
+}
+
+static uint32_t inline_value(const evm_insn_t *insn) {
+    return is_short_push(insn) ? insn[1].imm : (uint32_t)insn[1].imm << 16 | insn[2].imm;
+}
+
+// Peephole pass over the pre-decoded stream: replace the fixed sequences
+// solc emits everywhere by single superinstructions and compact the stream.
+// None of the patterns contains a block leader, so the block structure is
+// kept; jumpdest_insn is rebuilt for the new positions. A superinstruction
+// never takes more slots than the instructions it replaces.
+static void fuse_superinstructions(evm_program_t *prog) {
+
+    evm_insn_t *insn = prog->insn;
+    uint16_t count = prog->insn_count;
+    uint16_t r = 0;
+    uint16_t w = 0;
+    uint16_t jumpdests = 0;
+
+    while (r < count) {
+        const evm_insn_t *in[5];
+        int left = 1;
+        uint8_t fused;
+        uint32_t operand;
+
+        // the next five instructions, their operands are read before
+        // anything is written over them
+        in[0] = &insn[r];
+        for (uint16_t at = r + evm_insn_length(in[0]); left < 5 && at < count; at += evm_insn_length(&insn[at])) {
+            in[left++] = &insn[at];
+        }
+        if (in[0]->handler == JUMPDEST) {
+            prog->jumpdest_insn[jumpdests++] = w;
+        }
+#if EVM_PROGRAM_PCS
+        // a superinstruction is at the offset of its first opcode
+        prog->pc[w] = prog->pc[r];
+#endif
+
+        if (left >= 5 && in[0]->handler == DUP1 && is_inline_push(in[1]) &&
+            in[2]->handler == EQ && is_short_push(in[3]) && in[4]->handler == JUMPI) {
+            uint32_t selector = inline_value(in[1]);
+            uint16_t destination = in[3][1].imm;
+            r = in[4] - insn + 1;
+            insn[w].handler = OPX_SELECTOR_JUMPI;
+            insn[w].arg = 0;
+            insn[w + 1].imm = selector >> 16;
+            insn[w + 2].imm = (uint16_t)selector;
+            insn[w + 3].imm = destination;
+            w += 4;
+            continue;
+        }
+        if (left >= 2 && is_short_push(in[0]) && in[1]->handler == JUMPI) {
+            fused = OPX_PUSH_JUMPI;
+        }
+        else if (left >= 2 && is_short_push(in[0]) && in[1]->handler == MLOAD) {
+            fused = OPX_PUSH_MLOAD;
+        }
+        else if (left >= 2 && in[0]->handler == SWAP1 && in[1]->handler == POP) {
+            fused = OPX_SWAP1_POP;
+        }
+        else if (left >= 2 && in[0]->handler == ISZERO && in[1]->handler == ISZERO) {
+            fused = OPX_ISZERO_ISZERO;
+        }
+        else {
+            int length = evm_insn_length(in[0]);
+            memmove(&insn[w], &insn[r], length * sizeof(evm_insn_t));
+            w += length;
+            r += length;
+            continue;
+        }
+        operand = in[0][1].imm;
+        r = in[1] - insn + 1;
+        insn[w].handler = fused;
+        insn[w].arg = 0;
+        if (fused == OPX_PUSH_JUMPI || fused == OPX_PUSH_MLOAD) {
+            insn[w + 1].imm = operand;
+        }
+        w += evm_insn_length(&insn[w]);
+    }
+    prog->insn_count = w;
+}
+#endif /* EVM_SUPERINSNS */
+
+// Translate bytecode into the pre-decoded instruction stream of prog.
+// The JUMPDEST bitmap must already be built. The bytes after a terminal
+// opcode up to the next JUMPDEST can never run and are left out: the
+// runtime code and metadata solc appends to the code are most of them.
+// Returns 0 on success, -1 if the contract does not fit in evm_program_t,
+// in which case the plain interpreter runs it.
+int evm_predecode(evm_program_t *prog, const uint8_t *code, uint32_t size) {
+
+    uint32_t pc = 0;
+    uint16_t count = 0;
+    uint16_t jumpdests = 0;
+    uint32_t block_gas = 0;
+    bool block_start = true;
+    bool reachable = true;
+
+    prog->insn_count = 0;
+    if (prog->jumpdest_count > EVM_PROGRAM_MAX_JUMPDESTS) {
+        return -1;
+    }
+
+    while (pc < size) {
+        uint8_t op_code = code[pc];
+        const opcode_info_t *info = &OPCODE_INFO[op_code];
+
+        if (op_code == JUMPDEST) {
+            reachable = true;
+        }
+        if (!reachable) {
+            pc += 1 + info->imm;
+            continue;
+        }
+        // keep slots free for a block start, the instruction and the
+        // terminating STOP
+        if (count + 2 * EVM_LEADER_SLOTS + 1 > EVM_PROGRAM_MAX_INSNS) {
+            return -1;
+        }
+
+        // the gas of a block has to fit in its operand slot
+        if (block_gas + info->gas > UINT16_MAX) {
+            block_start = true;
+        }
+        // a JUMPDEST starts its own block, anything else needs a marker
+        if (op_code == JUMPDEST) {
+            block_gas = 0;
+        }
+        else if (block_start) {
+            prog->insn[count].handler = OPX_BEGINBLOCK;
+            prog->insn[count].arg = 0;
+            prog->insn[count + 1].imm = 0;
+            prog->insn[count + 2].imm = 0;
+#if EVM_PROGRAM_PCS
+            prog->pc[count] = pc;
+#endif
+            count += EVM_LEADER_SLOTS;
+            block_gas = 0;
+        }
+        block_gas += info->gas;
+        block_start = (info->flags & (OPCODE_ENDS_BLOCK | OPCODE_TERMINAL)) == OPCODE_ENDS_BLOCK;
+        reachable = !(info->flags & OPCODE_TERMINAL);
+
+        evm_insn_t *insn = &prog->insn[count];
+
+        insn->handler = op_code;
+        if (op_code >= EVM_PSEUDO_FIRST && op_code <= EVM_PSEUDO_LAST) {
+            insn->handler = OPX_UNDEFINED;
+        }
+        insn->arg = info->imm;
+
+        if (op_code >= PUSH1 && op_code <= PUSH32) {
+            if (insn->arg <= EVM_PUSH_INLINE_BYTES) {
+                // resolve the value now, missing trailing bytes read as zero
+                uint32_t value = 0;
+                for (int i = 1; i <= insn->arg; i++) {
+                    value = (value << 8) | (pc + i < size ? code[pc + i] : 0);
+                }
+                if (insn->arg <= 2) {
+                    insn[1].imm = value;
+                }
+                else {
+                    insn[1].imm = value >> 16;
+                    insn[2].imm = (uint16_t)value;
+                }
+            }
+            else {
+                insn[1].imm = pc + 1;
+            }
+        }
+        else if (op_code >= DUP1 && op_code <= DUP16) {
+            insn->arg = op_code - DUP1 + 1;
+        }
+        else if (op_code >= SWAP1 && op_code <= SWAP16) {
+            insn->arg = op_code - SWAP1 + 1;
+        }
+        else if (op_code == PC) {
+            insn[1].imm = pc;
+        }
+        else if (op_code == JUMPDEST) {
+            // JUMPDESTs are met in bitmap order
+            prog->jumpdest_insn[jumpdests++] = count;
+            insn[1].imm = 0;
+            insn[2].imm = 0;
+        }
+
+#if EVM_PROGRAM_PCS
+        prog->pc[count] = pc;
+#endif
+        pc += 1 + info->imm;
+        count += evm_insn_length(insn);
+    }
+
+    // running past the end of the code is an implicit STOP
+    prog->insn[count].handler = STOP;
+    prog->insn[count].arg = 0;
+#if EVM_PROGRAM_PCS
+    prog->pc[count] = size;
+#endif
+    prog->insn_count = count + 1;
+
+    bound_blocks(prog);
+#if EVM_SUPERINSNS
+    fuse_superinstructions(prog);
+#endif
+    return 0;
+}
+
+static evm_program_t *find(const uint8_t *code_hash) {
+
+    for (int i = 0; i < EVM_ANALYSIS_CACHE_SIZE; i++) {
+        if (cache[i].code_size != 0 && memcmp(cache[i].code_hash, code_hash, 32) == 0) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Cached analysis of the contract with the given keccak256 code hash
+const evm_program_t *evm_program_lookup(const uint8_t *code_hash) {
+
+    evm_program_t *prog;
+
+    EVM_LOCK();
+    prog = find(code_hash);
+    EVM_UNLOCK();
+    return prog;
+}
+
+// Entry to analyse new code into: the next one round-robin that no
+// machine is running, NULL if all are in use
+static evm_program_t *evict(void) {
+
+    for (int i = 0; i < EVM_ANALYSIS_CACHE_SIZE; i++) {
+        evm_program_t *prog = &cache[cache_next];
+        cache_next = (cache_next + 1) % EVM_ANALYSIS_CACHE_SIZE;
+        if (prog->users == 0) {
+            return prog;
+        }
+    }
+    return NULL;
+}
+
+// Analysis of the given bytecode, computed on first use and then reused
+// for every call of the same code. The result is not pre-decoded
+// (insn_count == 0) if the stream does not fit, and NULL if the bytecode
+// is larger than EVM_ANALYSIS_MAX_CODE_SIZE or every cache entry is in use.
+// The entry stays valid until evm_program_release().
+const evm_program_t *evm_program_load(const uint8_t *code, uint32_t size) {
+
+    uint8_t code_hash[32];
+    evm_program_t *prog;
+
+    if (size == 0 || size > EVM_ANALYSIS_MAX_CODE_SIZE) {
+        return NULL;
+    }
+    get_keccak256(code, size, code_hash);
+
+    EVM_LOCK();
+    prog = find(code_hash);
+    if (prog == NULL) {
+        prog = evict();
+        if (prog != NULL) {
+            memcpy(prog->code_hash, code_hash, 32);
+            prog->code_size = size;
+            analyse_jumpdests(prog, code, size);
+            evm_predecode(prog, code, size);
+            prog->aot = evm_aot_find(code_hash, size);
+        }
+    }
+    if (prog != NULL) {
+        prog->users++;
+    }
+    EVM_UNLOCK();
+    return prog;
+}
+
+// Analysis of code that arrives in pieces, e.g. over the network, without
+// holding all of it in RAM: the hash and the JUMPDEST bitmap are built as
+// the pieces come, the instruction stream once the code is complete.
+// The cache entry is taken at the start and only found by its hash at the
+// end. Returns -1 if every entry is in use; the code still gets hashed.
+int evm_program_stream_begin(evm_program_stream_t *stream) {
+
+    memset(stream, 0, sizeof(*stream));
+    keccak_init(&stream->hash);
+    EVM_LOCK();
+    stream->program = evict();
+    if (stream->program != NULL) {
+        // not valid until evm_program_stream_end()
+        stream->program->code_size = 0;
+        stream->program->users = 1;
+        memset(stream->program->jumpdest_bitmap, 0, sizeof(stream->program->jumpdest_bitmap));
+    }
+    EVM_UNLOCK();
+    return stream->program != NULL ? 0 : -1;
+}
+
+// The next length bytes of the code
+void evm_program_stream_feed(evm_program_stream_t *stream, const uint8_t *piece, uint32_t length) {
+
+    keccak_update(&stream->hash, piece, length);
+    if (stream->program != NULL && stream->size + length > EVM_ANALYSIS_MAX_CODE_SIZE) {
+        // too large, the code runs without analysis
+        evm_program_release(stream->program);
+        stream->program = NULL;
+    }
+    if (stream->program != NULL) {
+        stream->next_pc = mark_jumpdests(stream->program, piece, stream->size, length, stream->next_pc);
+    }
+    stream->size += length;
+}
+
+// Finish the analysis once all of code, now complete and readable in
+// place, was fed. Returns the entry, held like one of evm_program_load(),
+// or NULL if the code could not be analysed. stream->code_hash is set.
+const evm_program_t *evm_program_stream_end(evm_program_stream_t *stream, const uint8_t *code) {
+
+    evm_program_t *prog = stream->program;
+    evm_program_t *found;
+
+    keccak_final(&stream->hash, stream->code_hash);
+    if (prog == NULL || stream->size == 0) {
+        evm_program_release(prog);
+        return NULL;
+    }
+    EVM_LOCK();
+    found = find(stream->code_hash);
+    if (found != NULL) {
+        // analysed already
+        prog->users--;
+        found->users++;
+        prog = found;
+    }
+    else {
+        memcpy(prog->code_hash, stream->code_hash, 32);
+        prog->code_size = stream->size;
+        rank_jumpdests(prog);
+        evm_predecode(prog, code, stream->size);
+        prog->aot = evm_aot_find(prog->code_hash, prog->code_size);
+    }
+    EVM_UNLOCK();
+    return prog;
+}
+
+void evm_program_release(const evm_program_t *program) {
+
+    if (program == NULL) {
+        return;
+    }
+    EVM_LOCK();
+    ((evm_program_t *)program)->users--;
+    EVM_UNLOCK();
+}
+
+// Check that destination is a JUMPDEST opcode. Without an analysis the
+// bytecode is scanned from the start.
+bool evm_jumpdest_valid(const evm_program_t *prog, const uint8_t *code, uint32_t size, uint64_t destination) {
+
+    uint32_t pc = 0;
+
+    if (prog != NULL) {
+        return destination < prog->code_size &&
+            (prog->jumpdest_bitmap[destination / 32] & ((uint32_t)1 << (destination % 32)));
+    }
+    while (pc < size && pc < destination) {
+        pc += 1 + OPCODE_INFO[code[pc]].imm;
+    }
+    return pc == destination && pc < size && code[pc] == JUMPDEST;
+}
@@ -0,0 +1,192 @@
+#ifndef EVM_ANALYSIS_H
+#define EVM_ANALYSIS_H
+#include "evm.h"
+#include "keccak256.h"
+
+// Largest bytecode covered by the JUMPDEST bitmap
+#ifdef EVM_CONF_ANALYSIS_MAX_CODE_SIZE
+#define EVM_ANALYSIS_MAX_CODE_SIZE EVM_CONF_ANALYSIS_MAX_CODE_SIZE
+#else
+#define EVM_ANALYSIS_MAX_CODE_SIZE 4096
+#endif
+
+// Number of analysed contracts kept, keyed by their code hash
+#ifdef EVM_CONF_ANALYSIS_CACHE_SIZE
+#define EVM_ANALYSIS_CACHE_SIZE EVM_CONF_ANALYSIS_CACHE_SIZE
+#else
+#define EVM_ANALYSIS_CACHE_SIZE 1
+#endif
+
+// Upper bound of pre-decoded stream slots per contract, 2 bytes each; an
+// instruction takes one to four. The whole stream is built before the
+// superinstructions shorten it: the bundled contract needs 1369 slots for
+// its deployment and 1301 for its runtime code.
+#ifdef EVM_CONF_PROGRAM_MAX_INSNS
+#define EVM_PROGRAM_MAX_INSNS EVM_CONF_PROGRAM_MAX_INSNS
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_PROGRAM_MAX_INSNS 1376
+#else
+#define EVM_PROGRAM_MAX_INSNS 2048
+#endif
+
+// Upper bound of JUMPDEST opcodes per contract
+#ifdef EVM_CONF_PROGRAM_MAX_JUMPDESTS
+#define EVM_PROGRAM_MAX_JUMPDESTS EVM_CONF_PROGRAM_MAX_JUMPDESTS
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_PROGRAM_MAX_JUMPDESTS 64
+#else
+#define EVM_PROGRAM_MAX_JUMPDESTS 256
+#endif
+
+// Keep the bytecode offset of every instruction of the stream, for
+// tools/evm2c: dead code left out and superinstructions leave no other way
+// to tell them
+#ifdef EVM_CONF_PROGRAM_PCS
+#define EVM_PROGRAM_PCS EVM_CONF_PROGRAM_PCS
+#else
+#define EVM_PROGRAM_PCS 0
+#endif
+
+#define EVM_BITMAP_WORDS ((EVM_ANALYSIS_MAX_CODE_SIZE + 31) / 32)
+
+// offsets in the code are stream operands of 16 bits
+#if EVM_ANALYSIS_MAX_CODE_SIZE > UINT16_MAX
+#error "EVM_ANALYSIS_MAX_CODE_SIZE is larger than a stream operand"
+#endif
+#if EVM_PROGRAM_MAX_INSNS > UINT16_MAX
+#error "EVM_PROGRAM_MAX_INSNS is larger than a stream operand"
+#endif
+
+// Largest PUSH whose value is stored in the stream, in one or two operand
+// slots
+#define EVM_PUSH_INLINE_BYTES 4
+
+// Fuse common solc opcode sequences into superinstructions
+#ifdef EVM_CONF_SUPERINSNS
+#define EVM_SUPERINSNS EVM_CONF_SUPERINSNS
+#else
+#define EVM_SUPERINSNS 1
+#endif
+
+// Handlers that only exist in the pre-decoded stream. They are numbered in
+// 0xb0..0xef, a range without EVM opcodes; such bytes in the bytecode are
+// translated to OPX_UNDEFINED.
+enum evm_pseudo_op {
+    OPX_UNDEFINED = 0xb0,
+    OPX_BEGINBLOCK,         // start of a basic block that is not a JUMPDEST
+    // superinstructions, PUSH stands for PUSH1..PUSH4
+    OPX_PUSH_JUMPI,         // PUSH dest JUMPI, PUSH1 or PUSH2
+    OPX_PUSH_MLOAD,         // PUSH offset MLOAD, e.g. the free memory pointer
+    OPX_SELECTOR_JUMPI,     // DUP1 PUSH selector EQ PUSH dest JUMPI
+    OPX_SWAP1_POP,          // SWAP1 POP
+    OPX_ISZERO_ISZERO,      // ISZERO ISZERO
+};
+
+#define EVM_PSEUDO_FIRST 0xb0
+#define EVM_PSEUDO_LAST 0xef
+
+// One slot of the pre-decoded stream. An instruction is a slot with its
+// handler, the opcode byte or an OPX_ handler, and arg, followed by the
+// operand slots (imm) the handler takes:
+//  PUSH1, PUSH2                the pushed value
+//  PUSH3, PUSH4                the pushed value, high half first
+//  PUSH5..PUSH32               offset of the immediate bytes in the bytecode
+//  PC                          the program counter of the instruction
+//  JUMPDEST, OPX_BEGINBLOCK    static gas of the whole basic block, then
+//                              the most items the block puts above its
+//                              entry height
+//  OPX_PUSH_JUMPI              the jump destination
+//  OPX_PUSH_MLOAD              the memory offset
+//  OPX_SELECTOR_JUMPI          the selector, high half first, then the
+//                              jump destination
+// arg is the immediate width of PUSH, the depth of DUP and SWAP, and on
+// JUMPDEST and OPX_BEGINBLOCK the stack items the block reads below its
+// entry height. The stack is checked against a block once on entry.
+typedef union evm_insn {
+    struct {
+        uint8_t handler;
+        uint8_t arg;
+    };
+    uint16_t imm;
+} evm_insn_t;
+
+// Slots of the leader of a basic block: opcode, gas, grow
+#define EVM_LEADER_SLOTS 3
+
+// Slots the instruction at insn takes, its operands included
+static inline int evm_insn_length(const evm_insn_t *insn) {
+    switch (insn->handler) {
+    case JUMPDEST:
+    case OPX_BEGINBLOCK:
+        return EVM_LEADER_SLOTS;
+    case PUSH3:
+    case PUSH4:
+        return 3;
+    case OPX_SELECTOR_JUMPI:
+        return 4;
+    case PC:
+    case OPX_PUSH_JUMPI:
+    case OPX_PUSH_MLOAD:
+        return 2;
+    default:
+        return insn->handler >= PUSH1 && insn->handler <= PUSH32 ? 2 : 1;
+    }
+}
+
+// Result of the one-pass code analysis, cached by code hash. It does not
+// refer to the bytecode, every machine runs it over its own copy.
+// An entry in use by a machine (users != 0) is never replaced.
+// A JUMPDEST at bytecode offset pc is valid if bit pc of jumpdest_bitmap
+// is set. Its rank among the valid JUMPDESTs, bitmap_rank[pc / 32] plus the
+// set bits below pc in the same word, indexes jumpdest_insn.
+typedef struct evm_program {
+    uint8_t code_hash[32];
+    uint32_t code_size;
+    uint8_t users;
+    uint16_t insn_count;        // slots, 0 if the bytecode was too large to pre-decode
+    uint16_t jumpdest_count;
+    const struct evm_aot_contract *aot;     // translation of the code, NULL if none
+    uint32_t jumpdest_bitmap[EVM_BITMAP_WORDS];
+    uint16_t bitmap_rank[EVM_BITMAP_WORDS];
+    uint16_t jumpdest_insn[EVM_PROGRAM_MAX_JUMPDESTS];
+    evm_insn_t insn[EVM_PROGRAM_MAX_INSNS];
+#if EVM_PROGRAM_PCS
+    uint32_t pc[EVM_PROGRAM_MAX_INSNS];     // bytecode offset of the instruction at each slot
+#endif
+} evm_program_t;
+
+// State of an analysis fed piece by piece
+typedef struct evm_program_stream {
+    evm_program_t *program;     // cache entry being built, NULL if none
+    SHA3_CTX hash;
+    uint32_t size;              // bytes fed so far
+    uint32_t next_pc;           // first opcode not yet seen, past PUSH data
+    uint8_t code_hash[32];      // set by evm_program_stream_end()
+} evm_program_stream_t;
+
+int evm_predecode(evm_program_t *, const uint8_t *, uint32_t);
+const evm_program_t *evm_program_load(const uint8_t *, uint32_t);
+void evm_program_release(const evm_program_t *);
+const evm_program_t *evm_program_lookup(const uint8_t *);
+int evm_program_stream_begin(evm_program_stream_t *);
+void evm_program_stream_feed(evm_program_stream_t *, const uint8_t *, uint32_t);
+const evm_program_t *evm_program_stream_end(evm_program_stream_t *, const uint8_t *);
+bool evm_jumpdest_valid(const evm_program_t *, const uint8_t *, uint32_t, uint64_t);
+
+// Slot of the instruction a jump to destination lands on, -1 if the
+// destination is not a valid JUMPDEST. Constant time.
+static inline int evm_program_jump(const evm_program_t *prog, uint64_t destination) {
+    if (destination >= prog->code_size) {
+        return -1;
+    }
+    uint32_t word = prog->jumpdest_bitmap[destination / 32];
+    uint32_t bit = (uint32_t)1 << (destination % 32);
+    if (!(word & bit)) {
+        return -1;
+    }
+    return prog->jumpdest_insn[prog->bitmap_rank[destination / 32] + __builtin_popcount(word & (bit - 1))];
+}
+
+int execute_program(Machine *, const evm_program_t *, const uint8_t *);
+
+#endif /* EVM_ANALYSIS_H */
@@ -0,0 +1,31 @@
+#include "evm_aot.h"
+
+#if EVM_AOT
+// The translation of the contract with the given code hash, NULL if there
+// is none
+const evm_aot_contract_t *evm_aot_find(const uint8_t *code_hash, uint32_t code_size) {
+
+    for (int i = 0; i < evm_aot_contract_count; i++) {
+        if (evm_aot_contracts[i].code_size == code_size &&
+            memcmp(evm_aot_contracts[i].code_hash, code_hash, 32) == 0) {
+            return &evm_aot_contracts[i];
+        }
+    }
+    return NULL;
+}
+#endif
+
+// An opcode the translation leaves to the interpreter, run on the machine
+// stack. 0 to go on, otherwise the status the contract ends with.
+int evm_aot_op(Machine *machine_state, uint8_t op_code, const uint8_t *code) {
+
+    int status = decode_instruction(machine_state, op_code, code);
+
+    if (machine_state->SP > machine_state->stats.max_sp) {
+        machine_state->stats.max_sp = machine_state->SP;
+    }
+    if (status < 0) {
+        printf("ERROR!\n");
+    }
+    return status;
+}
@@ -0,0 +1,132 @@
+#ifndef EVM_AOT_H
+#define EVM_AOT_H
+#include "evm.h"
+
+// Contracts translated to C ahead of time by tools/evm2c and linked into
+// the firmware with EVM_AOT. A contract whose code hash matches one of
+// them runs its translation instead of an interpreter. The translated
+// code charges gas and checks the stack once per basic block like the
+// threaded interpreter, and runs every opcode it does not translate
+// through decode_instruction(), so the result and the gas are the same.
+// PC holds the bytecode offset of the block a paused call resumes at.
+
+typedef struct evm_aot_contract {
+    uint8_t code_hash[32];
+    uint32_t code_size;
+    // runs the contract on the current frame, returns like execute_program()
+    int (*run)(Machine *, const uint8_t *);
+} evm_aot_contract_t;
+
+#if EVM_AOT
+// defined by the file tools/evm2c writes, evm_aot_contracts.c
+extern const evm_aot_contract_t evm_aot_contracts[];
+extern const uint8_t evm_aot_contract_count;
+
+const evm_aot_contract_t *evm_aot_find(const uint8_t *, uint32_t);
+#else
+#define evm_aot_find(code_hash, code_size) NULL
+#endif
+
+int evm_aot_op(Machine *, uint8_t, const uint8_t *);
+
+// Entry of the block at pc: pause if the step is over, then charge its gas
+// and check the stack for it. 0 to run the block.
+static inline int evm_aot_block(Machine *machine_state, uint32_t pc, uint32_t gas, uint8_t need, uint8_t grow) {
+
+    if (machine_state->GAS_Charge >= machine_state->SLICE_End && machine_state->DEPTH == 0) {
+        machine_state->PC = pc;
+        return EVM_PAUSED;
+    }
+    machine_state->GAS_Charge += gas;
+    if (machine_state->GAS_Charge > machine_state->GAS_Limit) {
+        printf("Run out of GAS!\n");
+        return -1;
+    }
+    if (machine_state->SP - machine_state->SP_Base < need) {
+        empty_stack_err("block");
+        return -1;
+    }
+    if (machine_state->SP + grow > STACK_SPACE - 1) {
+        stack_overflow_err();
+        return -1;
+    }
+    return 0;
+}
+
+// The stack grew by count items, or shrank if count is negative
+static inline void evm_aot_grow(Machine *machine_state, int count) {
+
+    machine_state->SP += count;
+    if (machine_state->SP > machine_state->stats.max_sp) {
+        machine_state->stats.max_sp = machine_state->SP;
+    }
+}
+
+// The jump destination in item, -1 if no code is that large
+static inline int64_t evm_aot_dest(uint256_t *item) {
+
+    if (!zero128(&UPPER_P(item)) || UPPER(LOWER_P(item)) != 0 || LOWER(LOWER_P(item)) > INT32_MAX) {
+        return -1;
+    }
+    return LOWER(LOWER_P(item));
+}
+
+// The opcodes evm2c translates, with the operands in the order the
+// interpreter takes them (a is the top) and the result in r. evm2c folds
+// constants with the same functions.
+
+static inline void evm_aot_bool(uint256_t *r, bool value) {
+    clear256(r);
+    LOWER(LOWER_P(r)) = value;
+}
+
+static inline void evm_aot_lt(uint256_t *a, uint256_t *b, uint256_t *r) {
+    evm_aot_bool(r, gt256(b, a));
+}
+
+static inline void evm_aot_gt(uint256_t *a, uint256_t *b, uint256_t *r) {
+    evm_aot_bool(r, gt256(a, b));
+}
+
+static inline void evm_aot_eq(uint256_t *a, uint256_t *b, uint256_t *r) {
+    evm_aot_bool(r, equal256(a, b));
+}
+
+static inline void evm_aot_iszero(uint256_t *a, uint256_t *r) {
+    evm_aot_bool(r, zero256(a));
+}
+
+static inline void evm_aot_not(uint256_t *a, uint256_t *r) {
+    *r = *a;
+    not256(r);
+}
+
+static inline void evm_aot_div(uint256_t *a, uint256_t *b, uint256_t *r) {
+    uint256_t modulo;
+    if (zero256(b)) {
+        clear256(r);
+    }
+    else {
+        divmod256(a, b, r, &modulo);
+    }
+}
+
+static inline void evm_aot_mod(uint256_t *a, uint256_t *b, uint256_t *r) {
+    uint256_t quotient;
+    if (zero256(b)) {
+        clear256(r);
+    }
+    else {
+        divmod256(a, b, &quotient, r);
+    }
+}
+
+static inline void evm_aot_shl(uint256_t *a, uint256_t *b, uint256_t *r) {
+    shiftl256(b, (uint32_t)LOWER(LOWER_P(a)), r);
+}
+
+static inline void evm_aot_shr(uint256_t *a, uint256_t *b, uint256_t *r) {
+    shiftr256(b, (uint32_t)LOWER(LOWER_P(a)), r);
+}
+
+#endif /* EVM_AOT_H */
@@ -0,0 +1,294 @@
+#include "evm.h"
+#include "evm_call.h"
+
+static evm_call_frame_t frames[EVM_CALL_DEPTH];
+
+static evm_account_t accounts[EVM_CALL_ACCOUNTS];
+static evm_storage_t storages[EVM_CALL_ACCOUNTS];
+
+// Who holds every entry of accounts and where its code lies in the arena
+typedef struct account_slot {
+    uint8_t used;
+    const Machine *owner;     // the machine whose call made it, NULL once kept
+    uint32_t serial;          // numbers the contracts in the order they were made
+    uint16_t code_offset;
+    uint16_t code_length;
+} account_slot_t;
+
+static account_slot_t slots[EVM_CALL_ACCOUNTS];
+static uint32_t next_serial;
+
+static uint8_t code[EVM_CALL_CODE_SIZE];
+
+// Save the registers of the running frame and start an empty one above it:
+// no memory, no return data and a stack that begins at the caller's top.
+// The caller sets up the message, account and gas of the callee.
+// NULL if every frame record is in use.
+evm_call_frame_t *evm_call_enter(Machine *machine_state) {
+
+    evm_call_frame_t *frame = NULL;
+
+    EVM_LOCK();
+    for (int i = 0; i < EVM_CALL_DEPTH; i++) {
+        if (!frames[i].used) {
+            frame = &frames[i];
+            frame->used = 1;
+            break;
+        }
+    }
+    EVM_UNLOCK();
+    if (frame == NULL) {
+        printf("Call: more than %u nested frames\n", EVM_CALL_DEPTH);
+        return NULL;
+    }
+    frame->STATIC = machine_state->STATIC;
+    frame->SP = machine_state->SP;
+    frame->SP_Base = machine_state->SP_Base;
+    frame->PC = machine_state->PC;
+    frame->GAS_Limit = machine_state->GAS_Limit;
+    frame->MEM_Words = machine_state->MEM_Words;
+    frame->RETURN_Length = machine_state->RETURN_Length;
+    frame->MEM = machine_state->MEM;
+    frame->RETURNDATA_Pages = machine_state->RETURNDATA_Pages;
+    frame->RETURNDATA_Offset = machine_state->RETURNDATA_Offset;
+    frame->RETURNDATA_Length = machine_state->RETURNDATA_Length;
+    frame->message = machine_state->message;
+    frame->program = machine_state->program;
+    frame->ACCOUNT = machine_state->ACCOUNT;
+    frame->callee = NULL;
+    frame->journal_frame = machine_state->JOURNAL.frame;
+    evm_call_mark(machine_state, &frame->mark);
+
+    machine_state->SP_Base = machine_state->SP;
+    machine_state->PC = 0;
+    machine_state->MEM_Words = 0;
+    machine_state->RETURN_Offset = 0;
+    machine_state->RETURN_Length = 0;
+    memset(&machine_state->MEM, 0, sizeof(machine_state->MEM));
+    memset(&machine_state->RETURNDATA_Pages, 0, sizeof(machine_state->RETURNDATA_Pages));
+    machine_state->RETURNDATA_Offset = 0;
+    machine_state->RETURNDATA_Length = 0;
+    machine_state->program = NULL;
+    machine_state->JOURNAL.frame = machine_state->JOURNAL.length;
+    machine_state->DEPTH++;
+    return frame;
+}
+
+// Undo the storage changes and forget the contracts this machine made
+// since mark, with their code. Those of other machines stay.
+static void rollback(Machine *machine_state, const evm_call_mark_t *mark) {
+
+    evm_storage_rollback(&machine_state->JOURNAL, mark->journal);
+    EVM_LOCK();
+    for (int i = 0; i < EVM_CALL_ACCOUNTS; i++) {
+        if (slots[i].used && slots[i].owner == machine_state && slots[i].serial >= mark->serial) {
+            slots[i].used = 0;
+        }
+    }
+    EVM_UNLOCK();
+}
+
+// Return to the caller of the running frame, which ended with status.
+// The pages holding the callee's output become the caller's return data.
+// A failed or reverted callee is undone; after a failure the return data
+// is empty and all gas given to the callee is used up.
+void evm_call_leave(Machine *machine_state, evm_call_frame_t *frame, int status) {
+
+    evm_memory_free(&machine_state->RETURNDATA_Pages);
+    evm_memory_free(&frame->RETURNDATA_Pages);
+    if (!EVM_CALL_OK(status)) {
+        rollback(machine_state, &frame->mark);
+    }
+    if (status >= 0) {
+        machine_state->RETURNDATA_Pages = machine_state->MEM;
+        evm_memory_keep(&machine_state->RETURNDATA_Pages, machine_state->RETURN_Offset, machine_state->RETURN_Length);
+        machine_state->RETURNDATA_Offset = machine_state->RETURN_Offset;
+        machine_state->RETURNDATA_Length = machine_state->RETURN_Length;
+    }
+    else {
+        evm_memory_free(&machine_state->MEM);
+        machine_state->RETURNDATA_Offset = 0;
+        machine_state->RETURNDATA_Length = 0;
+        machine_state->GAS_Charge = machine_state->GAS_Limit;
+    }
+
+    machine_state->STATIC = frame->STATIC;
+    machine_state->SP = frame->SP;
+    machine_state->SP_Base = frame->SP_Base;
+    machine_state->PC = frame->PC;
+    machine_state->GAS_Limit = frame->GAS_Limit;
+    machine_state->MEM_Words = frame->MEM_Words;
+    machine_state->RETURN_Length = frame->RETURN_Length;
+    machine_state->MEM = frame->MEM;
+    machine_state->message = frame->message;
+    machine_state->program = frame->program;
+    machine_state->ACCOUNT = frame->ACCOUNT;
+    machine_state->JOURNAL.frame = frame->journal_frame;
+    machine_state->DEPTH--;
+    EVM_LOCK();
+    frame->used = 0;
+    EVM_UNLOCK();
+}
+
+void evm_call_mark(Machine *machine_state, evm_call_mark_t *mark) {
+
+    mark->journal = machine_state->JOURNAL.length;
+    EVM_LOCK();
+    mark->serial = next_serial;
+    EVM_UNLOCK();
+}
+
+// End of the outermost call, which ended with status: commit the storage
+// changes of every contract, or if it failed or reverted undo them and
+// forget the contracts created since mark
+void evm_call_finish(Machine *machine_state, const evm_call_mark_t *mark, int status) {
+
+    if (!EVM_CALL_OK(status)) {
+        rollback(machine_state, mark);
+    }
+    // the contracts it made are kept
+    EVM_LOCK();
+    for (int i = 0; i < EVM_CALL_ACCOUNTS; i++) {
+        if (slots[i].owner == machine_state) {
+            slots[i].owner = NULL;
+        }
+    }
+    EVM_UNLOCK();
+#if EVM_STORAGE_PERSISTENT
+    // one append per contract file
+    evm_storage_flush(&machine_state->STORAGE, &machine_state->JOURNAL);
+    for (int i = 0; i < EVM_CALL_ACCOUNTS; i++) {
+        if (slots[i].used) {
+            evm_storage_flush(accounts[i].storage, &machine_state->JOURNAL);
+        }
+    }
+#else
+    evm_storage_commit(&machine_state->JOURNAL, NULL, NULL, NULL);
+#endif
+    machine_state->JOURNAL.length = mark->journal;
+    evm_memory_free(&machine_state->RETURNDATA_Pages);
+    machine_state->RETURNDATA_Length = 0;
+}
+
+// The contract at address, NULL if there is none
+evm_account_t *evm_account_find(Machine *machine_state, const uint256_t *address) {
+
+    if (equal256(&machine_state->SELF.address, (uint256_t *)address)) {
+        return &machine_state->SELF;
+    }
+    for (int i = 0; i < EVM_CALL_ACCOUNTS; i++) {
+        if (slots[i].used && equal256(&accounts[i].address, (uint256_t *)address)) {
+            return &accounts[i];
+        }
+    }
+    return NULL;
+}
+
+// Whether a call of any machine still needs accounts[i]: a nested frame
+// runs as it, or a call that has not finished changed its storage, which
+// its journal may have to undo
+static bool account_in_use(int i) {
+    for (int j = 0; j < EVM_CALL_DEPTH; j++) {
+        if (frames[j].used && frames[j].callee == &accounts[i]) {
+            return true;
+        }
+    }
+    for (int k = 0; k < EVM_STORAGE_CAPACITY; k++) {
+        if (storages[i].flags[k] & EVM_STORAGE_DIRTY) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The entry for a new contract: a free one, else the oldest kept contract
+// no call needs. -1 if every entry is in use.
+static int account_slot(void) {
+
+    int oldest = -1;
+
+    for (int i = 0; i < EVM_CALL_ACCOUNTS; i++) {
+        if (!slots[i].used) {
+            return i;
+        }
+        if (slots[i].owner == NULL && !account_in_use(i) &&
+            (oldest < 0 || slots[i].serial < slots[oldest].serial)) {
+            oldest = i;
+        }
+    }
+    if (oldest >= 0) {
+        printf("Call: forgetting the oldest created contract\n");
+    }
+    return oldest;
+}
+
+// A new contract at address with empty storage and no code yet, made by
+// the running call of machine_state. NULL if every entry of the table is
+// used by a running call.
+evm_account_t *evm_account_create(Machine *machine_state, const uint256_t *address) {
+
+    evm_account_t *account = NULL;
+    int i;
+
+    EVM_LOCK();
+    i = account_slot();
+    if (i >= 0) {
+        slots[i].used = 1;
+        slots[i].owner = machine_state;
+        slots[i].serial = next_serial++;
+        slots[i].code_offset = 0;
+        slots[i].code_length = 0;
+        account = &accounts[i];
+        account->storage = &storages[i];
+    }
+    EVM_UNLOCK();
+    if (account == NULL) {
+        printf("Call: more than %u created contracts in use\n", EVM_CALL_ACCOUNTS);
+        return NULL;
+    }
+    account->address = *address;
+    account->code = NULL;
+    account->code_size = 0;
+    account->nonce = 1;
+    evm_storage_init(account->storage);
+#if EVM_STORAGE_PERSISTENT
+    evm_storage_open(account->storage, address);
+#endif
+    return account;
+}
+
+// length bytes of the arena for the code of account, in place of those it
+// had: first the init code, then the runtime code. NULL if there is no
+// room.
+uint8_t *evm_account_code_alloc(evm_account_t *account, uint32_t length) {
+
+    account_slot_t *slot = &slots[account - accounts];
+    uint8_t *space = NULL;
+    uint32_t offset = 0;
+    bool moved = true;
+
+    EVM_LOCK();
+    slot->code_length = 0;
+    // first fit between the code of the other contracts
+    while (moved && offset + length <= EVM_CALL_CODE_SIZE) {
+        moved = false;
+        for (int i = 0; i < EVM_CALL_ACCOUNTS; i++) {
+            if (slots[i].used && slots[i].code_length != 0 &&
+                offset < slots[i].code_offset + slots[i].code_length &&
+                slots[i].code_offset < offset + length) {
+                offset = slots[i].code_offset + slots[i].code_length;
+                moved = true;
+            }
+        }
+    }
+    if (offset + length <= EVM_CALL_CODE_SIZE) {
+        slot->code_offset = (uint16_t)offset;
+        slot->code_length = (uint16_t)length;
+        space = code + offset;
+    }
+    EVM_UNLOCK();
+    if (space == NULL) {
+        printf("Call: no room for %lu bytes of code\n", (unsigned long)length);
+    }
+    return space;
+}
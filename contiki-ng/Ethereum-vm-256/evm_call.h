@@ -0,0 +1,80 @@
+#ifndef EVM_CALL_H
+#define EVM_CALL_H
+#include "evm.h"
+
+// Nested calls (CALL, CALLCODE, DELEGATECALL, STATICCALL, CREATE) run on
+// the Machine of the outermost call. The callee's stack items go above the
+// caller's (SP_Base), its memory pages come from the shared pool, and the
+// caller's registers are kept in a frame record from a pool of
+// EVM_CALL_DEPTH records shared by all machines. The callee's output stays
+// in its memory pages, which become the caller's return data.
+// Contracts made by CREATE are kept, as long as the device runs, in a table
+// of accounts with their code in an arena and their storage in a table of
+// their own. Until the outermost call that made a contract ends well, the
+// contract belongs to that machine, and only a failure on that machine
+// forgets it again.
+
+// Nested frames running at the same time over all machines
+#ifdef EVM_CONF_CALL_DEPTH
+#define EVM_CALL_DEPTH EVM_CONF_CALL_DEPTH
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_CALL_DEPTH 2
+#else
+#define EVM_CALL_DEPTH 4
+#endif
+
+// Contracts made by CREATE kept at the same time. When the table is full
+// the oldest one no running call uses makes room for the new one.
+#ifdef EVM_CONF_CALL_ACCOUNTS
+#define EVM_CALL_ACCOUNTS EVM_CONF_CALL_ACCOUNTS
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_CALL_ACCOUNTS 1
+#else
+#define EVM_CALL_ACCOUNTS 4
+#endif
+
+// Bytes of code of these contracts, init code included while it runs
+#ifdef EVM_CONF_CALL_CODE_SIZE
+#define EVM_CALL_CODE_SIZE EVM_CONF_CALL_CODE_SIZE
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_CALL_CODE_SIZE 1024
+#else
+#define EVM_CALL_CODE_SIZE 2048
+#endif
+
+// A frame that ended with status changed state: it neither failed nor
+// reverted
+#define EVM_CALL_OK(status) ((status) >= 0 && (status) != REVERT)
+
+// What a nested call changes in the Machine of its caller
+typedef struct evm_call_frame {
+    uint8_t used;
+    uint8_t STATIC;
+    int SP;
+    int SP_Base;
+    uint32_t PC;
+    uint32_t GAS_Limit;
+    uint32_t MEM_Words;
+    uint32_t RETURN_Length;
+    uint16_t journal_frame;
+    evm_memory_t MEM;
+    evm_memory_t RETURNDATA_Pages;
+    uint32_t RETURNDATA_Offset;
+    uint32_t RETURNDATA_Length;
+    Message_Ext message;
+    const struct evm_program *program;
+    evm_account_t *ACCOUNT;
+    evm_account_t *callee;              // account the callee runs as, NULL if the caller's
+    evm_call_mark_t mark;
+} evm_call_frame_t;
+
+evm_call_frame_t *evm_call_enter(Machine *);
+void evm_call_leave(Machine *, evm_call_frame_t *, int);
+void evm_call_mark(Machine *, evm_call_mark_t *);
+void evm_call_finish(Machine *, const evm_call_mark_t *, int);
+
+evm_account_t *evm_account_find(Machine *, const uint256_t *);
+evm_account_t *evm_account_create(Machine *, const uint256_t *);
+uint8_t *evm_account_code_alloc(evm_account_t *, uint32_t);
+
+#endif /* EVM_CALL_H */
@@ -0,0 +1,148 @@
+#include "evm.h"
+#include "evm_code.h"
+
+#if EVM_CODE_FLASH
+#include "dev/flash.h"
+#include "dev/rom-util.h"
+
+// the pages right below the one holding the CCA
+#define REGION_START ((FLASH_CCA_ADDR & ~(FLASH_PAGE_SIZE - 1)) - EVM_CODE_PAGES * FLASH_PAGE_SIZE)
+#define SLOT_ADDRESS(slot) (REGION_START + (slot) * EVM_CODE_SLOT_SIZE)
+#define region ((uint8_t (*)[EVM_CODE_SLOT_SIZE])REGION_START)
+#else
+static uint8_t region[EVM_CODE_SLOTS][EVM_CODE_SLOT_SIZE];
+#endif
+
+#define MAGIC 0x45564D43            // "EVMC"
+
+// Bytes are programmed a block of whole words at a time
+#define BLOCK_WORDS 8
+
+static struct {
+    uint8_t slot;
+    uint8_t open;
+    uint32_t written;               // image bytes received
+    uint32_t flushed;               // image bytes programmed
+    uint32_t block[BLOCK_WORDS];
+} writer;
+
+static void erase(uint8_t slot) {
+#if EVM_CODE_FLASH
+    rom_util_page_erase(SLOT_ADDRESS(slot), EVM_CODE_SLOT_SIZE);
+#else
+    memset(region[slot], 0xFF, EVM_CODE_SLOT_SIZE);
+#endif
+}
+
+// Program length bytes, a multiple of 4, at offset of the slot
+static int program(uint8_t slot, uint32_t offset, uint32_t *data, uint32_t length) {
+#if EVM_CODE_FLASH
+    return rom_util_program_flash(data, SLOT_ADDRESS(slot) + offset, length) == 0 ? 0 : -1;
+#else
+    memcpy(region[slot] + offset, data, length);
+    return 0;
+#endif
+}
+
+static int flush_block(void) {
+
+    uint32_t length = writer.written - writer.flushed;
+
+    if (length == 0) {
+        return 0;
+    }
+    // pad the last word with erased bytes
+    memset((uint8_t *)writer.block + length, 0xFF, (4 - length % 4) % 4);
+    if (program(writer.slot, sizeof(evm_code_header_t) + writer.flushed, writer.block, (length + 3) & ~3u) < 0) {
+        printf("Code: cannot program slot %u\n", writer.slot);
+        return -1;
+    }
+    writer.flushed = writer.written;
+    return 0;
+}
+
+// Erase slot for a new image
+int evm_code_begin(uint8_t slot) {
+
+    if (slot >= EVM_CODE_SLOTS) {
+        return -1;
+    }
+    erase(slot);
+    writer.slot = slot;
+    writer.open = 1;
+    writer.written = 0;
+    writer.flushed = 0;
+    return 0;
+}
+
+// Append length bytes at offset of the image, the bytes must arrive in order.
+// The signature fits Machine.RETURN_Sink.
+int evm_code_write(const uint8_t *data, uint32_t offset, uint32_t length) {
+
+    if (!writer.open || offset != writer.written) {
+        printf("Code: write at 0x%lX out of order\n", (unsigned long)offset);
+        return -1;
+    }
+    if (offset + length > EVM_CODE_MAX_SIZE) {
+        printf("Code: more than %u bytes\n", (unsigned)EVM_CODE_MAX_SIZE);
+        return -1;
+    }
+    while (length > 0) {
+        uint32_t used = writer.written - writer.flushed;
+        uint32_t chunk = sizeof(writer.block) - used;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy((uint8_t *)writer.block + used, data, chunk);
+        writer.written += chunk;
+        data += chunk;
+        length -= chunk;
+        if (writer.written - writer.flushed == sizeof(writer.block) && flush_block() < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Finish the image with its length and the hash of its source, if any,
+// which makes it visible to evm_code_get(). An empty image, e.g. from a
+// failed deploy, is not kept.
+int evm_code_end(uint32_t length, const uint8_t *source_hash) {
+
+    evm_code_header_t header;
+
+    if (!writer.open || length == 0 || length != writer.written || flush_block() < 0) {
+        writer.open = 0;
+        return -1;
+    }
+    writer.open = 0;
+    header.magic = MAGIC;
+    header.length = length;
+    if (source_hash != NULL) {
+        memcpy(header.source_hash, source_hash, sizeof(header.source_hash));
+    }
+    else {
+        memset(header.source_hash, 0, sizeof(header.source_hash));
+    }
+    return program(writer.slot, 0, (uint32_t *)&header, sizeof(header));
+}
+
+// The image in slot, NULL if it is empty or, unless source_hash is NULL,
+// was built from something else
+const uint8_t *evm_code_get(uint8_t slot, const uint8_t *source_hash, uint32_t *length) {
+
+    const evm_code_header_t *header;
+
+    if (slot >= EVM_CODE_SLOTS) {
+        return NULL;
+    }
+    header = (const evm_code_header_t *)region[slot];
+    if (header->magic != MAGIC || header->length > EVM_CODE_MAX_SIZE) {
+        return NULL;
+    }
+    if (source_hash != NULL && memcmp(header->source_hash, source_hash, sizeof(header->source_hash)) != 0) {
+        return NULL;
+    }
+    *length = header->length;
+    return region[slot] + sizeof(evm_code_header_t);
+}
@@ -0,0 +1,48 @@
+#ifndef EVM_CODE_H
+#define EVM_CODE_H
+#include <stdint.h>
+
+// Code region: fixed slots that each hold one contract image, read in
+// place through a const pointer. On the cc2538 the slots are internal
+// flash pages below the CCA page, which the firmware area must leave free
+// (see FLASH_CONF_FW_SIZE in the Makefile); elsewhere they are RAM.
+// An image is written front to back between evm_code_begin() and
+// evm_code_end(); its header goes last, so a slot whose writing was
+// interrupted reads as empty.
+
+// Write the slots to the cc2538 internal flash
+#ifdef EVM_CONF_CODE_FLASH
+#define EVM_CODE_FLASH EVM_CONF_CODE_FLASH
+#else
+#define EVM_CODE_FLASH 0
+#endif
+
+// Flash pages of the whole region, split evenly between the slots
+#ifdef EVM_CONF_CODE_PAGES
+#define EVM_CODE_PAGES EVM_CONF_CODE_PAGES
+#else
+#define EVM_CODE_PAGES 6
+#endif
+
+#define EVM_CODE_PAGE_SIZE 2048
+#define EVM_CODE_SLOTS 2
+#define EVM_CODE_SLOT_SIZE (EVM_CODE_PAGES / EVM_CODE_SLOTS * EVM_CODE_PAGE_SIZE)
+
+// Largest image a slot holds
+#define EVM_CODE_MAX_SIZE (EVM_CODE_SLOT_SIZE - sizeof(evm_code_header_t))
+
+#define EVM_CODE_SLOT_RUNTIME 0
+#define EVM_CODE_SLOT_INIT 1       // init code received for deployment
+
+typedef struct evm_code_header {
+    uint32_t magic;
+    uint32_t length;
+    uint8_t source_hash[32];        // identifies what the image was built from
+} evm_code_header_t;
+
+int evm_code_begin(uint8_t);
+int evm_code_write(const uint8_t *, uint32_t, uint32_t);
+int evm_code_end(uint32_t, const uint8_t *);
+const uint8_t *evm_code_get(uint8_t, const uint8_t *, uint32_t *);
+
+#endif /* EVM_CODE_H */
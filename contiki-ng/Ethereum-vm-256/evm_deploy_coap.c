@@ -0,0 +1,150 @@
+#include "evm_deploy_coap.h"
+#include "evm_analysis.h"
+#include "evm_code.h"
+#include "coap-engine.h"
+#include "coap-block1.h"
+
+// Only one block and the analysis state are held in RAM, the code itself
+// is in the code slot as soon as its block arrived.
+
+// RFC 7959 code for a block out of sequence, missing in coap-constants.h
+#define REQUEST_ENTITY_INCOMPLETE_4_08 136
+
+enum deploy_state {
+    DEPLOY_IDLE,
+    DEPLOY_RECEIVING,
+    DEPLOY_RUNNING,
+    DEPLOY_DONE,
+    DEPLOY_FAILED,
+};
+
+process_event_t evm_deploy_event;
+
+static struct process *deployer;
+static uint8_t state;
+static uint32_t received;
+static uint32_t runtime_size;
+static evm_program_stream_t stream;
+static evm_deploy_t deploy;
+
+static void res_get_handler(coap_message_t *, coap_message_t *, uint8_t *, uint16_t, int32_t *);
+static void res_put_handler(coap_message_t *, coap_message_t *, uint8_t *, uint16_t, int32_t *);
+
+RESOURCE(res_evm_deploy,
+         "title=\"EVM deploy\";rt=\"application/octet-stream\"",
+         res_get_handler,
+         NULL,
+         res_put_handler,
+         NULL);
+
+static void abort_transfer(void) {
+    evm_program_release(stream.program);
+    stream.program = NULL;
+    state = DEPLOY_FAILED;
+}
+
+static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+
+    int length;
+
+    switch (state) {
+        case DEPLOY_RECEIVING:
+            length = snprintf((char *)buffer, preferred_size, "receiving %lu", (unsigned long)received);
+            break;
+        case DEPLOY_RUNNING:
+            length = snprintf((char *)buffer, preferred_size, "running");
+            break;
+        case DEPLOY_DONE:
+            length = snprintf((char *)buffer, preferred_size, "deployed %lu", (unsigned long)runtime_size);
+            break;
+        case DEPLOY_FAILED:
+            length = snprintf((char *)buffer, preferred_size, "failed");
+            break;
+        default:
+            length = snprintf((char *)buffer, preferred_size, "idle");
+            break;
+    }
+    coap_set_header_content_format(response, TEXT_PLAIN);
+    coap_set_payload(response, buffer, length);
+}
+
+static void res_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+
+    const uint8_t *payload = NULL;
+    int length = coap_get_payload(request, &payload);
+    // 0 without a Block1 option
+    uint32_t at = request->block1_offset;
+    int more;
+
+    if (state == DEPLOY_RUNNING) {
+        coap_set_status_code(response, SERVICE_UNAVAILABLE_5_03);
+        return;
+    }
+    if (at == 0) {
+        // a new transfer, an unfinished one is dropped
+        evm_program_release(stream.program);
+        evm_code_begin(EVM_CODE_SLOT_INIT);
+        // without a free analysis entry the code is analysed when it runs
+        evm_program_stream_begin(&stream);
+        received = 0;
+        state = DEPLOY_RECEIVING;
+    }
+    else if (state != DEPLOY_RECEIVING || at != received) {
+        coap_set_status_code(response, REQUEST_ENTITY_INCOMPLETE_4_08);
+        return;
+    }
+
+    more = coap_block1_handler(request, response, NULL, NULL, EVM_CODE_MAX_SIZE);
+    if (more < 0) {
+        abort_transfer();
+        return;
+    }
+    if (evm_code_write(payload, at, length) < 0) {
+        coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+        abort_transfer();
+        return;
+    }
+    evm_program_stream_feed(&stream, payload, length);
+    received += length;
+    if (more) {
+        // 2.31 Continue is set
+        return;
+    }
+
+    // last block: finish the analysis over the code in place and hand
+    // it to the deployer
+    if (evm_code_end(received, NULL) < 0) {
+        coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+        abort_transfer();
+        return;
+    }
+    deploy.code = evm_code_get(EVM_CODE_SLOT_INIT, NULL, &deploy.size);
+    deploy.program = evm_program_stream_end(&stream, deploy.code);
+    stream.program = NULL;
+    memcpy(deploy.code_hash, stream.code_hash, sizeof(deploy.code_hash));
+    if (process_post(deployer, evm_deploy_event, &deploy) != PROCESS_ERR_OK) {
+        evm_program_release(deploy.program);
+        state = DEPLOY_FAILED;
+        coap_set_status_code(response, SERVICE_UNAVAILABLE_5_03);
+        return;
+    }
+    state = DEPLOY_RUNNING;
+    coap_set_status_code(response, CHANGED_2_04);
+}
+
+// Serve evm/deploy, deployments are passed to process
+void evm_deploy_coap_init(struct process *process) {
+
+    deployer = process;
+    evm_deploy_event = process_alloc_event();
+    coap_engine_init();
+    coap_activate_resource(&res_evm_deploy, "evm/deploy");
+}
+
+// The constructor has run, runtime_length is the size of the runtime code
+// it returned, 0 if it failed
+void evm_deploy_done(uint32_t runtime_length) {
+
+    runtime_size = runtime_length;
+    state = runtime_length != 0 ? DEPLOY_DONE : DEPLOY_FAILED;
+}
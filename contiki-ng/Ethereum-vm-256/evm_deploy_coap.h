@@ -0,0 +1,26 @@
+#ifndef EVM_DEPLOY_COAP_H
+#define EVM_DEPLOY_COAP_H
+#include "contiki.h"
+#include "evm.h"
+
+// Deployment over CoAP: init code PUT to evm/deploy with Block1 goes
+// block by block into the EVM_CODE_SLOT_INIT code slot while it is
+// analysed. After the last block the process given to
+// evm_deploy_coap_init() gets evm_deploy_event with an evm_deploy_t, runs
+// the constructor and reports the outcome with evm_deploy_done().
+// GET evm/deploy tells the state of the last deployment.
+
+// Init code ready to run in place
+typedef struct evm_deploy {
+    const uint8_t *code;
+    uint32_t size;
+    uint8_t code_hash[32];
+    const struct evm_program *program;  // held analysis, NULL if none
+} evm_deploy_t;
+
+extern process_event_t evm_deploy_event;
+
+void evm_deploy_coap_init(struct process *);
+void evm_deploy_done(uint32_t);
+
+#endif /* EVM_DEPLOY_COAP_H */
@@ -0,0 +1,181 @@
+#include "evm.h"
+#include "evm_memory.h"
+
+static uint8_t pool[EVM_MEMORY_POOL_PAGES][EVM_MEMORY_PAGE_SIZE];
+static uint8_t free_pages[EVM_MEMORY_POOL_PAGES];
+static uint8_t free_count;
+static uint8_t allocated;     // pages handed out at least once
+
+// A zeroed page from the pool, -1 if the pool is exhausted. Pages never
+// used before are taken in order, so the free list needs no initialisation.
+static int alloc_page(void) {
+
+    int index = -1;
+
+    EVM_LOCK();
+    if (free_count > 0) {
+        index = free_pages[--free_count];
+    }
+    else if (allocated < EVM_MEMORY_POOL_PAGES) {
+        index = allocated++;
+    }
+    EVM_UNLOCK();
+    if (index >= 0) {
+        memset(pool[index], 0, EVM_MEMORY_PAGE_SIZE);
+    }
+    return index;
+}
+
+// Give all pages of memory back to the pool
+void evm_memory_free(evm_memory_t *memory) {
+
+    EVM_LOCK();
+    for (int i = 0; i < EVM_MEMORY_PAGES; i++) {
+        if (memory->page[i] != 0) {
+            free_pages[free_count++] = memory->page[i] - 1;
+            memory->page[i] = 0;
+        }
+    }
+    EVM_UNLOCK();
+}
+
+// Give back the pages that hold nothing of the length bytes at offset
+void evm_memory_keep(evm_memory_t *memory, uint32_t offset, uint32_t length) {
+
+    uint32_t first = offset / EVM_MEMORY_PAGE_SIZE;
+    uint32_t end = (offset + length + EVM_MEMORY_PAGE_SIZE - 1) / EVM_MEMORY_PAGE_SIZE;
+
+    if (length == 0) {
+        evm_memory_free(memory);
+        return;
+    }
+    EVM_LOCK();
+    for (uint32_t i = 0; i < EVM_MEMORY_PAGES; i++) {
+        if (memory->page[i] != 0 && (i < first || i >= end)) {
+            free_pages[free_count++] = memory->page[i] - 1;
+            memory->page[i] = 0;
+        }
+    }
+    EVM_UNLOCK();
+}
+
+// Copy length bytes of data to offset, zeros if data is NULL.
+// The range must lie within EVM_MEMORY_SIZE.
+// Returns -1 if a page could not be allocated.
+int evm_memory_write(evm_memory_t *memory, uint32_t offset, const uint8_t *data, uint32_t length) {
+
+    while (length > 0) {
+        uint32_t page = offset / EVM_MEMORY_PAGE_SIZE;
+        uint32_t in_page = offset % EVM_MEMORY_PAGE_SIZE;
+        uint32_t chunk = EVM_MEMORY_PAGE_SIZE - in_page;
+        if (chunk > length) {
+            chunk = length;
+        }
+        // writing zeros to an untouched page changes nothing
+        if (memory->page[page] == 0 && data != NULL) {
+            int index = alloc_page();
+            if (index < 0) {
+                printf("Memory: pool of %u pages exhausted\n", EVM_MEMORY_POOL_PAGES);
+                return -1;
+            }
+            memory->page[page] = index + 1;
+        }
+        if (data != NULL) {
+            memcpy(&pool[memory->page[page] - 1][in_page], data, chunk);
+            data += chunk;
+        }
+        else if (memory->page[page] != 0) {
+            memset(&pool[memory->page[page] - 1][in_page], 0, chunk);
+        }
+        offset += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Copy length bytes at offset to out. The range must lie within
+// EVM_MEMORY_SIZE.
+void evm_memory_read(const evm_memory_t *memory, uint32_t offset, uint8_t *out, uint32_t length) {
+
+    while (length > 0) {
+        uint32_t page = offset / EVM_MEMORY_PAGE_SIZE;
+        uint32_t in_page = offset % EVM_MEMORY_PAGE_SIZE;
+        uint32_t chunk = EVM_MEMORY_PAGE_SIZE - in_page;
+        if (chunk > length) {
+            chunk = length;
+        }
+        if (memory->page[page] == 0) {
+            memset(out, 0, chunk);
+        }
+        else {
+            memcpy(out, &pool[memory->page[page] - 1][in_page], chunk);
+        }
+        out += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+}
+
+// The bytes at offset up to the end of their page, in place. *length is
+// cut to their number. NULL if the page is untouched and reads as zeros.
+const uint8_t *evm_memory_span(const evm_memory_t *memory, uint32_t offset, uint32_t *length) {
+
+    uint32_t page = memory->page[offset / EVM_MEMORY_PAGE_SIZE];
+    uint32_t in_page = offset % EVM_MEMORY_PAGE_SIZE;
+
+    if (*length > EVM_MEMORY_PAGE_SIZE - in_page) {
+        *length = EVM_MEMORY_PAGE_SIZE - in_page;
+    }
+    return page == 0 ? NULL : &pool[page - 1][in_page];
+}
+
+// Copy length bytes at from_offset in another memory to to_offset, from
+// page to page. Untouched pages stay untouched where zeros are copied.
+// Returns -1 if a page could not be allocated.
+int evm_memory_copy(evm_memory_t *to, uint32_t to_offset, const evm_memory_t *from, uint32_t from_offset, uint32_t length) {
+
+    while (length > 0) {
+        uint32_t chunk = length;
+        const uint8_t *data = evm_memory_span(from, from_offset, &chunk);
+        if (evm_memory_write(to, to_offset, data, chunk) < 0) {
+            return -1;
+        }
+        to_offset += chunk;
+        from_offset += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Pass the length bytes at offset to each(), in place and a piece at a
+// time, for hashing them without a copy. -1 as soon as each() fails.
+int evm_memory_each(const evm_memory_t *memory, uint32_t offset, uint32_t length,
+                    int (*each)(void *, const uint8_t *, uint32_t), void *arg) {
+
+    static const uint8_t zeros[64];
+
+    while (length > 0) {
+        uint32_t chunk = length;
+        const uint8_t *data = evm_memory_span(memory, offset, &chunk);
+        if (data == NULL) {
+            data = zeros;
+            chunk = chunk < sizeof(zeros) ? chunk : sizeof(zeros);
+        }
+        if (each(arg, data, chunk) < 0) {
+            return -1;
+        }
+        offset += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+uint32_t evm_memory_pages_used(const evm_memory_t *memory) {
+
+    uint32_t used = 0;
+
+    for (int i = 0; i < EVM_MEMORY_PAGES; i++) {
+        used += memory->page[i] != 0;
+    }
+    return used;
+}
@@ -0,0 +1,51 @@
+#ifndef EVM_MEMORY_H
+#define EVM_MEMORY_H
+#include <stdint.h>
+
+// EVM memory is split in pages taken from a pool shared by all machines.
+// A page is only allocated, and zeroed, when it is first written; reading
+// an untouched page gives zeros. Freeing a machine's memory just returns
+// its pages to the pool.
+
+// Bytes per page, a power of two
+#ifdef EVM_CONF_MEMORY_PAGE_SIZE
+#define EVM_MEMORY_PAGE_SIZE EVM_CONF_MEMORY_PAGE_SIZE
+#else
+#define EVM_MEMORY_PAGE_SIZE 256
+#endif
+
+// Largest memory of one machine in bytes, rounded up to whole pages
+#ifdef EVM_CONF_MEMORY_SIZE
+#define EVM_MEMORY_SIZE_BYTES EVM_CONF_MEMORY_SIZE
+#else
+#define EVM_MEMORY_SIZE_BYTES 8192
+#endif
+
+// Pages in the pool, at most 255
+#ifdef EVM_CONF_MEMORY_POOL_PAGES
+#define EVM_MEMORY_POOL_PAGES EVM_CONF_MEMORY_POOL_PAGES
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_MEMORY_POOL_PAGES 8
+#else
+#define EVM_MEMORY_POOL_PAGES 32
+#endif
+
+#define EVM_MEMORY_PAGES ((EVM_MEMORY_SIZE_BYTES + EVM_MEMORY_PAGE_SIZE - 1) / EVM_MEMORY_PAGE_SIZE)
+#define EVM_MEMORY_SIZE (EVM_MEMORY_PAGES * EVM_MEMORY_PAGE_SIZE)
+
+typedef struct evm_memory {
+    // pool index + 1 of every page, 0 while the page is untouched, so
+    // that a zero-initialised evm_memory_t is empty
+    uint8_t page[EVM_MEMORY_PAGES];
+} evm_memory_t;
+
+void evm_memory_free(evm_memory_t *);
+void evm_memory_keep(evm_memory_t *, uint32_t, uint32_t);
+int evm_memory_write(evm_memory_t *, uint32_t, const uint8_t *, uint32_t);
+void evm_memory_read(const evm_memory_t *, uint32_t, uint8_t *, uint32_t);
+const uint8_t *evm_memory_span(const evm_memory_t *, uint32_t, uint32_t *);
+int evm_memory_copy(evm_memory_t *, uint32_t, const evm_memory_t *, uint32_t, uint32_t);
+int evm_memory_each(const evm_memory_t *, uint32_t, uint32_t, int (*)(void *, const uint8_t *, uint32_t), void *);
+uint32_t evm_memory_pages_used(const evm_memory_t *);
+
+#endif /* EVM_MEMORY_H */
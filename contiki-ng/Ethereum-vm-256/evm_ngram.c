@@ -0,0 +1,105 @@
+#include "evm_ngram.h"
+
+// Counts of the executed 2- to EVM_NGRAM_MAX-grams of opcodes, summed over
+// every contract run since the last reset. Sequences do not cross a block
+// boundary, as a superinstruction could not either.
+
+typedef struct ngram {
+    uint8_t length;     // 0 for a free slot
+    uint8_t op[EVM_NGRAM_MAX];
+    uint32_t count;
+} ngram_t;
+
+static ngram_t table[EVM_NGRAM_TABLE_SIZE];
+static uint32_t dropped;
+static uint8_t window[EVM_NGRAM_MAX];
+static uint8_t window_length;
+
+static uint32_t hash(const uint8_t *op, uint8_t length) {
+
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < length; i++) {
+        h = (h ^ op[i]) * 16777619u;
+    }
+    return h ^ length;
+}
+
+static void count(const uint8_t *op, uint8_t length) {
+
+    uint32_t slot = hash(op, length) % EVM_NGRAM_TABLE_SIZE;
+
+    for (int probe = 0; probe < EVM_NGRAM_TABLE_SIZE; probe++) {
+        ngram_t *entry = &table[slot];
+        if (entry->length == 0) {
+            entry->length = length;
+            memcpy(entry->op, op, length);
+            entry->count = 1;
+            return;
+        }
+        if (entry->length == length && memcmp(entry->op, op, length) == 0) {
+            entry->count++;
+            return;
+        }
+        slot = (slot + 1) % EVM_NGRAM_TABLE_SIZE;
+    }
+    dropped++;
+}
+
+void evm_ngram_reset(void) {
+    memset(table, 0, sizeof(table));
+    dropped = 0;
+    window_length = 0;
+}
+
+// Called with every opcode before it is executed
+void evm_ngram_record(uint8_t op_code) {
+
+    if (op_code == JUMPDEST) {
+        window_length = 0;
+    }
+    if (window_length == EVM_NGRAM_MAX) {
+        memmove(window, window + 1, EVM_NGRAM_MAX - 1);
+        window_length--;
+    }
+    window[window_length++] = op_code;
+
+    // every sequence ending with this opcode
+    for (int length = 2; length <= window_length; length++) {
+        count(window + window_length - length, length);
+    }
+
+    if (OPCODE_INFO[op_code].flags & OPCODE_ENDS_BLOCK) {
+        window_length = 0;
+    }
+}
+
+// Print the top most executed n-grams, weighted by the opcodes a fused
+// instruction would save: count * (length - 1)
+void evm_ngram_report(int top) {
+
+    static bool reported[EVM_NGRAM_TABLE_SIZE];
+
+    memset(reported, 0, sizeof(reported));
+    printf("Hottest opcode n-grams (dropped %lu):\n", (unsigned long)dropped);
+    for (int rank = 0; rank < top; rank++) {
+        int best = -1;
+        uint32_t best_score = 0;
+        for (int i = 0; i < EVM_NGRAM_TABLE_SIZE; i++) {
+            uint32_t score = table[i].count * (table[i].length - 1);
+            if (table[i].length != 0 && !reported[i] && score > best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        reported[best] = true;
+        printf("%8lu ", (unsigned long)table[best].count);
+        for (int i = 0; i < table[best].length; i++) {
+            printf(" %02X", table[best].op[i]);
+        }
+        printf("\n");
+    }
+}
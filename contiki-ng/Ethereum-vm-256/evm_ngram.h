@@ -0,0 +1,26 @@
+#ifndef EVM_NGRAM_H
+#define EVM_NGRAM_H
+#include "evm.h"
+
+// Longest opcode sequence counted
+#define EVM_NGRAM_MAX 5
+
+// Distinct n-grams kept, further ones are dropped
+#ifdef EVM_CONF_NGRAM_TABLE_SIZE
+#define EVM_NGRAM_TABLE_SIZE EVM_CONF_NGRAM_TABLE_SIZE
+#else
+#define EVM_NGRAM_TABLE_SIZE 256
+#endif
+
+// Number of n-grams printed by evm_ngram_report()
+#ifdef EVM_CONF_NGRAM_REPORT_TOP
+#define EVM_NGRAM_REPORT_TOP EVM_CONF_NGRAM_REPORT_TOP
+#else
+#define EVM_NGRAM_REPORT_TOP 10
+#endif
+
+void evm_ngram_reset(void);
+void evm_ngram_record(uint8_t);
+void evm_ngram_report(int);
+
+#endif /* EVM_NGRAM_H */
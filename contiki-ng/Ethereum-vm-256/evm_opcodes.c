@@ -0,0 +1,127 @@
+#include "evm.h"
+
+// Gas tiers of the yellow paper, same values as GAS_TABLE.stepGasN
+#define GAS_ZERO     0
+#define GAS_JUMPDEST 1
+#define GAS_BASE     2
+#define GAS_VERYLOW  3
+#define GAS_LOW      5
+#define GAS_MID      8
+#define GAS_HIGH     10
+#define GAS_EXT      20
+
+// Static information of every opcode, indexed by the opcode byte:
+// { static gas, immediate bytes, stack items read, stack items left }.
+// Dynamic costs (SHA3 words, copies, SSTORE, ...) are charged by the handlers.
+// Both interpreters check the stack against in and out before the handler
+// runs (see opcode_check() and evm_analysis.c), so the handlers of
+// decode_instruction() must take and leave exactly these numbers of items.
+const opcode_info_t OPCODE_INFO[256] = {
+    [STOP]          = { GAS_ZERO,    0, 0, 0, OPCODE_ENDS_BLOCK | OPCODE_TERMINAL },
+    [ADD]           = { GAS_VERYLOW, 0, 2, 1 },
+    [MUL]           = { GAS_LOW,     0, 2, 1 },
+    [SUB]           = { GAS_VERYLOW, 0, 2, 1 },
+    [DIV]           = { GAS_LOW,     0, 2, 1 },
+    [SDIV]          = { GAS_LOW,     0, 2, 1 },
+    [MOD]           = { GAS_LOW,     0, 2, 1 },
+    [SMOD]          = { GAS_LOW,     0, 2, 1 },
+    [ADDMOD]        = { GAS_MID,     0, 3, 1 },
+    [MULMOD]        = { GAS_MID,     0, 3, 1 },
+    [EXP]           = { GAS_HIGH,    0, 2, 1 },
+    [SIGNEXTEND]    = { GAS_LOW,     0, 2, 1 },
+
+    [SENSOR]        = { GAS_BASE,    0, 0, 0 },
+    [LED]           = { GAS_BASE,    0, 0, 0 },
+    [TEMPERATURE]   = { GAS_BASE,    0, 0, 1 },
+
+    [LT ... EQ]     = { GAS_VERYLOW, 0, 2, 1 },
+    [ISZERO]        = { GAS_VERYLOW, 0, 1, 1 },
+    [AND ... XOR]   = { GAS_VERYLOW, 0, 2, 1 },
+    [NOT]           = { GAS_VERYLOW, 0, 1, 1 },
+    [BYTE ... SAR]  = { GAS_VERYLOW, 0, 2, 1 },
+
+    [SHA3]          = { 30,          0, 2, 1 },
+
+    [ADDRESS]       = { GAS_BASE,    0, 0, 1 },
+    [BALANCE]       = { GAS_EXT,     0, 1, 1 },
+    [ORIGIN]        = { GAS_BASE,    0, 0, 1 },
+    [CALLER]        = { GAS_BASE,    0, 0, 1 },
+    [CALLVALUE]     = { GAS_BASE,    0, 0, 1 },
+    [CALLDATALOAD]  = { GAS_VERYLOW, 0, 1, 1 },
+    [CALLDATASIZE]  = { GAS_BASE,    0, 0, 1 },
+    [CALLDATACOPY]  = { GAS_VERYLOW, 0, 3, 0 },
+    [CODESIZE]      = { GAS_BASE,    0, 0, 1 },
+    [CODECOPY]      = { GAS_VERYLOW, 0, 3, 0 },
+    [GASPRICE]      = { GAS_BASE,    0, 0, 1 },
+    [EXTCODESIZE]   = { GAS_EXT,     0, 1, 1 },
+    [EXTCODECOPY]   = { GAS_EXT,     0, 4, 0 },
+    [RETURNDATASIZE] = { GAS_BASE,   0, 0, 1 },
+    [RETURNDATACOPY] = { GAS_VERYLOW, 0, 3, 0 },
+
+    [BLOCKHASH]     = { GAS_EXT,     0, 1, 1 },
+    [COINBASE ... GASLIMIT] = { GAS_BASE, 0, 0, 1 },
+
+    [POP]           = { GAS_BASE,    0, 1, 0 },
+    [MLOAD]         = { GAS_VERYLOW, 0, 1, 1 },
+    [MSTORE]        = { GAS_VERYLOW, 0, 2, 0 },
+    [MSTORE8]       = { GAS_VERYLOW, 0, 2, 0 },
+    [SLOAD]         = { 50,          0, 1, 1 },
+    [SSTORE]        = { GAS_ZERO,    0, 2, 0 },
+    [JUMP]          = { GAS_MID,     0, 1, 0, OPCODE_ENDS_BLOCK | OPCODE_TERMINAL },
+    [JUMPI]         = { GAS_HIGH,    0, 2, 0, OPCODE_ENDS_BLOCK },
+    [PC]            = { GAS_BASE,    0, 0, 1 },
+    [MSIZE]         = { GAS_BASE,    0, 0, 1 },
+    [GAS]           = { GAS_BASE,    0, 0, 1, OPCODE_ENDS_BLOCK },
+    [JUMPDEST]      = { GAS_JUMPDEST, 0, 0, 0 },
+
+    [PUSH1]  = { GAS_VERYLOW,  1, 0, 1 }, [PUSH2]  = { GAS_VERYLOW,  2, 0, 1 },
+    [PUSH3]  = { GAS_VERYLOW,  3, 0, 1 }, [PUSH4]  = { GAS_VERYLOW,  4, 0, 1 },
+    [PUSH5]  = { GAS_VERYLOW,  5, 0, 1 }, [PUSH6]  = { GAS_VERYLOW,  6, 0, 1 },
+    [PUSH7]  = { GAS_VERYLOW,  7, 0, 1 }, [PUSH8]  = { GAS_VERYLOW,  8, 0, 1 },
+    [PUSH9]  = { GAS_VERYLOW,  9, 0, 1 }, [PUSH10] = { GAS_VERYLOW, 10, 0, 1 },
+    [PUSH11] = { GAS_VERYLOW, 11, 0, 1 }, [PUSH12] = { GAS_VERYLOW, 12, 0, 1 },
+    [PUSH13] = { GAS_VERYLOW, 13, 0, 1 }, [PUSH14] = { GAS_VERYLOW, 14, 0, 1 },
+    [PUSH15] = { GAS_VERYLOW, 15, 0, 1 }, [PUSH16] = { GAS_VERYLOW, 16, 0, 1 },
+    [PUSH17] = { GAS_VERYLOW, 17, 0, 1 }, [PUSH18] = { GAS_VERYLOW, 18, 0, 1 },
+    [PUSH19] = { GAS_VERYLOW, 19, 0, 1 }, [PUSH20] = { GAS_VERYLOW, 20, 0, 1 },
+    [PUSH21] = { GAS_VERYLOW, 21, 0, 1 }, [PUSH22] = { GAS_VERYLOW, 22, 0, 1 },
+    [PUSH23] = { GAS_VERYLOW, 23, 0, 1 }, [PUSH24] = { GAS_VERYLOW, 24, 0, 1 },
+    [PUSH25] = { GAS_VERYLOW, 25, 0, 1 }, [PUSH26] = { GAS_VERYLOW, 26, 0, 1 },
+    [PUSH27] = { GAS_VERYLOW, 27, 0, 1 }, [PUSH28] = { GAS_VERYLOW, 28, 0, 1 },
+    [PUSH29] = { GAS_VERYLOW, 29, 0, 1 }, [PUSH30] = { GAS_VERYLOW, 30, 0, 1 },
+    [PUSH31] = { GAS_VERYLOW, 31, 0, 1 }, [PUSH32] = { GAS_VERYLOW, 32, 0, 1 },
+
+    [DUP1]  = { GAS_VERYLOW, 0,  1,  2 }, [DUP2]  = { GAS_VERYLOW, 0,  2,  3 },
+    [DUP3]  = { GAS_VERYLOW, 0,  3,  4 }, [DUP4]  = { GAS_VERYLOW, 0,  4,  5 },
+    [DUP5]  = { GAS_VERYLOW, 0,  5,  6 }, [DUP6]  = { GAS_VERYLOW, 0,  6,  7 },
+    [DUP7]  = { GAS_VERYLOW, 0,  7,  8 }, [DUP8]  = { GAS_VERYLOW, 0,  8,  9 },
+    [DUP9]  = { GAS_VERYLOW, 0,  9, 10 }, [DUP10] = { GAS_VERYLOW, 0, 10, 11 },
+    [DUP11] = { GAS_VERYLOW, 0, 11, 12 }, [DUP12] = { GAS_VERYLOW, 0, 12, 13 },
+    [DUP13] = { GAS_VERYLOW, 0, 13, 14 }, [DUP14] = { GAS_VERYLOW, 0, 14, 15 },
+    [DUP15] = { GAS_VERYLOW, 0, 15, 16 }, [DUP16] = { GAS_VERYLOW, 0, 16, 17 },
+
+    [SWAP1]  = { GAS_VERYLOW, 0,  2,  2 }, [SWAP2]  = { GAS_VERYLOW, 0,  3,  3 },
+    [SWAP3]  = { GAS_VERYLOW, 0,  4,  4 }, [SWAP4]  = { GAS_VERYLOW, 0,  5,  5 },
+    [SWAP5]  = { GAS_VERYLOW, 0,  6,  6 }, [SWAP6]  = { GAS_VERYLOW, 0,  7,  7 },
+    [SWAP7]  = { GAS_VERYLOW, 0,  8,  8 }, [SWAP8]  = { GAS_VERYLOW, 0,  9,  9 },
+    [SWAP9]  = { GAS_VERYLOW, 0, 10, 10 }, [SWAP10] = { GAS_VERYLOW, 0, 11, 11 },
+    [SWAP11] = { GAS_VERYLOW, 0, 12, 12 }, [SWAP12] = { GAS_VERYLOW, 0, 13, 13 },
+    [SWAP13] = { GAS_VERYLOW, 0, 14, 14 }, [SWAP14] = { GAS_VERYLOW, 0, 15, 15 },
+    [SWAP15] = { GAS_VERYLOW, 0, 16, 16 }, [SWAP16] = { GAS_VERYLOW, 0, 17, 17 },
+
+    [LOG0]          = { 375,         0, 2, 0 },
+    [LOG1]          = { 750,         0, 3, 0 },
+    [LOG2]          = { 1125,        0, 4, 0 },
+    [LOG3]          = { 1500,        0, 5, 0 },
+    [LOG4]          = { 1875,        0, 6, 0 },
+
+    [CREATE]        = { 32000,       0, 3, 1, OPCODE_ENDS_BLOCK },
+    [CALL]          = { 40,          0, 7, 1, OPCODE_ENDS_BLOCK },
+    [CALLCODE]      = { 40,          0, 7, 1, OPCODE_ENDS_BLOCK },
+    [RETURN]        = { GAS_ZERO,    0, 2, 0, OPCODE_ENDS_BLOCK | OPCODE_TERMINAL },
+    [DELEGATECALL]  = { 40,          0, 6, 1, OPCODE_ENDS_BLOCK },
+    [STATICCALL]    = { 40,          0, 6, 1, OPCODE_ENDS_BLOCK },
+    [REVERT]        = { GAS_ZERO,    0, 2, 0, OPCODE_ENDS_BLOCK | OPCODE_TERMINAL },
+    [INVALID]       = { GAS_ZERO,    0, 0, 0, OPCODE_ENDS_BLOCK | OPCODE_TERMINAL },
+    [SELFDESTRUCT]  = { GAS_ZERO,    0, 1, 0, OPCODE_ENDS_BLOCK | OPCODE_TERMINAL },
+};
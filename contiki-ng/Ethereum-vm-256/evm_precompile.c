@@ -0,0 +1,127 @@
+#include "evm_precompile.h"
+#include "evm_ripemd160.h"
+#include "evm_secp256k1.h"
+#include "evm_sha256.h"
+
+// The input at offset, cut or padded with zeros to size bytes
+static void read_input(const evm_memory_t *memory, uint32_t offset, uint32_t length, uint8_t *input, uint32_t size) {
+    memset(input, 0, size);
+    evm_memory_read(memory, offset, input, length < size ? length : size);
+}
+
+static uint32_t ecrecover_gas(uint32_t length) {
+    (void)length;
+    return 3000;
+}
+
+// The input is the hash, v, r and s, a word each. The output is the
+// address of the signer as a word, none if the signature is not valid.
+static int32_t ecrecover_run(const evm_memory_t *memory, uint32_t offset, uint32_t length, evm_memory_t *out) {
+
+    uint8_t input[128];
+    uint8_t public_key[64];
+    uint8_t address[32];
+
+    read_input(memory, offset, length, input, sizeof(input));
+    // v is 27 or 28 over the whole word
+    for (int i = 32; i < 63; i++) {
+        if (input[i] != 0) {
+            return 0;
+        }
+    }
+    if ((input[63] != 27 && input[63] != 28) ||
+        evm_secp256k1_recover(input, &input[64], &input[96], input[63] - 27, public_key) < 0) {
+        return 0;
+    }
+    get_keccak256(public_key, sizeof(public_key), address);
+    memset(address, 0, 12);
+    if (evm_memory_write(out, 0, address, sizeof(address)) < 0) {
+        return -1;
+    }
+    return sizeof(address);
+}
+
+static int sha256_update(void *hash, const uint8_t *data, uint32_t length) {
+    return evm_sha256_update(hash, data, length);
+}
+
+static int ripemd160_update(void *hash, const uint8_t *data, uint32_t length) {
+    evm_ripemd160_update(hash, data, length);
+    return 0;
+}
+
+static uint32_t words(uint32_t length) {
+    return (length + 31) / 32;
+}
+
+static uint32_t sha256_gas(uint32_t length) {
+    return 60 + 12 * words(length);
+}
+
+static int32_t sha256_run(const evm_memory_t *memory, uint32_t offset, uint32_t length, evm_memory_t *out) {
+
+    evm_sha256_t sha;
+    uint8_t digest[32];
+
+    evm_sha256_init(&sha, 1);
+    if (evm_memory_each(memory, offset, length, sha256_update, &sha) < 0 || evm_sha256_final(&sha, digest) < 0) {
+        // the engine was busy, e.g. with the radio
+        evm_sha256_init(&sha, 0);
+        evm_memory_each(memory, offset, length, sha256_update, &sha);
+        evm_sha256_final(&sha, digest);
+    }
+    if (evm_memory_write(out, 0, digest, sizeof(digest)) < 0) {
+        return -1;
+    }
+    return sizeof(digest);
+}
+
+static uint32_t ripemd160_gas(uint32_t length) {
+    return 600 + 120 * words(length);
+}
+
+// The digest right-aligned in a word
+static int32_t ripemd160_run(const evm_memory_t *memory, uint32_t offset, uint32_t length, evm_memory_t *out) {
+
+    evm_ripemd160_t ripemd;
+    uint8_t digest[32] = {0};
+
+    evm_ripemd160_init(&ripemd);
+    evm_memory_each(memory, offset, length, ripemd160_update, &ripemd);
+    evm_ripemd160_final(&ripemd, &digest[12]);
+    if (evm_memory_write(out, 0, digest, sizeof(digest)) < 0) {
+        return -1;
+    }
+    return sizeof(digest);
+}
+
+static uint32_t identity_gas(uint32_t length) {
+    return 15 + 3 * words(length);
+}
+
+// The input, moved from page to page without a buffer in between
+static int32_t identity_run(const evm_memory_t *memory, uint32_t offset, uint32_t length, evm_memory_t *out) {
+    if (evm_memory_copy(out, 0, memory, offset, length) < 0) {
+        return -1;
+    }
+    return length;
+}
+
+static const evm_precompile_t PRECOMPILES[] = {
+    [1] = { ecrecover_gas, ecrecover_run },
+    [2] = { sha256_gas, sha256_run },
+    [3] = { ripemd160_gas, ripemd160_run },
+    [4] = { identity_gas, identity_run },
+};
+
+const evm_precompile_t *evm_precompile_find(const uint256_t *address) {
+
+    uint256_t *item = (uint256_t *)address;
+
+    if (!zero128(&UPPER_P(item)) || UPPER(LOWER_P(item)) != 0 ||
+        LOWER(LOWER_P(item)) >= sizeof(PRECOMPILES) / sizeof(PRECOMPILES[0]) ||
+        PRECOMPILES[LOWER(LOWER_P(item))].run == NULL) {
+        return NULL;
+    }
+    return &PRECOMPILES[LOWER(LOWER_P(item))];
+}
@@ -0,0 +1,25 @@
+#ifndef EVM_PRECOMPILE_H
+#define EVM_PRECOMPILE_H
+#include "evm.h"
+
+// Contracts at low addresses that run natively instead of from code:
+//   0x01 ECRECOVER, see evm_secp256k1.h
+//   0x02 SHA256, see evm_sha256.h
+//   0x03 RIPEMD160
+//   0x04 IDENTITY
+// A call to one charges its gas, reads the call data from the caller's
+// memory and leaves the output in pages of its own, which become the
+// caller's return data.
+
+typedef struct evm_precompile {
+    // gas for a call with length bytes of input
+    uint32_t (*gas)(uint32_t length);
+    // writes the output for the input at offset in memory to out from 0
+    // on, returns the length of the output, -1 if the call fails
+    int32_t (*run)(const evm_memory_t *memory, uint32_t offset, uint32_t length, evm_memory_t *out);
+} evm_precompile_t;
+
+// The precompile at address, NULL if there is none
+const evm_precompile_t *evm_precompile_find(const uint256_t *address);
+
+#endif /* EVM_PRECOMPILE_H */
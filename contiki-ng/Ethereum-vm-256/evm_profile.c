@@ -0,0 +1,162 @@
+#include "evm_profile.h"
+#if EVM_PROFILE_CLOCK == EVM_PROFILE_CLOCK_CYCLES
+#include "dev/sys-ctrl.h"
+#endif
+
+// Instructions are timed from just before to just after
+// decode_instruction(), so a CALL or CREATE includes the instructions of
+// its callee, which are also counted on their own. The time the
+// interpreter loop spends between instructions (gas, dispatch) is the
+// total time of the runs less the time of all opcodes.
+// PCs of different contracts share the table: reset between contracts to
+// profile them apart.
+
+typedef struct profile_entry {
+    uint32_t count;
+    uint64_t time;
+} profile_entry_t;
+
+static profile_entry_t opcodes[256];
+static profile_entry_t pcs[EVM_PROFILE_PCS];
+static uint32_t runs;
+static uint64_t total_time;
+
+void evm_profile_reset(void) {
+    memset(opcodes, 0, sizeof(opcodes));
+    memset(pcs, 0, sizeof(pcs));
+    runs = 0;
+    total_time = 0;
+}
+
+// Start timing a slice of a call, run by execute_contract_step(). Enables
+// the cycle counter, whichever way the app runs its calls.
+uint32_t evm_profile_begin(void) {
+#if EVM_PROFILE_CLOCK == EVM_PROFILE_CLOCK_CYCLES
+    // the counter only runs with tracing enabled
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    return evm_profile_now();
+}
+
+// A call run in slices counts as one run, its time is that of its slices
+void evm_profile_end(uint32_t start, bool finished) {
+    total_time += (uint32_t)(evm_profile_now() - start);
+    if (finished) {
+        runs++;
+    }
+}
+
+// Called after every instruction with its opcode, PC and time
+void evm_profile_record(uint8_t op_code, uint32_t pc, uint32_t time) {
+    opcodes[op_code].count++;
+    opcodes[op_code].time += time;
+    if (pc < EVM_PROFILE_PCS) {
+        pcs[pc].count++;
+        pcs[pc].time += time;
+    }
+}
+
+// Print the top opcodes that took the most time
+void evm_profile_report(int top) {
+
+    static bool reported[256];
+    uint64_t opcode_time = 0;
+
+    memset(reported, 0, sizeof(reported));
+    for (int i = 0; i < 256; i++) {
+        opcode_time += opcodes[i].time;
+    }
+    printf("Profile of %lu runs, clock %u: total %llu, outside opcodes %llu\n",
+        (unsigned long)runs, EVM_PROFILE_CLOCK, (unsigned long long)total_time,
+        (unsigned long long)(total_time > opcode_time ? total_time - opcode_time : 0));
+    for (int rank = 0; rank < top; rank++) {
+        int best = -1;
+        for (int i = 0; i < 256; i++) {
+            if (opcodes[i].count != 0 && !reported[i] &&
+                (best < 0 || opcodes[i].time > opcodes[best].time)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        reported[best] = true;
+        printf("%02X %8lu %10llu\n", best, (unsigned long)opcodes[best].count,
+            (unsigned long long)opcodes[best].time);
+    }
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        *p++ = value >> (8 * i);
+    }
+    return p;
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t value) {
+    p = put32(p, (uint32_t)value);
+    return put32(p, (uint32_t)(value >> 32));
+}
+
+// Pass the profile to sink, a piece at a time, as a blob of little-endian
+// fields:
+//   "EVMP", version 1, clock, 2 bytes zero, clock rate in Hz (0 unknown),
+//   runs, total time (8 bytes), opcode entries, PC entries
+//   then the entries that ran at least once, 16 bytes each:
+//   opcode or PC (4 bytes), count (4 bytes), time (8 bytes)
+// Returns the size of the blob, -1 if sink failed.
+int evm_profile_export(int (*sink)(const uint8_t *, uint32_t, uint32_t)) {
+
+    uint8_t record[32];
+    uint8_t *p = record;
+    uint32_t offset = 0;
+    uint32_t used_opcodes = 0;
+    uint32_t used_pcs = 0;
+    uint32_t rate;
+
+#if EVM_PROFILE_CLOCK == EVM_PROFILE_CLOCK_CYCLES
+    rate = SYS_CTRL_SYS_CLOCK;
+#elif EVM_PROFILE_CLOCK == EVM_PROFILE_CLOCK_RTIMER
+    rate = RTIMER_SECOND;
+#else
+    rate = 1000000000;
+#endif
+    for (int i = 0; i < 256; i++) {
+        used_opcodes += opcodes[i].count != 0;
+    }
+    for (int i = 0; i < EVM_PROFILE_PCS; i++) {
+        used_pcs += pcs[i].count != 0;
+    }
+
+    memcpy(p, "EVMP", 4);
+    p += 4;
+    *p++ = 1;
+    *p++ = EVM_PROFILE_CLOCK;
+    *p++ = 0;
+    *p++ = 0;
+    p = put32(p, rate);
+    p = put32(p, runs);
+    p = put64(p, total_time);
+    p = put32(p, used_opcodes);
+    p = put32(p, used_pcs);
+    if (sink(record, offset, p - record) < 0) {
+        return -1;
+    }
+    offset += p - record;
+
+    for (int i = 0; i < 256 + EVM_PROFILE_PCS; i++) {
+        const profile_entry_t *entry = i < 256 ? &opcodes[i] : &pcs[i - 256];
+        if (entry->count == 0) {
+            continue;
+        }
+        p = put32(record, i < 256 ? i : i - 256);
+        p = put32(p, entry->count);
+        p = put64(p, entry->time);
+        if (sink(record, offset, p - record) < 0) {
+            return -1;
+        }
+        offset += p - record;
+    }
+    return offset;
+}
@@ -0,0 +1,64 @@
+#ifndef EVM_PROFILE_H
+#define EVM_PROFILE_H
+#include "evm.h"
+
+// Execution count and time of every opcode and of every PC, summed over
+// the contracts run since the last evm_profile_reset(). Time is read from
+// the DWT cycle counter of the Cortex-M3 (cc2538), else from the rtimer
+// under Contiki, else from clock_gettime(); evm_profile_export() records
+// which clock it was and its rate.
+// Profiling runs every contract on the plain interpreter, execute_bytecode(),
+// as it is the one that steps an opcode at a time: the figures are those of
+// its switch dispatch, not of the threaded or translated code.
+#ifdef CMSIS_DEV_HDR
+#include CMSIS_DEV_HDR
+#define EVM_PROFILE_CLOCK EVM_PROFILE_CLOCK_CYCLES
+#elif defined(CONTIKI)
+#include "contiki.h"
+#define EVM_PROFILE_CLOCK EVM_PROFILE_CLOCK_RTIMER
+#else
+#include <time.h>
+#define EVM_PROFILE_CLOCK EVM_PROFILE_CLOCK_NS
+#endif
+
+#define EVM_PROFILE_CLOCK_CYCLES 1
+#define EVM_PROFILE_CLOCK_RTIMER 2
+#define EVM_PROFILE_CLOCK_NS 3
+
+// PCs profiled one by one, instructions at higher PCs are only counted
+// per opcode. Every PC takes 16 bytes.
+#ifdef EVM_CONF_PROFILE_PCS
+#define EVM_PROFILE_PCS EVM_CONF_PROFILE_PCS
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_PROFILE_PCS 128
+#else
+#define EVM_PROFILE_PCS 1024
+#endif
+
+// Number of opcodes printed by evm_profile_report()
+#ifdef EVM_CONF_PROFILE_REPORT_TOP
+#define EVM_PROFILE_REPORT_TOP EVM_CONF_PROFILE_REPORT_TOP
+#else
+#define EVM_PROFILE_REPORT_TOP 10
+#endif
+
+static inline uint32_t evm_profile_now(void) {
+#if EVM_PROFILE_CLOCK == EVM_PROFILE_CLOCK_CYCLES
+    return DWT->CYCCNT;
+#elif EVM_PROFILE_CLOCK == EVM_PROFILE_CLOCK_RTIMER
+    return RTIMER_NOW();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+void evm_profile_reset(void);
+uint32_t evm_profile_begin(void);
+void evm_profile_end(uint32_t, bool);
+void evm_profile_record(uint8_t, uint32_t, uint32_t);
+void evm_profile_report(int);
+int evm_profile_export(int (*)(const uint8_t *, uint32_t, uint32_t));
+
+#endif /* EVM_PROFILE_H */
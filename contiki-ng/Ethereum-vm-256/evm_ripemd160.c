@@ -0,0 +1,136 @@
+#include <string.h>
+#include "evm_ripemd160.h"
+
+// message word and rotation of every step, left line then right line
+static const uint8_t R_LEFT[80] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+    3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+    1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+    4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13,
+};
+static const uint8_t R_RIGHT[80] = {
+    5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+    6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+    15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+    8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+    12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11,
+};
+static const uint8_t S_LEFT[80] = {
+    11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+    7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+    11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+    11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+    9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6,
+};
+static const uint8_t S_RIGHT[80] = {
+    8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+    9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+    9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+    15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+    8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11,
+};
+static const uint32_t K_LEFT[5] = { 0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E };
+static const uint32_t K_RIGHT[5] = { 0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0x00000000 };
+
+#define ROTL(x, n) ((x) << (n) | (x) >> (32 - (n)))
+
+// the boolean function of round j, 0 to 4
+static uint32_t f(int j, uint32_t x, uint32_t y, uint32_t z) {
+    switch (j) {
+        case 0: return x ^ y ^ z;
+        case 1: return (x & y) | (~x & z);
+        case 2: return (x | ~y) ^ z;
+        case 3: return (x & z) | (y & ~z);
+        default: return x ^ (y | ~z);
+    }
+}
+
+static void compress(uint32_t *state, const uint8_t *block) {
+
+    uint32_t x[16];
+    uint32_t al = state[0], bl = state[1], cl = state[2], dl = state[3], el = state[4];
+    uint32_t ar = al, br = bl, cr = cl, dr = dl, er = el;
+    uint32_t t;
+
+    for (int i = 0; i < 16; i++) {
+        x[i] = (uint32_t)block[4 * i] | (uint32_t)block[4 * i + 1] << 8 |
+               (uint32_t)block[4 * i + 2] << 16 | (uint32_t)block[4 * i + 3] << 24;
+    }
+    for (int i = 0; i < 80; i++) {
+        int j = i / 16;
+        t = al + f(j, bl, cl, dl) + x[R_LEFT[i]] + K_LEFT[j];
+        t = ROTL(t, S_LEFT[i]) + el;
+        al = el;
+        el = dl;
+        dl = ROTL(cl, 10);
+        cl = bl;
+        bl = t;
+        t = ar + f(4 - j, br, cr, dr) + x[R_RIGHT[i]] + K_RIGHT[j];
+        t = ROTL(t, S_RIGHT[i]) + er;
+        ar = er;
+        er = dr;
+        dr = ROTL(cr, 10);
+        cr = br;
+        br = t;
+    }
+    t = state[1] + cl + dr;
+    state[1] = state[2] + dl + er;
+    state[2] = state[3] + el + ar;
+    state[3] = state[4] + al + br;
+    state[4] = state[0] + bl + cr;
+    state[0] = t;
+}
+
+void evm_ripemd160_init(evm_ripemd160_t *ripemd) {
+
+    static const uint32_t initial[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    memcpy(ripemd->state, initial, sizeof(initial));
+    ripemd->length = 0;
+}
+
+void evm_ripemd160_update(evm_ripemd160_t *ripemd, const uint8_t *data, uint32_t length) {
+
+    while (length > 0) {
+        uint32_t used = ripemd->length % 64;
+        uint32_t chunk = 64 - used < length ? 64 - used : length;
+        if (used == 0 && chunk == 64) {
+            compress(ripemd->state, data);
+        }
+        else {
+            memcpy(&ripemd->block[used], data, chunk);
+            if (used + chunk == 64) {
+                compress(ripemd->state, ripemd->block);
+            }
+        }
+        ripemd->length += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void evm_ripemd160_final(evm_ripemd160_t *ripemd, uint8_t *digest) {
+
+    uint64_t bits = ripemd->length * 8;
+    uint32_t used = ripemd->length % 64;
+
+    // as SHA-256 but with the length and the words little-endian
+    ripemd->block[used++] = 0x80;
+    if (used > 56) {
+        memset(&ripemd->block[used], 0, 64 - used);
+        compress(ripemd->state, ripemd->block);
+        used = 0;
+    }
+    memset(&ripemd->block[used], 0, 56 - used);
+    for (int i = 0; i < 8; i++) {
+        ripemd->block[56 + i] = bits >> (8 * i);
+    }
+    compress(ripemd->state, ripemd->block);
+    for (int i = 0; i < 5; i++) {
+        digest[4 * i] = ripemd->state[i];
+        digest[4 * i + 1] = ripemd->state[i] >> 8;
+        digest[4 * i + 2] = ripemd->state[i] >> 16;
+        digest[4 * i + 3] = ripemd->state[i] >> 24;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef EVM_RIPEMD160_H
+#define EVM_RIPEMD160_H
+#include <stdint.h>
+
+// RIPEMD-160 for the RIPEMD160 precompile
+
+typedef struct evm_ripemd160 {
+    uint32_t state[5];
+    uint64_t length;            // bytes hashed
+    uint8_t block[64];
+} evm_ripemd160_t;
+
+void evm_ripemd160_init(evm_ripemd160_t *);
+void evm_ripemd160_update(evm_ripemd160_t *, const uint8_t *, uint32_t);
+// the 20-byte digest
+void evm_ripemd160_final(evm_ripemd160_t *, uint8_t *);
+
+#endif /* EVM_RIPEMD160_H */
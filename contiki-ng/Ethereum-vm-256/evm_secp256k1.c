@@ -0,0 +1,375 @@
+#include <string.h>
+#include "evm_secp256k1.h"
+#if EVM_SECP256K1_PKA
+#include <stdio.h>
+#include "contiki.h"
+#include "dev/ecc-algorithm.h"
+#include "dev/ecc-curve.h"
+#include "dev/pka.h"
+#endif
+
+// A number mod p or mod n in little-endian 32-bit limbs, the word order
+// of the cc2538 curve tables
+typedef uint32_t fe_t[8];
+
+// A modulus m with R^2 mod m and -1/m mod 2^32, for Montgomery
+// multiplication with R = 2^256
+typedef struct modulus {
+    fe_t m;
+    fe_t r2;
+    uint32_t inv;
+} modulus_t;
+
+// Projective point (X : Y : Z) of y^2 = x^3 + 7, the coordinates in
+// Montgomery form. Z = 0 is the point at infinity.
+typedef struct point {
+    fe_t x;
+    fe_t y;
+    fe_t z;
+} point_t;
+
+static const modulus_t P = {
+    .m = { 0xFFFFFC2F, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF },
+    .r2 = { 0x000E90A1, 0x000007A2, 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000 },
+    .inv = 0xD2253531,
+};
+
+static const modulus_t N = {
+    .m = { 0xD0364141, 0xBFD25E8C, 0xAF48A03B, 0xBAAEDCE6, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF },
+    .r2 = { 0x67D7D140, 0x896CF214, 0x0E7CF878, 0x741496C2, 0x5BCD07C6, 0xE697F5E4, 0x81C69BC5, 0x9D671CD5 },
+    .inv = 0x5588B13F,
+};
+
+static const fe_t ZERO = { 0 };
+static const fe_t ONE = { 1 };
+// 1, 7 and 3 * 7 mod p in Montgomery form
+static const fe_t P_ONE = { 0x000003D1, 0x00000001 };
+static const fe_t P_B = { 0x00001AB7, 0x00000007 };
+static const fe_t P_B3 = { 0x00005025, 0x00000015 };
+// exponents for inversion mod p and mod n, and (p + 1) / 4 for the root
+static const fe_t P_MINUS_2 = { 0xFFFFFC2D, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+static const fe_t N_MINUS_2 = { 0xD036413F, 0xBFD25E8C, 0xAF48A03B, 0xBAAEDCE6, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+static const fe_t P_SQRT = { 0xBFFFFF0C, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x3FFFFFFF };
+// the generator, affine
+static const fe_t G_X = { 0x16F81798, 0x59F2815B, 0x2DCE28D9, 0x029BFCDB, 0xCE870B07, 0x55A06295, 0xF9DCBBAC, 0x79BE667E };
+static const fe_t G_Y = { 0xFB10D4B8, 0x9C47D08F, 0xA6855419, 0xFD17B448, 0x0E1108A8, 0x5DA4FBFC, 0x26A3C465, 0x483ADA77 };
+
+static void fe_read(fe_t r, const uint8_t *bytes) {
+    for (int i = 0; i < 8; i++) {
+        const uint8_t *word = &bytes[28 - 4 * i];
+        r[i] = (uint32_t)word[0] << 24 | (uint32_t)word[1] << 16 | (uint32_t)word[2] << 8 | word[3];
+    }
+}
+
+static void fe_write(const fe_t a, uint8_t *bytes) {
+    for (int i = 0; i < 8; i++) {
+        uint8_t *word = &bytes[28 - 4 * i];
+        word[0] = a[i] >> 24;
+        word[1] = a[i] >> 16;
+        word[2] = a[i] >> 8;
+        word[3] = a[i];
+    }
+}
+
+// r = a + b, the carry out
+static uint32_t fe_add(fe_t r, const fe_t a, const fe_t b) {
+    uint64_t carry = 0;
+    for (int i = 0; i < 8; i++) {
+        carry += (uint64_t)a[i] + b[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return (uint32_t)carry;
+}
+
+// r = a - b, the borrow out
+static uint32_t fe_sub(fe_t r, const fe_t a, const fe_t b) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t difference = (uint64_t)a[i] - b[i] - borrow;
+        r[i] = (uint32_t)difference;
+        borrow = difference >> 63;
+    }
+    return (uint32_t)borrow;
+}
+
+// r = a where mask is all ones, r is kept where it is zero
+static void fe_select(fe_t r, const fe_t a, uint32_t mask) {
+    for (int i = 0; i < 8; i++) {
+        r[i] ^= (r[i] ^ a[i]) & mask;
+    }
+}
+
+static uint32_t fe_is_zero(const fe_t a) {
+    uint32_t bits = 0;
+    for (int i = 0; i < 8; i++) {
+        bits |= a[i];
+    }
+    return bits == 0;
+}
+
+static uint32_t fe_equal(const fe_t a, const fe_t b) {
+    uint32_t bits = 0;
+    for (int i = 0; i < 8; i++) {
+        bits |= a[i] ^ b[i];
+    }
+    return bits == 0;
+}
+
+// r = a + b mod m, for a and b below m
+static void mod_add(fe_t r, const fe_t a, const fe_t b, const modulus_t *mod) {
+    fe_t reduced;
+    uint32_t carry = fe_add(r, a, b);
+    uint32_t borrow = fe_sub(reduced, r, mod->m);
+    fe_select(r, reduced, -(carry | (borrow ^ 1)));
+}
+
+// r = a - b mod m, for a and b below m
+static void mod_sub(fe_t r, const fe_t a, const fe_t b, const modulus_t *mod) {
+    fe_t wrapped;
+    uint32_t borrow = fe_sub(r, a, b);
+    fe_add(wrapped, r, mod->m);
+    fe_select(r, wrapped, -borrow);
+}
+
+// r = a * b / R mod m (CIOS), for a and b below m
+static void mont_mul(fe_t r, const fe_t a, const fe_t b, const modulus_t *mod) {
+
+    uint32_t t[10] = { 0 };
+    fe_t reduced;
+
+    for (int i = 0; i < 8; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < 8; j++) {
+            carry += (uint64_t)a[j] * b[i] + t[j];
+            t[j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        carry += t[8];
+        t[8] = (uint32_t)carry;
+        t[9] = (uint32_t)(carry >> 32);
+
+        uint32_t q = t[0] * mod->inv;
+        carry = ((uint64_t)q * mod->m[0] + t[0]) >> 32;
+        for (int j = 1; j < 8; j++) {
+            carry += (uint64_t)q * mod->m[j] + t[j];
+            t[j - 1] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        carry += t[8];
+        t[7] = (uint32_t)carry;
+        t[8] = t[9] + (uint32_t)(carry >> 32);
+    }
+    // t is below 2m
+    uint32_t borrow = fe_sub(reduced, t, mod->m);
+    memcpy(r, t, sizeof(fe_t));
+    fe_select(r, reduced, -(t[8] | (borrow ^ 1)));
+}
+
+// r = a^e in Montgomery form. The exponents are public constants.
+static void mod_pow(fe_t r, const fe_t a, const fe_t e, const modulus_t *mod) {
+
+    fe_t base;
+    fe_t result;
+
+    memcpy(base, a, sizeof(fe_t));
+    mont_mul(result, ONE, mod->r2, mod);
+    for (int i = 255; i >= 0; i--) {
+        mont_mul(result, result, result, mod);
+        if ((e[i / 32] >> (i % 32)) & 1) {
+            mont_mul(result, result, base, mod);
+        }
+    }
+    memcpy(r, result, sizeof(fe_t));
+}
+
+// r = a + b with the complete formulas for a = 0 of Renes, Costello and
+// Batina (2016), which also hold for a = b and for the point at infinity
+static void point_add(point_t *r, const point_t *a, const point_t *b) {
+
+    fe_t t0, t1, t2, t3, t4, t5, u, v;
+    point_t sum;
+
+    mont_mul(t0, a->x, b->x, &P);
+    mont_mul(t1, a->y, b->y, &P);
+    mont_mul(t2, a->z, b->z, &P);
+
+    mod_add(u, a->x, a->y, &P);
+    mod_add(v, b->x, b->y, &P);
+    mont_mul(t3, u, v, &P);
+    mod_add(u, t0, t1, &P);
+    mod_sub(t3, t3, u, &P);
+
+    mod_add(u, a->x, a->z, &P);
+    mod_add(v, b->x, b->z, &P);
+    mont_mul(t4, u, v, &P);
+    mod_add(u, t0, t2, &P);
+    mod_sub(t4, t4, u, &P);
+
+    mod_add(u, a->y, a->z, &P);
+    mod_add(v, b->y, b->z, &P);
+    mont_mul(t5, u, v, &P);
+    mod_add(u, t1, t2, &P);
+    mod_sub(t5, t5, u, &P);
+
+    mont_mul(sum.z, P_B3, t2, &P);
+    mod_sub(sum.x, t1, sum.z, &P);
+    mod_add(sum.z, t1, sum.z, &P);
+    mont_mul(sum.y, sum.x, sum.z, &P);
+    mod_add(t1, t0, t0, &P);
+    mod_add(t1, t1, t0, &P);
+    mont_mul(t4, P_B3, t4, &P);
+
+    mont_mul(u, t1, t4, &P);
+    mod_add(sum.y, sum.y, u, &P);
+    mont_mul(u, t5, t4, &P);
+    mont_mul(sum.x, t3, sum.x, &P);
+    mod_sub(sum.x, sum.x, u, &P);
+    mont_mul(u, t3, t1, &P);
+    mont_mul(sum.z, t5, sum.z, &P);
+    mod_add(sum.z, sum.z, u, &P);
+    *r = sum;
+}
+
+// Swap a and b where mask is all ones
+static void point_swap(point_t *a, point_t *b, uint32_t mask) {
+    uint32_t *x = (uint32_t *)a;
+    uint32_t *y = (uint32_t *)b;
+    for (size_t i = 0; i < sizeof(point_t) / sizeof(uint32_t); i++) {
+        uint32_t bits = (x[i] ^ y[i]) & mask;
+        x[i] ^= bits;
+        y[i] ^= bits;
+    }
+}
+
+// r = k * a by a Montgomery ladder, the same operations for every k
+static void point_mul(point_t *r, const point_t *a, const fe_t k) {
+
+    point_t r0;
+    point_t r1 = *a;
+
+    // the point at infinity (0 : 1 : 0)
+    memset(&r0, 0, sizeof(r0));
+    memcpy(r0.y, P_ONE, sizeof(fe_t));
+
+    for (int i = 255; i >= 0; i--) {
+        uint32_t mask = -((k[i / 32] >> (i % 32)) & 1);
+        point_swap(&r0, &r1, mask);
+        point_add(&r1, &r0, &r1);
+        point_add(&r0, &r0, &r0);
+        point_swap(&r0, &r1, mask);
+    }
+    *r = r0;
+}
+
+// The point of the affine x and y, which are not in Montgomery form
+static void point_set(point_t *r, const fe_t x, const fe_t y) {
+    mont_mul(r->x, x, P.r2, &P);
+    mont_mul(r->y, y, P.r2, &P);
+    memcpy(r->z, P_ONE, sizeof(fe_t));
+}
+
+#if EVM_SECP256K1_PKA
+// r = k * (x, y) on the PKA engine, -1 if it fails. The engine computes
+// on its own while ecc_multiply() waits for it, which is polled here until
+// the product is ready.
+static int pka_point_mul(point_t *r, const fe_t x, const fe_t y, const fe_t k) {
+
+    static ecc_multiply_state_t state;
+    static uint8_t enabled;
+
+    if (fe_is_zero(k)) {
+        // the engine has no point at infinity
+        return -1;
+    }
+    if (!enabled) {
+        pka_init();
+        enabled = 1;
+    }
+    memset(&state, 0, sizeof(state));
+    state.curve_info = &secp256k1;
+    memcpy(state.point_in.x, x, sizeof(fe_t));
+    memcpy(state.point_in.y, y, sizeof(fe_t));
+    memcpy(state.secret, k, sizeof(fe_t));
+    PT_INIT(&state.pt);
+    while (PT_SCHEDULE(ecc_multiply(&state))) {
+    }
+    if (state.result != PKA_STATUS_SUCCESS) {
+        printf("ECRECOVER: PKA error %u, in software\n", state.result);
+        return -1;
+    }
+    point_set(r, state.point_out.x, state.point_out.y);
+    return 0;
+}
+#endif
+
+int evm_secp256k1_recover(const uint8_t *hash, const uint8_t *r, const uint8_t *s, uint8_t recovery_id, uint8_t *public_key) {
+
+    fe_t sig_r, sig_s, e;
+    fe_t x, y, alpha, t;
+    point_t point_r, point_g, q1, q2;
+
+    fe_read(sig_r, r);
+    fe_read(sig_s, s);
+    if (recovery_id > 1 || fe_is_zero(sig_r) || fe_is_zero(sig_s) ||
+        !fe_sub(t, sig_r, N.m) || !fe_sub(t, sig_s, N.m)) {
+        return -1;
+    }
+
+    // R = (r, y) with y^2 = r^3 + 7 and the parity of the recovery id; r is
+    // below n and so below p
+    mont_mul(x, sig_r, P.r2, &P);
+    mont_mul(alpha, x, x, &P);
+    mont_mul(alpha, alpha, x, &P);
+    mod_add(alpha, alpha, P_B, &P);
+    mod_pow(y, alpha, P_SQRT, &P);
+    mont_mul(t, y, y, &P);
+    if (!fe_equal(t, alpha)) {
+        return -1;
+    }
+    mont_mul(y, y, ONE, &P);
+    if ((y[0] & 1) != recovery_id) {
+        mod_sub(y, ZERO, y, &P);
+    }
+
+    // Q = u1 * G + u2 * R with u1 = -e / r and u2 = s / r mod n. A product
+    // with one factor in Montgomery form is not.
+    fe_read(e, hash);
+    // the hash is below 2n
+    fe_select(e, t, -(fe_sub(t, e, N.m) ^ 1));
+    mont_mul(t, sig_r, N.r2, &N);
+    mod_pow(t, t, N_MINUS_2, &N);
+    mont_mul(e, e, t, &N);
+    mod_sub(e, ZERO, e, &N);
+    mont_mul(sig_s, sig_s, t, &N);
+
+#if EVM_SECP256K1_PKA
+    if (pka_point_mul(&q1, G_X, G_Y, e) < 0) {
+        point_set(&point_g, G_X, G_Y);
+        point_mul(&q1, &point_g, e);
+    }
+    if (pka_point_mul(&q2, sig_r, y, sig_s) < 0) {
+        point_set(&point_r, sig_r, y);
+        point_mul(&q2, &point_r, sig_s);
+    }
+#else
+    point_set(&point_g, G_X, G_Y);
+    point_mul(&q1, &point_g, e);
+    point_set(&point_r, sig_r, y);
+    point_mul(&q2, &point_r, sig_s);
+#endif
+    point_add(&q1, &q1, &q2);
+    if (fe_is_zero(q1.z)) {
+        return -1;
+    }
+
+    // back to affine coordinates, out of Montgomery form
+    mod_pow(t, q1.z, P_MINUS_2, &P);
+    mont_mul(x, q1.x, t, &P);
+    mont_mul(y, q1.y, t, &P);
+    mont_mul(x, x, ONE, &P);
+    mont_mul(y, y, ONE, &P);
+    fe_write(x, public_key);
+    fe_write(y, &public_key[32]);
+    return 0;
+}
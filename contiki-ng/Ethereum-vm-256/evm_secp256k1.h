@@ -0,0 +1,26 @@
+#ifndef EVM_SECP256K1_H
+#define EVM_SECP256K1_H
+#include <stdint.h>
+
+// Public key recovery from secp256k1 signatures, for the ECRECOVER
+// precompile. The field and scalar arithmetic is in software with
+// constant-time Montgomery multiplication, the point multiplications use
+// complete addition formulas in a Montgomery ladder. With EVM_SECP256K1_PKA
+// the point multiplications run on the PKA engine of the cc2538 instead,
+// and in software where the engine fails.
+
+// Point multiplications on the PKA engine, on by default on the cc2538
+#ifdef EVM_CONF_SECP256K1_PKA
+#define EVM_SECP256K1_PKA EVM_CONF_SECP256K1_PKA
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_SECP256K1_PKA 1
+#else
+#define EVM_SECP256K1_PKA 0
+#endif
+
+// The public key, x then y big-endian, that signed the 32-byte hash with
+// the big-endian r and s and the recovery id (0 if R has an even y, 1 if
+// odd). -1 if the signature is not valid.
+int evm_secp256k1_recover(const uint8_t *hash, const uint8_t *r, const uint8_t *s, uint8_t recovery_id, uint8_t *public_key);
+
+#endif /* EVM_SECP256K1_H */
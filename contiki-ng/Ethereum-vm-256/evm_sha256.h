@@ -0,0 +1,38 @@
+#ifndef EVM_SHA256_H
+#define EVM_SHA256_H
+#include <stdint.h>
+
+// SHA-256 for the SHA256 precompile. With EVM_SHA256_HW the hash engine of
+// the cc2538 compresses the blocks, otherwise the portable code here does.
+
+// The cc2538 hash engine, on by default on the cc2538
+#ifdef EVM_CONF_SHA256_HW
+#define EVM_SHA256_HW EVM_CONF_SHA256_HW
+#elif defined(CMSIS_DEV_HDR)
+#define EVM_SHA256_HW 1
+#else
+#define EVM_SHA256_HW 0
+#endif
+
+#if EVM_SHA256_HW
+#include "dev/sha256.h"
+#endif
+
+typedef struct evm_sha256 {
+#if EVM_SHA256_HW
+    sha256_state_t engine;
+    uint8_t hardware;           // the engine holds the state
+#endif
+    uint32_t state[8];
+    uint64_t length;            // bytes hashed
+    uint8_t block[64];
+} evm_sha256_t;
+
+// Start a hash, on the engine if hardware is set and there is one
+void evm_sha256_init(evm_sha256_t *, uint8_t hardware);
+// -1 if the engine failed, e.g. because the radio was using it; the hash
+// then has to start over in software
+int evm_sha256_update(evm_sha256_t *, const uint8_t *, uint32_t);
+int evm_sha256_final(evm_sha256_t *, uint8_t *);
+
+#endif /* EVM_SHA256_H */
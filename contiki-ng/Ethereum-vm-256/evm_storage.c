@@ -0,0 +1,247 @@
+#include "evm.h"
+#include "evm_storage.h"
+
+#define MASK (EVM_STORAGE_CAPACITY - 1)
+
+// Fold the four limbs and scramble them (Fibonacci hashing), so that
+// both small slot numbers and keccak256 mapping keys spread over the table
+static uint32_t home(const uint256_t *key) {
+
+    uint64_t h = UPPER(UPPER_P(key)) ^ LOWER(UPPER_P(key)) ^ UPPER(LOWER_P(key)) ^ LOWER(LOWER_P(key));
+
+    h *= 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(h >> 32) & MASK;
+}
+
+static bool same_key(const uint256_t *a, const uint256_t *b) {
+    return memcmp(a, b, sizeof(uint256_t)) == 0;
+}
+
+// Index of key, or of the free entry that ends its probe sequence.
+// -1 if the key is absent and the table is full.
+static int find(const evm_storage_t *storage, const uint256_t *key) {
+
+    uint32_t i = home(key);
+
+    for (int probe = 0; probe < EVM_STORAGE_CAPACITY; probe++) {
+        if (!(storage->flags[i] & EVM_STORAGE_USED) || same_key(&storage->key[i], key)) {
+            return i;
+        }
+        i = (i + 1) & MASK;
+    }
+    return -1;
+}
+
+// Empty entry i and move back the entries after it that would no longer
+// be reachable from their home position
+static void remove_entry(evm_storage_t *storage, uint32_t i) {
+
+    uint32_t j = i;
+
+    storage->flags[i] = 0;
+    storage->count--;
+    for (;;) {
+        j = (j + 1) & MASK;
+        if (!(storage->flags[j] & EVM_STORAGE_USED)) {
+            return;
+        }
+        uint32_t h = home(&storage->key[j]);
+        // the entry at j may fill the hole at i if its home is not in (i, j]
+        if (((j - h) & MASK) >= ((j - i) & MASK)) {
+            storage->key[i] = storage->key[j];
+            storage->value[i] = storage->value[j];
+            storage->flags[i] = storage->flags[j];
+            storage->flags[j] = 0;
+            i = j;
+        }
+    }
+}
+
+void evm_storage_init(evm_storage_t *storage) {
+    memset(storage, 0, sizeof(*storage));
+}
+
+#if EVM_STORAGE_PERSISTENT
+// Second-chance sweep: drop the first clean entry that was not used since
+// the hand last passed it. -1 if every entry is dirty.
+static int evict(evm_storage_t *storage) {
+
+    for (int step = 0; step < 2 * EVM_STORAGE_CAPACITY; step++) {
+        uint32_t i = storage->hand;
+        storage->hand = (storage->hand + 1) & MASK;
+        if ((storage->flags[i] & (EVM_STORAGE_USED | EVM_STORAGE_DIRTY)) != EVM_STORAGE_USED) {
+            continue;
+        }
+        if (storage->flags[i] & EVM_STORAGE_HOT) {
+            storage->flags[i] &= ~EVM_STORAGE_HOT;
+            continue;
+        }
+        remove_entry(storage, i);
+        return 0;
+    }
+    return -1;
+}
+#endif
+
+// Entry for a key that is not in the table, -1 if it is full
+static int insert(evm_storage_t *storage, const uint256_t *key) {
+
+    int i = find(storage, key);
+
+#if EVM_STORAGE_PERSISTENT
+    if (i < 0 && evict(storage) == 0) {
+        i = find(storage, key);
+    }
+#endif
+    if (i < 0) {
+        return -1;
+    }
+    storage->key[i] = *key;
+    storage->flags[i] = EVM_STORAGE_USED | EVM_STORAGE_HOT;
+    storage->count++;
+    return i;
+}
+
+void evm_storage_load(evm_storage_t *storage, const uint256_t *key, uint256_t *value) {
+
+    int i = find(storage, key);
+
+    if (i >= 0 && (storage->flags[i] & EVM_STORAGE_USED)) {
+        storage->flags[i] |= EVM_STORAGE_HOT;
+        *value = storage->value[i];
+        return;
+    }
+    clear256(value);
+#if EVM_STORAGE_PERSISTENT
+    if (storage->name[0] != '\0') {
+        evm_storage_read(storage, key, value);
+        // cache zero too, the next miss would scan the file again
+        i = insert(storage, key);
+        if (i >= 0) {
+            storage->value[i] = *value;
+        }
+    }
+#endif
+}
+
+// Record the state of key, at entry i if it is in the table, before it
+// changes. A slot the running frame changed before keeps its first record.
+// Returns -1 if the journal is full.
+static int record(evm_journal_t *journal, evm_storage_t *storage, const uint256_t *key, int i) {
+
+    bool present = i >= 0 && (storage->flags[i] & EVM_STORAGE_USED);
+    evm_storage_change_t *change;
+
+    if (present && (storage->flags[i] & EVM_STORAGE_DIRTY)) {
+        for (uint32_t c = journal->frame; c < journal->length; c++) {
+            if (journal->change[c].storage == storage && same_key(&journal->change[c].key, key)) {
+                return 0;
+            }
+        }
+    }
+    if (journal->length == EVM_STORAGE_JOURNAL) {
+        printf("Storage: more than %u changes\n", EVM_STORAGE_JOURNAL);
+        return -1;
+    }
+    change = &journal->change[journal->length++];
+    change->storage = storage;
+    change->key = *key;
+    if (present) {
+        change->flags = storage->flags[i] & (EVM_STORAGE_USED | EVM_STORAGE_DIRTY);
+        change->value = storage->value[i];
+    }
+    else {
+        change->flags = 0;
+        clear256(&change->value);
+    }
+    return 0;
+}
+
+// Returns -1 if a new slot does not fit the table or the change does not
+// fit the journal
+int evm_storage_store(evm_storage_t *storage, evm_journal_t *journal, const uint256_t *key, const uint256_t *value) {
+
+    int i = find(storage, key);
+
+    if (i < 0 || !(storage->flags[i] & EVM_STORAGE_USED)) {
+        // without a backing file an absent slot is zero, with one it may
+        // have to be deleted there
+#if EVM_STORAGE_PERSISTENT
+        if (zero256((uint256_t *)value) && storage->name[0] == '\0') {
+#else
+        if (zero256((uint256_t *)value)) {
+#endif
+            return 0;
+        }
+        if (record(journal, storage, key, -1) < 0) {
+            return -1;
+        }
+        i = insert(storage, key);
+        if (i < 0) {
+            journal->length--;
+            printf("Storage: more than %u slots\n", EVM_STORAGE_CAPACITY);
+            return -1;
+        }
+    }
+    else if (equal256(&storage->value[i], (uint256_t *)value)) {
+        // unchanged, nothing to write back
+        storage->flags[i] |= EVM_STORAGE_HOT;
+        return 0;
+    }
+    else if (record(journal, storage, key, i) < 0) {
+        return -1;
+    }
+    storage->value[i] = *value;
+    storage->flags[i] |= EVM_STORAGE_DIRTY | EVM_STORAGE_HOT;
+    return 0;
+}
+
+// Pass every slot of storage, or of any table if it is NULL, changed in
+// the journal to visit, if not NULL, then mark it clean and drop it if it
+// was set to zero. Only the slots in the journal are looked at; the
+// journal itself is left as it is.
+void evm_storage_commit(evm_journal_t *journal, evm_storage_t *storage, evm_storage_visit_t visit, void *context) {
+
+    for (uint32_t c = 0; c < journal->length; c++) {
+        evm_storage_change_t *change = &journal->change[c];
+        evm_storage_t *table = change->storage;
+        int i;
+
+        if (storage != NULL && table != storage) {
+            continue;
+        }
+        i = find(table, &change->key);
+        // a slot recorded more than once is committed at its first record
+        if (i < 0 || !(table->flags[i] & EVM_STORAGE_DIRTY)) {
+            continue;
+        }
+        if (visit != NULL) {
+            visit(&table->key[i], &table->value[i], context);
+        }
+        table->flags[i] &= ~EVM_STORAGE_DIRTY;
+        if (zero256(&table->value[i])) {
+            remove_entry(table, i);
+        }
+    }
+}
+
+// Undo the changes recorded after the first length ones, newest first.
+// A changed slot is dirty, so it is still in its table.
+void evm_storage_rollback(evm_journal_t *journal, uint16_t length) {
+
+    while (journal->length > length) {
+        evm_storage_change_t *change = &journal->change[--journal->length];
+        evm_storage_t *table = change->storage;
+        int i = find(table, &change->key);
+
+        if (i < 0 || !(table->flags[i] & EVM_STORAGE_USED)) {
+            continue;
+        }
+        if (change->flags == 0) {
+            remove_entry(table, i);
+            continue;
+        }
+        table->value[i] = change->value;
+        table->flags[i] = change->flags | (table->flags[i] & EVM_STORAGE_HOT);
+    }
+}
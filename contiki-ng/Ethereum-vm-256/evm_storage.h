@@ -0,0 +1,92 @@
+#ifndef EVM_STORAGE_H
+#define EVM_STORAGE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "uint256.h"
+
+// Contract storage: open addressing with linear probing over the full
+// 256-bit slot number. A slot set to zero is absent; it is kept, dirty,
+// until the next evm_storage_commit() so that the deletion can be
+// persisted, then removed by shifting its successors back (no tombstones).
+// With EVM_STORAGE_PERSISTENT the table is a write-back cache of the slots
+// kept in flash by evm_storage_cfs.c: a miss is read from the contract's
+// file and clean entries are evicted when the table is full.
+// Every change is recorded with the previous state of its slot in a
+// journal, so that a reverted call is undone slot by slot and a finished
+// one is committed by going over the journal instead of the tables.
+
+// Live slots per contract, a power of two
+#ifdef EVM_CONF_STORAGE_CAPACITY
+#define EVM_STORAGE_CAPACITY EVM_CONF_STORAGE_CAPACITY
+#else
+#define EVM_STORAGE_CAPACITY 32
+#endif
+
+// Keep storage in a Coffee file per contract address
+#ifdef EVM_CONF_STORAGE_PERSISTENT
+#define EVM_STORAGE_PERSISTENT EVM_CONF_STORAGE_PERSISTENT
+#else
+#define EVM_STORAGE_PERSISTENT 0
+#endif
+
+#define EVM_STORAGE_USED    0x01
+#define EVM_STORAGE_DIRTY   0x02
+#define EVM_STORAGE_HOT     0x04            // read or written since the last eviction sweep
+
+// Changes recorded by one call, a slot written more than once by the same
+// frame takes one
+#ifdef EVM_CONF_STORAGE_JOURNAL
+#define EVM_STORAGE_JOURNAL EVM_CONF_STORAGE_JOURNAL
+#else
+#define EVM_STORAGE_JOURNAL 32
+#endif
+
+// "s", 12 hex digits of the hash of the address, "." and the generation,
+// within the 16 characters Coffee keeps on every platform
+#define EVM_STORAGE_NAME_LENGTH 16
+
+typedef struct evm_storage {
+    uint16_t count;                         // used entries
+#if EVM_STORAGE_PERSISTENT
+    char name[EVM_STORAGE_NAME_LENGTH];     // backing file, "" if none is open
+    uint8_t hand;                           // next entry the eviction sweep looks at
+    uint16_t records;                       // records in the backing file
+    uint16_t live;                          // of which left by the last compaction
+#endif
+    uint8_t flags[EVM_STORAGE_CAPACITY];
+    uint256_t key[EVM_STORAGE_CAPACITY];
+    uint256_t value[EVM_STORAGE_CAPACITY];
+} evm_storage_t;
+
+// A slot as it was before a change
+typedef struct evm_storage_change {
+    struct evm_storage *storage;
+    uint8_t flags;                          // 0 if the slot was not in the table
+    uint256_t key;
+    uint256_t value;
+} evm_storage_change_t;
+
+typedef struct evm_journal {
+    uint16_t length;
+    uint16_t frame;                         // first change of the running frame
+    evm_storage_change_t change[EVM_STORAGE_JOURNAL];
+} evm_journal_t;
+
+// Called for every dirty slot by evm_storage_commit(); a zero value means
+// the slot was deleted
+typedef void (*evm_storage_visit_t)(const uint256_t *key, const uint256_t *value, void *context);
+
+void evm_storage_init(evm_storage_t *);
+void evm_storage_load(evm_storage_t *, const uint256_t *, uint256_t *);
+int evm_storage_store(evm_storage_t *, evm_journal_t *, const uint256_t *, const uint256_t *);
+void evm_storage_commit(evm_journal_t *, evm_storage_t *, evm_storage_visit_t, void *);
+void evm_storage_rollback(evm_journal_t *, uint16_t);
+
+#if EVM_STORAGE_PERSISTENT
+// backing store, see evm_storage_cfs.c
+void evm_storage_open(evm_storage_t *, const uint256_t *);
+void evm_storage_read(const evm_storage_t *, const uint256_t *, uint256_t *);
+int evm_storage_flush(evm_storage_t *, evm_journal_t *);
+#endif
+
+#endif /* EVM_STORAGE_H */
@@ -0,0 +1,331 @@
+#include "evm.h"
+#include "evm_storage.h"
+
+#if EVM_STORAGE_PERSISTENT
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "cfs-coffee-arch.h"
+#include "lib/assert.h"
+#include "keccak256.h"
+
+// Flash backend of contract storage. Every contract has an append-only log
+// of (slot, value) records in a Coffee file named after the hash of its
+// address; the last record of a slot holds its value and a zero value
+// deletes it.
+// Coffee finds the end of a file by its last non-zero byte, so each record
+// ends with a non-zero tag.
+// A call appends its dirty slots once it has finished successfully. When
+// EVM_STORAGE_LOG_RECORDS records were appended since the last compaction
+// the log is rewritten with only the
+// live slots into the file of the next generation ("s<hash>.0" and
+// "s<hash>.1" alternate), then the old one is removed.
+
+// Records appended between compactions, space for them is reserved
+#ifdef EVM_CONF_STORAGE_LOG_RECORDS
+#define EVM_STORAGE_LOG_RECORDS EVM_CONF_STORAGE_LOG_RECORDS
+#else
+#define EVM_STORAGE_LOG_RECORDS 32
+#endif
+
+// Records gathered in RAM before they are written
+#ifdef EVM_CONF_STORAGE_BATCH
+#define EVM_STORAGE_BATCH EVM_CONF_STORAGE_BATCH
+#else
+#define EVM_STORAGE_BATCH 8
+#endif
+
+#define RECORD_SIZE 65
+#define RECORD_TAG  0xA5
+
+// Records the space reserved for a log holds: the live slots and the
+// records appended until the next compaction. compact() sorts out this
+// many records at once.
+#define LOG_RECORDS (EVM_STORAGE_CAPACITY + EVM_STORAGE_LOG_RECORDS)
+
+typedef struct batch {
+    int fd;
+    int status;
+    uint16_t used;
+    uint8_t record[EVM_STORAGE_BATCH][RECORD_SIZE];
+} batch_t;
+
+static batch_t batch;
+
+// The records of the window compact() is at: a 16-bit hash of the slot of
+// each, and whether it is dead, superseded or zero
+static uint16_t window_hash[LOG_RECORDS];
+static uint8_t window_dead[(LOG_RECORDS + 7) / 8];
+
+// Coffee cuts longer names, a file would then never be found again
+CTASSERT(EVM_STORAGE_NAME_LENGTH <= COFFEE_NAME_LENGTH);
+
+// The name of generation 0 of the file of the contract at address, from
+// the Keccak-256 hash of all 20 bytes of the address
+static void file_name(char *name, const uint256_t *address) {
+
+    uint8_t word[32];
+    uint8_t hash[32];
+    SHA3_CTX ctx;
+
+    writeu256BE((uint256_t *)address, word);
+    keccak_init(&ctx);
+    keccak_update(&ctx, word + 12, 20);
+    keccak_final(&ctx, hash);
+    snprintf(name, EVM_STORAGE_NAME_LENGTH, "s%02x%02x%02x%02x%02x%02x.0",
+             hash[0], hash[1], hash[2], hash[3], hash[4], hash[5]);
+}
+
+static void name_generation(char *name, uint8_t generation) {
+    name[EVM_STORAGE_NAME_LENGTH - 2] = '0' + generation;
+}
+
+static cfs_offset_t file_size(const char *name) {
+
+    int fd = cfs_open(name, CFS_READ);
+    cfs_offset_t size;
+
+    if (fd < 0) {
+        return -1;
+    }
+    size = cfs_seek(fd, 0, CFS_SEEK_END);
+    cfs_close(fd);
+    return size;
+}
+
+// Open the file of the contract at address. The cached slots are dropped
+// if they belong to another contract.
+void evm_storage_open(evm_storage_t *storage, const uint256_t *address) {
+
+    char name[EVM_STORAGE_NAME_LENGTH];
+    cfs_offset_t size[2];
+
+    file_name(name, address);
+    if (memcmp(name, storage->name, EVM_STORAGE_NAME_LENGTH - 2) == 0) {
+        return;
+    }
+    evm_storage_init(storage);
+
+    size[0] = file_size(name);
+    name_generation(name, 1);
+    size[1] = file_size(name);
+    if (size[0] >= 0 && size[1] >= 0) {
+        // compaction was interrupted: the new generation is a copy of the
+        // live part of the old one, complete or not, so the larger is valid
+        uint8_t stale = size[0] >= size[1];
+        name_generation(name, stale);
+        cfs_remove(name);
+        size[stale] = -1;
+    }
+    name_generation(name, size[1] >= 0);
+    memcpy(storage->name, name, sizeof(name));
+    storage->records = size[size[1] >= 0] > 0 ? size[size[1] >= 0] / RECORD_SIZE : 0;
+}
+
+// Latest value of key in the log, zero if it has none
+void evm_storage_read(const evm_storage_t *storage, const uint256_t *key, uint256_t *value) {
+
+    uint8_t slot[32];
+    uint8_t record[RECORD_SIZE];
+    int fd;
+
+    clear256(value);
+    fd = cfs_open(storage->name, CFS_READ);
+    if (fd < 0) {
+        // nothing written yet
+        return;
+    }
+    writeu256BE((uint256_t *)key, slot);
+    while (cfs_read(fd, record, RECORD_SIZE) == RECORD_SIZE) {
+        if (memcmp(record, slot, 32) == 0) {
+            readu256BE(record + 32, value);
+        }
+    }
+    cfs_close(fd);
+}
+
+static void batch_write(void) {
+
+    int length = batch.used * RECORD_SIZE;
+
+    if (batch.used != 0 && cfs_write(batch.fd, batch.record, length) != length) {
+        printf("Storage: write failed\n");
+        batch.status = -1;
+    }
+    batch.used = 0;
+}
+
+static void batch_append(const uint256_t *key, const uint256_t *value, void *context) {
+
+    (void)context;
+    if (batch.used == EVM_STORAGE_BATCH) {
+        batch_write();
+    }
+    writeu256BE((uint256_t *)key, batch.record[batch.used]);
+    writeu256BE((uint256_t *)value, batch.record[batch.used] + 32);
+    batch.record[batch.used][64] = RECORD_TAG;
+    batch.used++;
+}
+
+static uint16_t slot_hash(const uint8_t *slot) {
+
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < 32; i++) {
+        h = (h ^ slot[i]) * 16777619u;
+    }
+    return (uint16_t)(h ^ (h >> 16));
+}
+
+static bool is_dead(uint16_t i) {
+    return window_dead[i / 8] & (1 << (i % 8));
+}
+
+static void set_dead(uint16_t i) {
+    window_dead[i / 8] |= 1 << (i % 8);
+}
+
+// Mark the dead records of the window of count records from first. Every
+// record from first on is read once and its slot hash compared with those
+// of the window records before it; only on a match is the earlier record
+// read back to compare the slots.
+static int sort_out(int in, uint16_t first, uint16_t count, uint16_t records) {
+
+    uint8_t record[RECORD_SIZE];
+    uint8_t slot[32];
+
+    memset(window_dead, 0, sizeof(window_dead));
+    for (uint16_t j = first; j < records; j++) {
+        cfs_offset_t next = (cfs_offset_t)(j + 1) * RECORD_SIZE;
+        uint16_t hash;
+        if (cfs_read(in, record, RECORD_SIZE) != RECORD_SIZE) {
+            return -1;
+        }
+        hash = slot_hash(record);
+        for (uint16_t i = 0; i < count && first + i < j; i++) {
+            if (window_hash[i] != hash || is_dead(i)) {
+                continue;
+            }
+            cfs_seek(in, (cfs_offset_t)(first + i) * RECORD_SIZE, CFS_SEEK_SET);
+            if (cfs_read(in, slot, 32) != 32) {
+                return -1;
+            }
+            if (memcmp(slot, record, 32) == 0) {
+                set_dead(i);
+            }
+        }
+        cfs_seek(in, next, CFS_SEEK_SET);
+        if (j - first < count) {
+            uint256_t value;
+            readu256BE(record + 32, &value);
+            window_hash[j - first] = hash;
+            if (zero256(&value)) {
+                set_dead(j - first);
+            }
+        }
+    }
+    return 0;
+}
+
+// Rewrite the log into the next generation with one record per live slot.
+// A record is live if no later record has the same slot and its value is
+// not zero. The log is gone through in windows of LOG_RECORDS records, one
+// if it is no longer than its reserved space.
+static int compact(evm_storage_t *storage) {
+
+    char name[EVM_STORAGE_NAME_LENGTH];
+    uint8_t record[RECORD_SIZE];
+    uint16_t live = 0;
+    uint16_t reserve;
+    int status = 0;
+    int in;
+    int out;
+
+    memcpy(name, storage->name, sizeof(name));
+    name_generation(name, name[EVM_STORAGE_NAME_LENGTH - 2] == '0');
+    cfs_remove(name);
+    // room for every live slot, the log may hold more than the cache; a
+    // file that outgrows its reservation is copied by Coffee
+    reserve = storage->records > EVM_STORAGE_CAPACITY ? storage->records : EVM_STORAGE_CAPACITY;
+    if (cfs_coffee_reserve(name, (cfs_offset_t)(reserve + EVM_STORAGE_LOG_RECORDS) * RECORD_SIZE) < 0) {
+        printf("Storage: cannot reserve %s\n", name);
+        return -1;
+    }
+    in = cfs_open(storage->name, CFS_READ);
+    out = cfs_open(name, CFS_WRITE | CFS_APPEND);
+    if (in < 0 || out < 0) {
+        printf("Storage: cannot compact %s\n", storage->name);
+        cfs_close(in);
+        cfs_close(out);
+        return -1;
+    }
+    for (uint16_t first = 0; first < storage->records && status == 0; first += LOG_RECORDS) {
+        uint16_t count = storage->records - first;
+        if (count > LOG_RECORDS) {
+            count = LOG_RECORDS;
+        }
+        cfs_seek(in, (cfs_offset_t)first * RECORD_SIZE, CFS_SEEK_SET);
+        status = sort_out(in, first, count, storage->records);
+        cfs_seek(in, (cfs_offset_t)first * RECORD_SIZE, CFS_SEEK_SET);
+        for (uint16_t i = 0; i < count && status == 0; i++) {
+            if (cfs_read(in, record, RECORD_SIZE) != RECORD_SIZE) {
+                status = -1;
+            }
+            else if (!is_dead(i)) {
+                if (cfs_write(out, record, RECORD_SIZE) != RECORD_SIZE) {
+                    printf("Storage: write failed\n");
+                    status = -1;
+                }
+                live++;
+            }
+        }
+    }
+    cfs_close(in);
+    cfs_close(out);
+    if (status < 0) {
+        // the old generation is complete, keep it
+        cfs_remove(name);
+        return -1;
+    }
+    cfs_remove(storage->name);
+    memcpy(storage->name, name, sizeof(name));
+    storage->records = live;
+    storage->live = live;
+    return 0;
+}
+
+// Append the slots of storage that journal holds changes of to the log,
+// compacting it first if it has grown enough. Returns -1 if the file could
+// not be written; the slots are clean afterwards in any case.
+int evm_storage_flush(evm_storage_t *storage, evm_journal_t *journal) {
+
+    cfs_offset_t end;
+
+    if (storage->name[0] == '\0') {
+        evm_storage_commit(journal, storage, NULL, NULL);
+        return 0;
+    }
+    if (storage->records - storage->live >= EVM_STORAGE_LOG_RECORDS) {
+        compact(storage);
+    }
+    if (storage->records == 0 && file_size(storage->name) < 0) {
+        // a new log, reserve its space up front so that appends do not move it
+        cfs_coffee_reserve(storage->name, LOG_RECORDS * RECORD_SIZE);
+    }
+    batch.fd = cfs_open(storage->name, CFS_WRITE | CFS_APPEND);
+    batch.status = 0;
+    batch.used = 0;
+    if (batch.fd < 0) {
+        printf("Storage: cannot open %s\n", storage->name);
+        evm_storage_commit(journal, storage, NULL, NULL);
+        return -1;
+    }
+    evm_storage_commit(journal, storage, batch_append, NULL);
+    batch_write();
+    end = cfs_seek(batch.fd, 0, CFS_SEEK_END);
+    cfs_close(batch.fd);
+    if (end >= 0) {
+        storage->records = end / RECORD_SIZE;
+    }
+    return batch.status;
+}
+#endif /* EVM_STORAGE_PERSISTENT */
@@ -19,156 +19,238 @@
 
 #include "keccak256.h"
 
-//#include <avr/pgmspace.h>
-
 #include <string.h>
 #include <stdint.h>
 
-#define BLOCK_SIZE     ((1600 - 256 * 2) / 8)
-
-#define I64(x) x##LL
-#define ROTL64(qword, n) ((qword) << (n) ^ ((qword) >> (64 - (n))))
-#define le2me_64(x) (x)
-#define IS_ALIGNED_64(p) (0 == (7 & ((const char*)(p) - (const char*)0)))
-#define me64_to_le_str(to, from, length) memcpy((to), (from), (length))
+#define BLOCK_SIZE KECCAK256_BLOCK_SIZE
 
-/* constants */
+#define ROTL32(x, n) ((x) << (n) | (x) >> ((32 - (n)) & 31))
+#define ROTL64(x, n) ((x) << (n) | (x) >> ((64 - (n)) & 63))
 
-//const uint8_t round_constant_info[] PROGMEM = {
-//const uint8_t constants[] PROGMEM = {
-const uint8_t constants[]  = {
+static uint32_t load32_le(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
 
-    1, 26, 94, 112, 31, 33, 121, 85, 14, 12, 53, 38, 63, 79, 93, 83, 82, 72, 22, 102, 121, 88, 33, 116,
-//};
+#if EVM_KECCAK_INTERLEAVED
+
+/* the iota constants, interleaved */
+static const keccak_lane_t keccakf_rndc[24] = {
+    { 0x00000001, 0x00000000 }, { 0x00000000, 0x00000089 }, { 0x00000000, 0x8000008B },
+    { 0x00000000, 0x80008080 }, { 0x00000001, 0x0000008B }, { 0x00000001, 0x00008000 },
+    { 0x00000001, 0x80008088 }, { 0x00000001, 0x80000082 }, { 0x00000000, 0x0000000B },
+    { 0x00000000, 0x0000000A }, { 0x00000001, 0x00008082 }, { 0x00000000, 0x00008003 },
+    { 0x00000001, 0x0000808B }, { 0x00000001, 0x8000000B }, { 0x00000001, 0x8000008A },
+    { 0x00000001, 0x80000081 }, { 0x00000000, 0x80000081 }, { 0x00000000, 0x80000008 },
+    { 0x00000000, 0x00000083 }, { 0x00000000, 0x80008003 }, { 0x00000001, 0x80008088 },
+    { 0x00000000, 0x80000088 }, { 0x00000001, 0x00008000 }, { 0x00000000, 0x80008082 },
+};
 
-//const uint8_t pi_transform[] PROGMEM = {
-    1, 6, 9, 22, 14, 20, 2, 12, 13, 19, 23, 15, 4, 24, 21, 8, 16, 5, 3, 18, 17, 11, 7, 10,
-//};
+static inline keccak_lane_t lane_xor(keccak_lane_t a, keccak_lane_t b) {
+    keccak_lane_t r = { a.even ^ b.even, a.odd ^ b.odd };
+    return r;
+}
 
-//const uint8_t rhoTransforms[] PROGMEM = {
-    1, 62, 28, 27, 36, 44, 6, 55, 20, 3, 10, 43, 25, 39, 41, 45, 15, 21, 8, 18, 2, 61, 56, 14,
-};
+/* ~a & b */
+static inline keccak_lane_t lane_andn(keccak_lane_t a, keccak_lane_t b) {
+    keccak_lane_t r = { ~a.even & b.even, ~a.odd & b.odd };
+    return r;
+}
 
-#define TYPE_ROUND_INFO      0
-#define TYPE_PI_TRANSFORM   24
-#define TYPE_RHO_TRANSFORM  48
+/* A rotation by an odd count swaps the halves */
+static inline keccak_lane_t lane_rotl(keccak_lane_t a, unsigned n) {
+    keccak_lane_t r;
+    if (n & 1) {
+        r.even = ROTL32(a.odd, (n + 1) / 2);
+        r.odd = ROTL32(a.even, n / 2);
+    } else {
+        r.even = ROTL32(a.even, n / 2);
+        r.odd = ROTL32(a.odd, n / 2);
+    }
+    return r;
+}
 
-uint8_t getConstant(uint8_t type, uint8_t index) {
-    return constants[type + index];
-    //return pgm_read_byte(&constants[type + index]);
+/* the even bits of x in the low 16 bits */
+static uint32_t even_bits(uint32_t x) {
+    x &= 0x55555555;
+    x = (x | x >> 1) & 0x33333333;
+    x = (x | x >> 2) & 0x0F0F0F0F;
+    x = (x | x >> 4) & 0x00FF00FF;
+    return (x | x >> 8) & 0x0000FFFF;
 }
 
-static uint64_t get_round_constant(uint8_t round) {
-    uint64_t result = 0;
+/* the low 16 bits of x in the even bits */
+static uint32_t spread_bits(uint32_t x) {
+    x &= 0x0000FFFF;
+    x = (x | x << 8) & 0x00FF00FF;
+    x = (x | x << 4) & 0x0F0F0F0F;
+    x = (x | x << 2) & 0x33333333;
+    return (x | x << 1) & 0x55555555;
+}
 
-    //uint8_t roundInfo = pgm_read_byte(&round_constant_info[round]);
-    uint8_t roundInfo = getConstant(TYPE_ROUND_INFO, round);
-    if (roundInfo & (1 << 6)) { result |= ((uint64_t)1 << 63); }
-    if (roundInfo & (1 << 5)) { result |= ((uint64_t)1 << 31); }
-    if (roundInfo & (1 << 4)) { result |= ((uint64_t)1 << 15); }
-    if (roundInfo & (1 << 3)) { result |= ((uint64_t)1 << 7); }
-    if (roundInfo & (1 << 2)) { result |= ((uint64_t)1 << 3); }
-    if (roundInfo & (1 << 1)) { result |= ((uint64_t)1 << 1); }
-    if (roundInfo & (1 << 0)) { result |= ((uint64_t)1 << 0); }
+static keccak_lane_t lane_load(const uint8_t *p) {
+    uint32_t low = load32_le(p), high = load32_le(p + 4);
+    keccak_lane_t r = {
+        even_bits(low) | even_bits(high) << 16,
+        even_bits(low >> 1) | even_bits(high >> 1) << 16
+    };
+    return r;
+}
 
-    return result;
+static uint64_t lane_value(keccak_lane_t a) {
+    uint32_t low = spread_bits(a.even) | spread_bits(a.odd) << 1;
+    uint32_t high = spread_bits(a.even >> 16) | spread_bits(a.odd >> 16) << 1;
+    return (uint64_t)high << 32 | low;
 }
 
+#else
+
+static const keccak_lane_t keccakf_rndc[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a,
+    0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
+    0x8000000080008081, 0x8000000000008009, 0x000000000000008a,
+    0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089,
+    0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+    0x000000000000800a, 0x800000008000000a, 0x8000000080008081,
+    0x8000000000008080, 0x0000000080000001, 0x8000000080008008
+};
 
-/* Initializing a sha3 context for given number of output bits */
-void keccak_init(SHA3_CTX *ctx) {
-    /* NB: The Keccak capacity parameter = bits * 2 */
+#define lane_xor(a, b) ((a) ^ (b))
+#define lane_andn(a, b) (~(a) & (b))
+#define lane_rotl(a, n) ROTL64(a, n)
+#define lane_load(p) ((uint64_t)load32_le((p) + 4) << 32 | load32_le(p))
+#define lane_value(a) (a)
 
-    memset(ctx, 0, sizeof(SHA3_CTX));
+#endif /* EVM_KECCAK_INTERLEAVED */
+
+/* a digest lane as a big-endian number, one byte swap (REV on Cortex-M3) */
+static uint64_t lane_be(keccak_lane_t a) {
+    return __builtin_bswap64(lane_value(a));
 }
 
-/* Keccak theta() transformation */
-static void keccak_theta(uint64_t *A) {
-    uint64_t C[5], D[5];
+#define XOR5(x) \
+    lane_xor(lane_xor(lane_xor(lane_xor(A[x], A[x + 5]), A[x + 10]), A[x + 15]), A[x + 20])
 
-    for (uint8_t i = 0; i < 5; i++) {
-        C[i] = A[i];
-        for (uint8_t j = 5; j < 25; j += 5) { C[i] ^= A[i + j]; }
-    }
+#if EVM_KECCAK_UNROLL
 
-    for (uint8_t i = 0; i < 5; i++) {
-        D[i] = ROTL64(C[(i + 1) % 5], 1) ^ C[(i + 4) % 5];
-    }
+#define THETA(x) \
+    D = lane_xor(C[(x + 4) % 5], lane_rotl(C[(x + 1) % 5], 1)); \
+    A[x] = lane_xor(A[x], D); \
+    A[x + 5] = lane_xor(A[x + 5], D); \
+    A[x + 10] = lane_xor(A[x + 10], D); \
+    A[x + 15] = lane_xor(A[x + 15], D); \
+    A[x + 20] = lane_xor(A[x + 20], D)
 
-    for (uint8_t i = 0; i < 5; i++) {
-        //for (uint8_t j = 0; j < 25; j += 5) {
-        for (uint8_t j = 0; j < 25; j += 5) { A[i + j] ^= D[i]; }
-    }
-}
+#define RHO_PI(j, n) \
+    u = A[j]; \
+    A[j] = lane_rotl(t, n); \
+    t = u
 
+#define CHI(y) \
+    a0 = A[y]; \
+    a1 = A[y + 1]; \
+    A[y] = lane_xor(a0, lane_andn(a1, A[y + 2])); \
+    A[y + 1] = lane_xor(a1, lane_andn(A[y + 2], A[y + 3])); \
+    A[y + 2] = lane_xor(A[y + 2], lane_andn(A[y + 3], A[y + 4])); \
+    A[y + 3] = lane_xor(A[y + 3], lane_andn(A[y + 4], a0)); \
+    A[y + 4] = lane_xor(A[y + 4], lane_andn(a0, a1))
 
-/* Keccak pi() transformation */
-static void keccak_pi(uint64_t *A) {
-    uint64_t A1 = A[1];
-    //for (uint8_t i = 1; i < sizeof(pi_transform); i++) {
-    for (uint8_t i = 1; i < 24; i++) {
-        //A[pgm_read_byte(&pi_transform[i - 1])] = A[pgm_read_byte(&pi_transform[i])];
-        A[getConstant(TYPE_PI_TRANSFORM, i - 1)] = A[getConstant(TYPE_PI_TRANSFORM, i)];
+static void keccak_permutation(keccak_lane_t *A) {
+    keccak_lane_t C[5], D, t, u, a0, a1;
+
+    for (uint8_t round = 0; round < 24; round++) {
+        C[0] = XOR5(0);
+        C[1] = XOR5(1);
+        C[2] = XOR5(2);
+        C[3] = XOR5(3);
+        C[4] = XOR5(4);
+        THETA(0);
+        THETA(1);
+        THETA(2);
+        THETA(3);
+        THETA(4);
+
+        t = A[1];
+        RHO_PI(10, 1);  RHO_PI(7, 3);   RHO_PI(11, 6);  RHO_PI(17, 10);
+        RHO_PI(18, 15); RHO_PI(3, 21);  RHO_PI(5, 28);  RHO_PI(16, 36);
+        RHO_PI(8, 45);  RHO_PI(21, 55); RHO_PI(24, 2);  RHO_PI(4, 14);
+        RHO_PI(15, 27); RHO_PI(23, 41); RHO_PI(19, 56); RHO_PI(13, 8);
+        RHO_PI(12, 25); RHO_PI(2, 43);  RHO_PI(20, 62); RHO_PI(14, 18);
+        RHO_PI(22, 39); RHO_PI(9, 61);  RHO_PI(6, 20);  RHO_PI(1, 44);
+
+        CHI(0);
+        CHI(5);
+        CHI(10);
+        CHI(15);
+        CHI(20);
+
+        A[0] = lane_xor(A[0], keccakf_rndc[round]);
     }
-    A[10] = A1;
-    /* note: A[ 0] is left as is */
 }
 
-/*
-ketch uses 30084 bytes (93%) of program storage space. Maximum is 32256 bytes.
-Global variables use 743 bytes (36%) of dynamic memory, leaving 1305 bytes for local variables. Maximum is 2048 bytes.
+#else
 
-*/
-/* Keccak chi() transformation */
-static void keccak_chi(uint64_t *A) {
-    for (uint8_t i = 0; i < 25; i += 5) {
-        uint64_t A0 = A[0 + i], A1 = A[1 + i];
-        A[0 + i] ^= ~A1 & A[2 + i];
-        A[1 + i] ^= ~A[2 + i] & A[3 + i];
-        A[2 + i] ^= ~A[3 + i] & A[4 + i];
-        A[3 + i] ^= ~A[4 + i] & A0;
-        A[4 + i] ^= ~A0 & A1;
-    }
-}
+/* rho and pi: the lane every step moves to and its rotation */
+static const uint8_t keccakf_piln[24] = {
+    10, 7,  11, 17, 18, 3, 5,  16, 8,  21, 24, 4,
+    15, 23, 19, 13, 12, 2, 20, 14, 22, 9,  6,  1
+};
+static const uint8_t keccakf_rotc[24] = {
+    1,  3,  6,  10, 15, 21, 28, 36, 45, 55, 2,  14,
+    27, 41, 56, 8,  25, 43, 62, 18, 39, 61, 20, 44
+};
 
+static void keccak_permutation(keccak_lane_t *A) {
+    keccak_lane_t C[5], D, t, u;
 
-static void sha3_permutation(uint64_t *state) {
-    //for (uint8_t round = 0; round < sizeof(round_constant_info); round++) {
     for (uint8_t round = 0; round < 24; round++) {
-        keccak_theta(state);
+        /* theta */
+        for (uint8_t x = 0; x < 5; x++) {
+            C[x] = XOR5(x);
+        }
+        for (uint8_t x = 0; x < 5; x++) {
+            D = lane_xor(C[(x + 4) % 5], lane_rotl(C[(x + 1) % 5], 1));
+            for (uint8_t y = 0; y < 25; y += 5) {
+                A[x + y] = lane_xor(A[x + y], D);
+            }
+        }
 
-        /* apply Keccak rho() transformation */
-        for (uint8_t i = 1; i < 25; i++) {
-            //state[i] = ROTL64(state[i], pgm_read_byte(&rhoTransforms[i - 1]));
-            state[i] = ROTL64(state[i], getConstant(TYPE_RHO_TRANSFORM, i - 1));
+        /* rho and pi */
+        t = A[1];
+        for (uint8_t i = 0; i < 24; i++) {
+            u = A[keccakf_piln[i]];
+            A[keccakf_piln[i]] = lane_rotl(t, keccakf_rotc[i]);
+            t = u;
         }
 
-        keccak_pi(state);
-        keccak_chi(state);
+        /* chi */
+        for (uint8_t y = 0; y < 25; y += 5) {
+            for (uint8_t x = 0; x < 5; x++) {
+                C[x] = A[y + x];
+            }
+            for (uint8_t x = 0; x < 5; x++) {
+                A[y + x] = lane_xor(C[x], lane_andn(C[(x + 1) % 5], C[(x + 2) % 5]));
+            }
+        }
 
-        /* apply iota(state, round) */
-        *state ^= get_round_constant(round);
+        /* iota */
+        A[0] = lane_xor(A[0], keccakf_rndc[round]);
     }
 }
 
-/**
- * The core transformation. Process the specified block of data.
- *
- * @param hash the algorithm state
- * @param block the message block to process
- * @param block_size the size of the processed block in bytes
- */
-static void sha3_process_block(uint64_t hash[25], const uint64_t *block) {
-    for (uint8_t i = 0; i < 17; i++) {
-        hash[i] ^= le2me_64(block[i]);
-    }
+#endif /* EVM_KECCAK_UNROLL */
 
-    /* make a permutation of the hash */
-    sha3_permutation(hash);
+/* XOR a block of the message into the state and permute it */
+static void keccak_absorb(keccak_lane_t *A, const uint8_t *block) {
+    for (uint8_t i = 0; i < BLOCK_SIZE / 8; i++) {
+        A[i] = lane_xor(A[i], lane_load(block + 8 * i));
+    }
+    keccak_permutation(A);
 }
 
-//#define SHA3_FINALIZED 0x80000000
-//#define SHA3_FINALIZED 0x8000
+void keccak_init(SHA3_CTX *ctx) {
+    memset(ctx, 0, sizeof(SHA3_CTX));
+}
 
 /**
  * Calculate message hash.
@@ -180,34 +262,24 @@ static void sha3_process_block(uint64_t hash[25], const uint64_t *block) {
  */
 void keccak_update(SHA3_CTX *ctx, const unsigned char *msg, uint16_t size)
 {
-    uint16_t idx = (uint16_t)ctx->rest;
+    uint16_t idx = ctx->rest;
 
-    //if (ctx->rest & SHA3_FINALIZED) return; /* too late for additional input */
-    ctx->rest = (unsigned)((ctx->rest + size) % BLOCK_SIZE);
+    ctx->rest = (uint16_t)((ctx->rest + size) % BLOCK_SIZE);
 
     /* fill partial block */
     if (idx) {
         uint16_t left = BLOCK_SIZE - idx;
-        memcpy((char*)ctx->message + idx, msg, (size < left ? size : left));
+        memcpy(ctx->message + idx, msg, (size < left ? size : left));
         if (size < left) return;
 
-        /* process partial block */
-        sha3_process_block(ctx->hash, ctx->message);
+        keccak_absorb(ctx->hash, ctx->message);
         msg  += left;
         size -= left;
     }
 
+    /* whole blocks straight from the message */
     while (size >= BLOCK_SIZE) {
-        uint64_t* aligned_message_block;
-        if (IS_ALIGNED_64(msg)) {
-            // the most common case is processing of an already aligned message without copying it
-            aligned_message_block = (uint64_t*)(void*)msg;
-        } else {
-            memcpy(ctx->message, msg, BLOCK_SIZE);
-            aligned_message_block = ctx->message;
-        }
-
-        sha3_process_block(ctx->hash, aligned_message_block);
+        keccak_absorb(ctx->hash, msg);
         msg  += BLOCK_SIZE;
         size -= BLOCK_SIZE;
     }
@@ -217,6 +289,15 @@ void keccak_update(SHA3_CTX *ctx, const unsigned char *msg, uint16_t size)
     }
 }
 
+/* pad and absorb the last block */
+static void keccak_pad(SHA3_CTX *ctx)
+{
+    memset(ctx->message + ctx->rest, 0, BLOCK_SIZE - ctx->rest);
+    ctx->message[ctx->rest] |= 0x01;
+    ctx->message[BLOCK_SIZE - 1] |= 0x80;
+    keccak_absorb(ctx->hash, ctx->message);
+}
+
 /**
 * Store calculated hash into the given array.
 *
@@ -225,21 +306,54 @@ void keccak_update(SHA3_CTX *ctx, const unsigned char *msg, uint16_t size)
 */
 void keccak_final(SHA3_CTX *ctx, unsigned char* result)
 {
-    uint16_t digest_length = 100 - BLOCK_SIZE / 2;
-
-//    if (!(ctx->rest & SHA3_FINALIZED)) {
-        /* clear the rest of the data queue */
-        memset((char*)ctx->message + ctx->rest, 0, BLOCK_SIZE - ctx->rest);
-        ((char*)ctx->message)[ctx->rest] |= 0x01;
-        ((char*)ctx->message)[BLOCK_SIZE - 1] |= 0x80;
+    keccak_pad(ctx);
+    if (result) {
+        for (uint8_t i = 0; i < 4; i++) {
+            uint64_t word = lane_value(ctx->hash[i]);
+            for (uint8_t j = 0; j < 8; j++) {
+                result[8 * i + j] = (uint8_t)(word >> (8 * j));
+            }
+        }
+    }
+}
 
-        /* process final block */
-        sha3_process_block(ctx->hash, ctx->message);
-//        ctx->rest = SHA3_FINALIZED; /* mark context as finalized */
-//    }
+void keccak_final_words(SHA3_CTX *ctx, uint64_t *words)
+{
+    keccak_pad(ctx);
+    for (uint8_t i = 0; i < 4; i++) {
+        words[i] = lane_be(ctx->hash[i]);
+    }
+}
 
-    if (result) {
-         me64_to_le_str(result, ctx->hash, digest_length);
+/* Hash length bytes, less than a block, with a single permutation and
+ * without a context: the lanes are loaded from data and padded in place. */
+static inline void keccak_block_words(const uint8_t *data, uint8_t length, uint64_t *words)
+{
+    static const uint8_t pad_end[8] = { 0, 0, 0, 0, 0, 0, 0, 0x80 };
+    keccak_lane_t A[25];
+    uint8_t tail[8] = { 0 };
+    uint8_t full = length / 8;
+
+    memset(A, 0, sizeof(A));
+    for (uint8_t i = 0; i < full; i++) {
+        A[i] = lane_load(data + 8 * i);
+    }
+    memcpy(tail, data + 8 * full, length % 8);
+    tail[length % 8] = 0x01;
+    A[full] = lane_load(tail);
+    A[BLOCK_SIZE / 8 - 1] = lane_xor(A[BLOCK_SIZE / 8 - 1], lane_load(pad_end));
+    keccak_permutation(A);
+    for (uint8_t i = 0; i < 4; i++) {
+        words[i] = lane_be(A[i]);
     }
 }
 
+void keccak256_32(const uint8_t *data, uint64_t *words)
+{
+    keccak_block_words(data, 32, words);
+}
+
+void keccak256_64(const uint8_t *data, uint64_t *words)
+{
+    keccak_block_words(data, 64, words);
+}
@@ -22,18 +22,45 @@
 
 #include <stdint.h>
 
-#define sha3_max_permutation_size 25
-#define sha3_max_rate_in_qwords 24
+/* Keccak-256, as Ethereum uses it: the original padding, not the SHA-3 one.
+ * One Keccak-f[1600] core in keccak256.c, over 64-bit lanes or, where the
+ * CPU is 32-bit, over bit-interleaved lanes: two 32-bit words with the even
+ * and the odd bits of the lane, which turn every 64-bit rotation into two
+ * 32-bit ones. */
+
+/* bit-interleaved lanes, by default where pointers have 32 bits (cc2538) */
+#ifdef EVM_CONF_KECCAK_INTERLEAVED
+#define EVM_KECCAK_INTERLEAVED EVM_CONF_KECCAK_INTERLEAVED
+#elif UINTPTR_MAX > 0xFFFFFFFF
+#define EVM_KECCAK_INTERLEAVED 0
+#else
+#define EVM_KECCAK_INTERLEAVED 1
+#endif
+
+/* fully unrolled rounds, faster but several times the code */
+#ifdef EVM_CONF_KECCAK_UNROLL
+#define EVM_KECCAK_UNROLL EVM_CONF_KECCAK_UNROLL
+#else
+#define EVM_KECCAK_UNROLL 0
+#endif
+
+#define KECCAK256_BLOCK_SIZE 136
+
+#if EVM_KECCAK_INTERLEAVED
+typedef struct keccak_lane {
+    uint32_t even;
+    uint32_t odd;
+} keccak_lane_t;
+#else
+typedef uint64_t keccak_lane_t;
+#endif
 
 typedef struct SHA3_CTX {
     /* 1600 bits algorithm hashing state */
-    uint64_t hash[sha3_max_permutation_size];
-    /* 1536-bit buffer for leftovers */
-    uint64_t message[sha3_max_rate_in_qwords];
-    /* count of bytes in the message[] buffer */
+    keccak_lane_t hash[25];
+    /* leftovers of the message, less than a block */
+    uint8_t message[KECCAK256_BLOCK_SIZE];
     uint16_t rest;
-    /* size of a message block processed at once */
-    //unsigned block_size;
 } SHA3_CTX;
 
 
@@ -45,6 +72,13 @@ extern "C" {
 void keccak_init(SHA3_CTX *ctx);
 void keccak_update(SHA3_CTX *ctx, const unsigned char *msg, uint16_t size);
 void keccak_final(SHA3_CTX *ctx, unsigned char* result);
+/* keccak_final() giving the digest as four big-endian 64-bit words, most
+ * significant first: the limbs of a uint256_t as they lie in memory */
+void keccak_final_words(SHA3_CTX *ctx, uint64_t *words);
+/* The digest of 32 or 64 bytes, as keccak_final_words() gives it, in one
+ * permutation without a context: mapping slots and hash-lock preimages */
+void keccak256_32(const uint8_t *data, uint64_t *words);
+void keccak256_64(const uint8_t *data, uint64_t *words);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,592 @@
+// evm2c: translate the runtime code of contracts to C, to be linked into
+// the firmware with EVM_AOT (see evm_aot.h).
+//   evm2c [-o evm_aot_contracts.c] name runtime.hex [name runtime.hex]...
+// Every basic block of the pre-decoded stream (evm_analysis.h) becomes
+// straight-line code. Within a block the stack is kept in locals and the
+// operations on constants are folded; the machine stack is written back
+// before an opcode that is not translated, which runs through
+// decode_instruction(), and at the end of the block. Jumps to a constant
+// go straight to their block, the others through a switch over the
+// JUMPDESTs.
+
+#include <ctype.h>
+#include "evm.h"
+#include "evm_analysis.h"
+#include "evm_aot.h"
+
+#if !EVM_PROGRAM_PCS
+#error "evm2c needs EVM_CONF_PROGRAM_PCS=1"
+#endif
+
+// Locals a translated contract keeps stack items in
+#define MAX_SLOTS 64
+// Distinct constants of a contract
+#define MAX_CONSTS 2048
+// Items a block can hold in locals: all it pushes, and the items it moves
+// from the machine stack
+#define MAX_ITEMS (255 + 17)
+
+enum item_kind {
+    ITEM_BASE,      // on the machine stack, index places below the top + 1
+    ITEM_CONST,     // index in consts
+    ITEM_LOCAL,     // in local t[index]
+};
+
+typedef struct item {
+    uint8_t kind;
+    int index;
+} item_t;
+
+static const char *prefix;
+static FILE *out;
+
+static uint256_t consts[MAX_CONSTS];
+static int const_count;
+
+static int slot_refs[MAX_SLOTS];
+static int slot_count;
+
+// the stack of the running block over the machine stack at the last write
+// back, of which it took the top low items
+static item_t items[MAX_ITEMS];
+static int height;
+static int low;
+
+static bool uses_jump;
+static bool uses_cond;
+
+static void fail(const char *message) {
+    fprintf(stderr, "evm2c: %s: %s\n", prefix, message);
+    exit(1);
+}
+
+static int constant(const uint256_t *value) {
+
+    for (int i = 0; i < const_count; i++) {
+        if (equal256(&consts[i], (uint256_t *)value)) {
+            return i;
+        }
+    }
+    if (const_count == MAX_CONSTS) {
+        fail("too many constants");
+    }
+    consts[const_count] = *value;
+    return const_count++;
+}
+
+static int slot_new(void) {
+
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        if (slot_refs[i] == 0) {
+            slot_refs[i] = 1;
+            if (i >= slot_count) {
+                slot_count = i + 1;
+            }
+            return i;
+        }
+    }
+    fail("too many stack items in locals");
+    return -1;
+}
+
+static void item_ref(item_t item) {
+    if (item.kind == ITEM_LOCAL) {
+        slot_refs[item.index]++;
+    }
+}
+
+static void item_drop(item_t item) {
+    if (item.kind == ITEM_LOCAL) {
+        slot_refs[item.index]--;
+    }
+}
+
+// C expression of a pointer to the item
+static const char *ref(item_t item) {
+
+    static char buffer[4][64];
+    static int next;
+    char *text = buffer[next++ % 4];
+
+    switch (item.kind) {
+    case ITEM_BASE:
+        snprintf(text, 64, "stack_at(m, %d)", item.index - 1);
+        break;
+    case ITEM_CONST:
+        snprintf(text, 64, "(uint256_t *)&%s_k[%d]", prefix, item.index);
+        break;
+    default:
+        snprintf(text, 64, "&t[%d]", item.index);
+        break;
+    }
+    return text;
+}
+
+// Make the top depth items of the stack locals of the block
+static void pull(int depth) {
+
+    while (height < depth) {
+        if (height == MAX_ITEMS) {
+            fail("block too deep");
+        }
+        memmove(&items[1], &items[0], height * sizeof(item_t));
+        items[0].kind = ITEM_BASE;
+        items[0].index = ++low;
+        height++;
+    }
+}
+
+static item_t pop(void) {
+    pull(1);
+    return items[--height];
+}
+
+static void push(item_t item) {
+    if (height == MAX_ITEMS) {
+        fail("block too deep");
+    }
+    items[height++] = item;
+}
+
+static void push_const(const uint256_t *value) {
+    item_t item = { ITEM_CONST, constant(value) };
+    push(item);
+}
+
+static item_t push_local(void) {
+    item_t item = { ITEM_LOCAL, slot_new() };
+    push(item);
+    return item;
+}
+
+// Write the stack of the block back to the machine stack
+static void write_back(void) {
+
+    // an item taken from the machine stack that has to move is read before
+    // anything is written
+    for (int i = 0; i < height; i++) {
+        if (items[i].kind == ITEM_BASE && items[i].index != low - i) {
+            int slot = slot_new();
+            fprintf(out, "    t[%d] = *%s;\n", slot, ref(items[i]));
+            items[i].kind = ITEM_LOCAL;
+            items[i].index = slot;
+        }
+    }
+    for (int i = 0; i < height; i++) {
+        int offset = i + 1 - low;
+        if (items[i].kind == ITEM_CONST) {
+            fprintf(out, "    m->STACK[m->SP %c %d] = %s_k[%d];\n", offset < 0 ? '-' : '+', abs(offset), prefix, items[i].index);
+        }
+        else if (items[i].kind == ITEM_LOCAL) {
+            fprintf(out, "    m->STACK[m->SP %c %d] = t[%d];\n", offset < 0 ? '-' : '+', abs(offset), items[i].index);
+        }
+        item_drop(items[i]);
+    }
+    if (height != low) {
+        fprintf(out, "    evm_aot_grow(m, %d);\n", height - low);
+    }
+    height = 0;
+    low = 0;
+}
+
+typedef void (*binary_fn)(uint256_t *, uint256_t *, uint256_t *);
+
+static void binary(binary_fn fn, const char *name) {
+
+    item_t a = pop();
+    item_t b = pop();
+
+    if (a.kind == ITEM_CONST && b.kind == ITEM_CONST) {
+        uint256_t result;
+        fn(&consts[a.index], &consts[b.index], &result);
+        push_const(&result);
+    }
+    else {
+        item_t result = push_local();
+        fprintf(out, "    %s(%s, %s, &t[%d]);\n", name, ref(a), ref(b), result.index);
+    }
+    item_drop(a);
+    item_drop(b);
+}
+
+static void unary(void (*fn)(uint256_t *, uint256_t *), const char *name) {
+
+    item_t a = pop();
+
+    if (a.kind == ITEM_CONST) {
+        uint256_t result;
+        fn(&consts[a.index], &result);
+        push_const(&result);
+    }
+    else {
+        item_t result = push_local();
+        fprintf(out, "    %s(%s, &t[%d]);\n", name, ref(a), result.index);
+    }
+    item_drop(a);
+}
+
+// Jump to destination, if cond (a C expression) holds
+static void jump(const evm_program_t *prog, item_t destination, const char *cond) {
+
+    const char *guard = cond != NULL ? "if (cond) " : "";
+    int target = -1;
+
+    if (cond != NULL) {
+        // read before the write back
+        uses_cond = true;
+        fprintf(out, "    cond = %s;\n", cond);
+    }
+    if (destination.kind == ITEM_CONST) {
+        uint256_t *value = &consts[destination.index];
+        if (zero128(&UPPER_P(value)) && UPPER(LOWER_P(value)) == 0) {
+            target = evm_program_jump(prog, LOWER(LOWER_P(value)));
+        }
+        if (target >= 0) {
+            item_drop(destination);
+            write_back();
+            fprintf(out, "    %sgoto b_%llx;\n", guard, (unsigned long long)LOWER(LOWER_P(value)));
+            return;
+        }
+    }
+    uses_jump = true;
+    if (target < 0 && destination.kind == ITEM_CONST) {
+        fprintf(out, "    dest = -1;\n");
+    }
+    else {
+        fprintf(out, "    dest = evm_aot_dest(%s);\n", ref(destination));
+    }
+    item_drop(destination);
+    write_back();
+    fprintf(out, "    %sgoto jump;\n", guard);
+}
+
+static void push_value(const evm_program_t *prog, const uint8_t *code, const evm_insn_t *insn) {
+
+    uint8_t word[32] = {0};
+    uint256_t value;
+
+    if (insn->arg <= 2) {
+        clear256(&value);
+        LOWER(LOWER(value)) = insn[1].imm;
+    }
+    else if (insn->arg <= EVM_PUSH_INLINE_BYTES) {
+        clear256(&value);
+        LOWER(LOWER(value)) = (uint32_t)insn[1].imm << 16 | insn[2].imm;
+    }
+    else {
+        for (int i = 0; i < insn->arg; i++) {
+            if (insn[1].imm + i < prog->code_size) {
+                word[32 - insn->arg + i] = code[insn[1].imm + i];
+            }
+        }
+        readu256BE(word, &value);
+    }
+    push_const(&value);
+}
+
+static void translate_body(const evm_program_t *prog, const uint8_t *code) {
+
+    bool reachable = false;
+
+    for (int i = 0; i < prog->insn_count; i += evm_insn_length(&prog->insn[i])) {
+        const evm_insn_t *insn = &prog->insn[i];
+        uint8_t op = insn->handler;
+
+        if (op == JUMPDEST || op == OPX_BEGINBLOCK) {
+            write_back();
+            fprintf(out, "b_%lx:\n", (unsigned long)prog->pc[i]);
+            fprintf(out, "    if ((status = evm_aot_block(m, 0x%lx, %lu, %u, %u)) != 0) return status;\n",
+                    (unsigned long)prog->pc[i], (unsigned long)insn[1].imm, insn->arg, insn[2].imm);
+            reachable = true;
+            continue;
+        }
+        if (!reachable) {
+            continue;
+        }
+        if (op >= PUSH1 && op <= PUSH32) {
+            push_value(prog, code, insn);
+        }
+        else if (op >= DUP1 && op <= DUP16) {
+            pull(insn->arg);
+            item_t item = items[height - insn->arg];
+            item_ref(item);
+            push(item);
+        }
+        else if (op >= SWAP1 && op <= SWAP16) {
+            pull(insn->arg + 1);
+            item_t top = items[height - 1];
+            items[height - 1] = items[height - 1 - insn->arg];
+            items[height - 1 - insn->arg] = top;
+        }
+        else if (op == POP) {
+            item_drop(pop());
+        }
+        else if (op == PC) {
+            uint256_t value;
+            clear256(&value);
+            LOWER(LOWER(value)) = insn[1].imm;
+            push_const(&value);
+        }
+        else if (op == ADD) {
+            binary(add256, "add256");
+        }
+        else if (op == SUB) {
+            binary(minus256, "minus256");
+        }
+        else if (op == MUL) {
+            binary(mul256, "mul256");
+        }
+        else if (op == DIV) {
+            binary(evm_aot_div, "evm_aot_div");
+        }
+        else if (op == MOD) {
+            binary(evm_aot_mod, "evm_aot_mod");
+        }
+        else if (op == LT) {
+            binary(evm_aot_lt, "evm_aot_lt");
+        }
+        else if (op == GT) {
+            binary(evm_aot_gt, "evm_aot_gt");
+        }
+        else if (op == EQ) {
+            binary(evm_aot_eq, "evm_aot_eq");
+        }
+        else if (op == AND) {
+            binary(and256, "and256");
+        }
+        else if (op == OR) {
+            binary(or256, "or256");
+        }
+        else if (op == XOR) {
+            binary(xor256, "xor256");
+        }
+        else if (op == SHL) {
+            binary(evm_aot_shl, "evm_aot_shl");
+        }
+        else if (op == SHR) {
+            binary(evm_aot_shr, "evm_aot_shr");
+        }
+        else if (op == ISZERO) {
+            unary(evm_aot_iszero, "evm_aot_iszero");
+        }
+        else if (op == NOT) {
+            unary(evm_aot_not, "evm_aot_not");
+        }
+        else if (op == JUMP) {
+            jump(prog, pop(), NULL);
+            reachable = false;
+        }
+        else if (op == JUMPI) {
+            item_t destination = pop();
+            item_t cond = pop();
+            if (cond.kind == ITEM_CONST) {
+                // decided now
+                if (zero256(&consts[cond.index])) {
+                    item_drop(destination);
+                }
+                else {
+                    jump(prog, destination, NULL);
+                }
+            }
+            else {
+                char test[80];
+                snprintf(test, sizeof(test), "!zero256(%s)", ref(cond));
+                item_drop(cond);
+                jump(prog, destination, test);
+            }
+        }
+        else if (op == STOP) {
+            write_back();
+            fprintf(out, "    return 0;\n");
+            reachable = false;
+        }
+        else {
+            write_back();
+            if (OPCODE_INFO[op].flags & OPCODE_TERMINAL) {
+                fprintf(out, "    return evm_aot_op(m, 0x%02x, code);\n", op);
+                reachable = false;
+            }
+            else {
+                fprintf(out, "    if ((status = evm_aot_op(m, 0x%02x, code)) != 0) return status;\n", op);
+            }
+        }
+    }
+}
+
+static void print_u256(FILE *file, uint256_t *value) {
+    fprintf(file, "{{{{0x%llx, 0x%llx}}, {{0x%llx, 0x%llx}}}}",
+            (unsigned long long)UPPER(UPPER_P(value)), (unsigned long long)LOWER(UPPER_P(value)),
+            (unsigned long long)UPPER(LOWER_P(value)), (unsigned long long)LOWER(LOWER_P(value)));
+}
+
+static void translate(FILE *file, const char *name, const uint8_t *code, uint32_t size) {
+
+    const evm_program_t *prog = evm_program_load(code, size);
+
+    prefix = name;
+    if (prog == NULL || prog->insn_count == 0) {
+        fail("code too large to analyse");
+    }
+    const_count = 0;
+    slot_count = 0;
+    memset(slot_refs, 0, sizeof(slot_refs));
+    height = low = 0;
+    uses_jump = uses_cond = false;
+
+    // the body comes first, it tells what the function needs
+    out = tmpfile();
+    if (out == NULL) {
+        fail("no temporary file");
+    }
+    translate_body(prog, code);
+
+    fprintf(file, "// %s: %lu bytes of runtime code\n", name, (unsigned long)size);
+    if (const_count != 0) {
+        fprintf(file, "static const uint256_t %s_k[] = {\n", name);
+        for (int i = 0; i < const_count; i++) {
+            fprintf(file, "    ");
+            print_u256(file, &consts[i]);
+            fprintf(file, ",\n");
+        }
+        fprintf(file, "};\n\n");
+    }
+    fprintf(file, "static int %s_run(Machine *m, const uint8_t *code) {\n\n", name);
+    if (slot_count != 0) {
+        fprintf(file, "    uint256_t t[%d];\n", slot_count);
+    }
+    if (uses_jump) {
+        fprintf(file, "    int64_t dest;\n");
+    }
+    if (uses_cond) {
+        fprintf(file, "    bool cond;\n");
+    }
+    fprintf(file, "    int status;\n\n");
+    fprintf(file, "    (void)code;\n");
+    // a paused call goes on at the block it stopped at
+    fprintf(file, "    switch (m->PC) {\n");
+    for (int i = 0; i < prog->insn_count; i += evm_insn_length(&prog->insn[i])) {
+        if (prog->insn[i].handler == JUMPDEST || prog->insn[i].handler == OPX_BEGINBLOCK) {
+            fprintf(file, "    case 0x%lx: goto b_%lx;\n", (unsigned long)prog->pc[i], (unsigned long)prog->pc[i]);
+        }
+    }
+    fprintf(file, "    }\n    return -1;\n");
+
+    rewind(out);
+    int c;
+    while ((c = fgetc(out)) != EOF) {
+        fputc(c, file);
+    }
+    fclose(out);
+
+    if (uses_jump) {
+        fprintf(file, "jump:\n    switch (dest) {\n");
+        for (int i = 0; i < prog->insn_count; i += evm_insn_length(&prog->insn[i])) {
+            if (prog->insn[i].handler == JUMPDEST) {
+                fprintf(file, "    case 0x%lx: goto b_%lx;\n", (unsigned long)prog->pc[i], (unsigned long)prog->pc[i]);
+            }
+        }
+        fprintf(file, "    }\n");
+        fprintf(file, "    printf(\"Invalid jump destination: 0x%%llX\\n\", (unsigned long long)dest);\n");
+        fprintf(file, "    return -1;\n");
+    }
+    fprintf(file, "}\n\n");
+    evm_program_release(prog);
+}
+
+static uint8_t *read_hex(const char *path, uint32_t *size) {
+
+    FILE *file = fopen(path, "r");
+    uint8_t *code = malloc(EVM_ANALYSIS_MAX_CODE_SIZE);
+    int high = -1;
+    int c;
+
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    *size = 0;
+    while ((c = fgetc(file)) != EOF) {
+        if (c == 'x' && high == 0 && *size == 0) {
+            // 0x prefix
+            high = -1;
+            continue;
+        }
+        if (!isxdigit(c)) {
+            continue;
+        }
+        int digit = isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+        if (high < 0) {
+            high = digit;
+            continue;
+        }
+        if (*size == EVM_ANALYSIS_MAX_CODE_SIZE) {
+            fprintf(stderr, "evm2c: %s: more than %u bytes\n", path, EVM_ANALYSIS_MAX_CODE_SIZE);
+            exit(1);
+        }
+        code[(*size)++] = high << 4 | digit;
+        high = -1;
+    }
+    fclose(file);
+    return code;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: evm2c [-o file.c] name runtime.hex [name runtime.hex]...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+
+    const char *output = "evm_aot_contracts.c";
+    FILE *file;
+    int first = 1;
+    int count;
+
+    if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+        output = argv[2];
+        first = 3;
+    }
+    count = (argc - first) / 2;
+    if (count == 0 || (argc - first) % 2 != 0 || count > UINT8_MAX) {
+        usage();
+    }
+    for (int i = first; i < argc; i += 2) {
+        for (const char *c = argv[i]; *c; c++) {
+            if (!isalnum((unsigned char)*c) && *c != '_') {
+                fprintf(stderr, "evm2c: %s: the name must be a C identifier\n", argv[i]);
+                exit(2);
+            }
+        }
+    }
+
+    file = fopen(output, "w");
+    if (file == NULL) {
+        perror(output);
+        return 1;
+    }
+    fprintf(file, "// Generated by tools/evm2c, do not edit.\n");
+    fprintf(file, "#include \"evm_aot.h\"\n\n");
+
+    uint8_t hashes[UINT8_MAX][32];
+    uint32_t sizes[UINT8_MAX];
+    for (int i = 0; i < count; i++) {
+        uint32_t size;
+        uint8_t *code = read_hex(argv[first + 2 * i + 1], &size);
+        translate(file, argv[first + 2 * i], code, size);
+        get_keccak256(code, size, hashes[i]);
+        sizes[i] = size;
+        free(code);
+    }
+
+    fprintf(file, "const evm_aot_contract_t evm_aot_contracts[] = {\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "    {\n        {");
+        for (int j = 0; j < 32; j++) {
+            fprintf(file, "0x%02x%s", hashes[i][j], j < 31 ? (j % 8 == 7 ? ",\n         " : ", ") : "");
+        }
+        fprintf(file, "},\n        %lu, %s_run,\n    },\n", (unsigned long)sizes[i], argv[first + 2 * i]);
+    }
+    fprintf(file, "};\n\nconst uint8_t evm_aot_contract_count = %d;\n", count);
+    fclose(file);
+    return 0;
+}
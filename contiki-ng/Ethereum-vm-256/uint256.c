@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "uint256.h"
 
@@ -41,6 +42,47 @@ void readu256BE(uint8_t *buffer, uint256_t *target) {
     readu128BE(buffer + 16, &LOWER_P(target));
 }
 
+static void writeUint64BE(uint64_t value, uint8_t *buffer) {
+    for (int i = 7; i >= 0; i--) {
+        buffer[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+void writeu128BE(uint128_t *number, uint8_t *buffer) {
+    writeUint64BE(UPPER_P(number), buffer);
+    writeUint64BE(LOWER_P(number), buffer + 8);
+}
+
+void writeu256BE(uint256_t *number, uint8_t *buffer) {
+    writeu128BE(&UPPER_P(number), buffer);
+    writeu128BE(&LOWER_P(number), buffer + 16);
+}
+
+// limb[0] is the least significant
+static inline void load_limbs(const uint256_t *number, uint32_t *limb) {
+    uint64_t word;
+    word = LOWER(LOWER_P(number));
+    limb[0] = (uint32_t)word;
+    limb[1] = (uint32_t)(word >> 32);
+    word = UPPER(LOWER_P(number));
+    limb[2] = (uint32_t)word;
+    limb[3] = (uint32_t)(word >> 32);
+    word = LOWER(UPPER_P(number));
+    limb[4] = (uint32_t)word;
+    limb[5] = (uint32_t)(word >> 32);
+    word = UPPER(UPPER_P(number));
+    limb[6] = (uint32_t)word;
+    limb[7] = (uint32_t)(word >> 32);
+}
+
+static inline void store_limbs(const uint32_t *limb, uint256_t *target) {
+    LOWER(LOWER_P(target)) = (uint64_t)limb[1] << 32 | limb[0];
+    UPPER(LOWER_P(target)) = (uint64_t)limb[3] << 32 | limb[2];
+    LOWER(UPPER_P(target)) = (uint64_t)limb[5] << 32 | limb[4];
+    UPPER(UPPER_P(target)) = (uint64_t)limb[7] << 32 | limb[6];
+}
+
 bool zero128(uint128_t *number) {
     return ((LOWER_P(number) == 0) && (UPPER_P(number) == 0));
 }
@@ -89,6 +131,7 @@ void shiftl128(uint128_t *number, uint32_t value, uint128_t *target) {
     }
 }
 
+#if !EVM_UINT256_LIMB32
 void shiftl256(uint256_t *number, uint32_t value, uint256_t *target) {
     if (value >= 256) {
         clear256(target);
@@ -113,6 +156,7 @@ void shiftl256(uint256_t *number, uint32_t value, uint256_t *target) {
         clear256(target);
     }
 }
+#endif
 
 void shiftr128(uint128_t *number, uint32_t value, uint128_t *target) {
     if (value >= 128) {
@@ -136,6 +180,7 @@ void shiftr128(uint128_t *number, uint32_t value, uint128_t *target) {
     }
 }
 
+#if !EVM_UINT256_LIMB32
 void shiftr256(uint256_t *number, uint32_t value, uint256_t *target) {
     if (value >= 256) {
         clear256(target);
@@ -160,6 +205,7 @@ void shiftr256(uint256_t *number, uint32_t value, uint256_t *target) {
         clear256(target);
     }
 }
+#endif
 
 uint32_t bits128(uint128_t *number) {
     uint32_t result = 0;
@@ -180,6 +226,7 @@ uint32_t bits128(uint128_t *number) {
     return result;
 }
 
+#if !EVM_UINT256_LIMB32
 uint32_t bits256(uint256_t *number) {
     uint32_t result = 0;
     if (!zero128(&UPPER_P(number))) {
@@ -200,6 +247,7 @@ uint32_t bits256(uint256_t *number) {
     }
     return result;
 }
+#endif
 
 bool equal128(uint128_t *number1, uint128_t *number2) {
     return (UPPER_P(number1) == UPPER_P(number2)) &&
@@ -240,6 +288,7 @@ void add128(uint128_t *number1, uint128_t *number2, uint128_t *target) {
     LOWER_P(target) = LOWER_P(number1) + LOWER_P(number2);
 }
 
+#if !EVM_UINT256_LIMB32
 void add256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
     uint128_t tmp;
     add128(&UPPER_P(number1), &UPPER_P(number2), &UPPER_P(target));
@@ -252,6 +301,7 @@ void add256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
     }
     add128(&LOWER_P(number1), &LOWER_P(number2), &LOWER_P(target));
 }
+#endif
 
 void minus128(uint128_t *number1, uint128_t *number2, uint128_t *target) {
     UPPER_P(target) =
@@ -260,6 +310,7 @@ void minus128(uint128_t *number1, uint128_t *number2, uint128_t *target) {
     LOWER_P(target) = LOWER_P(number1) - LOWER_P(number2);
 }
 
+#if !EVM_UINT256_LIMB32
 void minus256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
     uint128_t tmp;
     minus128(&UPPER_P(number1), &UPPER_P(number2), &UPPER_P(target));
@@ -272,6 +323,7 @@ void minus256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
     }
     minus128(&LOWER_P(number1), &LOWER_P(number2), &LOWER_P(target));
 }
+#endif
 
 void or128(uint128_t *number1, uint128_t *number2, uint128_t *target) {
     UPPER_P(target) = UPPER_P(number1) | UPPER_P(number2);
@@ -358,100 +410,158 @@ void mul128(uint128_t *number1, uint128_t *number2, uint128_t *target) {
     add128(&tmp, &tmp2, target);
 }
 
+#if !EVM_UINT256_LIMB32
+// The 128-bit product of a and b from four 32x32->64 products
+static void mul64(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low) {
+    uint64_t a_low = a & 0xffffffff, a_high = a >> 32;
+    uint64_t b_low = b & 0xffffffff, b_high = b >> 32;
+    uint64_t low_low = a_low * b_low;
+    uint64_t high_low = a_high * b_low;
+    uint64_t low_high = a_low * b_high;
+    uint64_t middle = (low_low >> 32) + (high_low & 0xffffffff) + (low_high & 0xffffffff);
+
+    *low = (middle << 32) | (low_low & 0xffffffff);
+    *high = a_high * b_high + (high_low >> 32) + (low_high >> 32) + (middle >> 32);
+}
+
+// Schoolbook over the 64-bit words, least significant first, keeping only
+// the products that reach the low 256 bits. a[i] * b[j] + r[i + j] + carry
+// always fits in 128 bits.
 void mul256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
-    uint128_t top[4];
-    uint128_t bottom[4];
-    uint128_t products[4][4];
-    uint128_t tmp, tmp2, fourth64, third64, second64, first64;
-    uint256_t target1, target2;
-    UPPER(top[0]) = 0;
-    LOWER(top[0]) = UPPER(UPPER_P(number1));
-    UPPER(top[1]) = 0;
-    LOWER(top[1]) = LOWER(UPPER_P(number1));
-    UPPER(top[2]) = 0;
-    LOWER(top[2]) = UPPER(LOWER_P(number1));
-    UPPER(top[3]) = 0;
-    LOWER(top[3]) = LOWER(LOWER_P(number1));
-    UPPER(bottom[0]) = 0;
-    LOWER(bottom[0]) = UPPER(UPPER_P(number2));
-    UPPER(bottom[1]) = 0;
-    LOWER(bottom[1]) = LOWER(UPPER_P(number2));
-    UPPER(bottom[2]) = 0;
-    LOWER(bottom[2]) = UPPER(LOWER_P(number2));
-    UPPER(bottom[3]) = 0;
-    LOWER(bottom[3]) = LOWER(LOWER_P(number2));
+    uint64_t a[4] = {LOWER(LOWER_P(number1)), UPPER(LOWER_P(number1)),
+                     LOWER(UPPER_P(number1)), UPPER(UPPER_P(number1))};
+    uint64_t b[4] = {LOWER(LOWER_P(number2)), UPPER(LOWER_P(number2)),
+                     LOWER(UPPER_P(number2)), UPPER(UPPER_P(number2))};
+    uint64_t r[4] = {0};
+
+    for (int i = 0; i < 4; i++) {
+        uint64_t carry = 0;
+        if (a[i] == 0) {
+            continue;
+        }
+        for (int j = 0; i + j < 4; j++) {
+            uint64_t high, low;
+            mul64(a[i], b[j], &high, &low);
+            low += r[i + j];
+            high += low < r[i + j];
+            low += carry;
+            high += low < carry;
+            r[i + j] = low;
+            carry = high;
+        }
+    }
+    UPPER(UPPER_P(target)) = r[3];
+    LOWER(UPPER_P(target)) = r[2];
+    UPPER(LOWER_P(target)) = r[1];
+    LOWER(LOWER_P(target)) = r[0];
+}
+#endif
 
-    for (int y = 3; y > -1; y--) {
-        for (int x = 3; x > -1; x--) {
-            mul128(&top[x], &bottom[y], &products[3 - x][y]);
+#if EVM_UINT256_LIMB32
+
+void shiftl256(uint256_t *number, uint32_t value, uint256_t *target) {
+    uint32_t a[8], r[8];
+    uint32_t limbs = value / 32, bits = value % 32;
+    if (value >= 256) {
+        clear256(target);
+        return;
+    }
+    load_limbs(number, a);
+    for (int i = 7; i >= 0; i--) {
+        int from = i - (int)limbs;
+        uint32_t limb = 0;
+        if (from >= 0) {
+            limb = a[from] << bits;
+            if (bits != 0 && from > 0) {
+                limb |= a[from - 1] >> (32 - bits);
+            }
         }
+        r[i] = limb;
     }
+    store_limbs(r, target);
+}
 
-    UPPER(fourth64) = 0;
-    LOWER(fourth64) = LOWER(products[0][3]);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[0][2]);
-    UPPER(tmp2) = 0;
-    LOWER(tmp2) = UPPER(products[0][3]);
-    add128(&tmp, &tmp2, &third64);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[0][1]);
-    UPPER(tmp2) = 0;
-    LOWER(tmp2) = UPPER(products[0][2]);
-    add128(&tmp, &tmp2, &second64);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[0][0]);
-    UPPER(tmp2) = 0;
-    LOWER(tmp2) = UPPER(products[0][1]);
-    add128(&tmp, &tmp2, &first64);
+void shiftr256(uint256_t *number, uint32_t value, uint256_t *target) {
+    uint32_t a[8], r[8];
+    uint32_t limbs = value / 32, bits = value % 32;
+    if (value >= 256) {
+        clear256(target);
+        return;
+    }
+    load_limbs(number, a);
+    for (int i = 0; i < 8; i++) {
+        uint32_t from = i + limbs;
+        uint32_t limb = 0;
+        if (from < 8) {
+            limb = a[from] >> bits;
+            if (bits != 0 && from < 7) {
+                limb |= a[from + 1] << (32 - bits);
+            }
+        }
+        r[i] = limb;
+    }
+    store_limbs(r, target);
+}
 
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[1][3]);
-    add128(&tmp, &third64, &tmp2);
-    copy128(&third64, &tmp2);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[1][2]);
-    add128(&tmp, &second64, &tmp2);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = UPPER(products[1][3]);
-    add128(&tmp, &tmp2, &second64);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[1][1]);
-    add128(&tmp, &first64, &tmp2);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = UPPER(products[1][2]);
-    add128(&tmp, &tmp2, &first64);
+uint32_t bits256(uint256_t *number) {
+    uint32_t a[8];
+    load_limbs(number, a);
+    for (int i = 7; i >= 0; i--) {
+        if (a[i] != 0) {
+            return 32 * i + 32 - __builtin_clz(a[i]);
+        }
+    }
+    return 0;
+}
 
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[2][3]);
-    add128(&tmp, &second64, &tmp2);
-    copy128(&second64, &tmp2);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[2][2]);
-    add128(&tmp, &first64, &tmp2);
-    UPPER(tmp) = 0;
-    LOWER(tmp) = UPPER(products[2][3]);
-    add128(&tmp, &tmp2, &first64);
+void add256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
+    uint32_t a[8], b[8];
+    uint64_t carry = 0;
+    load_limbs(number1, a);
+    load_limbs(number2, b);
+    for (int i = 0; i < 8; i++) {
+        carry += (uint64_t)a[i] + b[i];
+        a[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    store_limbs(a, target);
+}
 
-    UPPER(tmp) = 0;
-    LOWER(tmp) = LOWER(products[3][3]);
-    add128(&tmp, &first64, &tmp2);
-    copy128(&first64, &tmp2);
-
-    clear256(&target1);
-    shiftl128(&first64, 64, &UPPER(target1));
-    clear256(&target2);
-    UPPER(UPPER(target2)) = UPPER(third64);
-    shiftl128(&third64, 64, &LOWER(target2));
-    add256(&target1, &target2, target);
-    clear256(&target1);
-    copy128(&UPPER(target1), &second64);
-    add256(&target1, target, &target2);
-    clear256(&target1);
-    copy128(&LOWER(target1), &fourth64);
-    add256(&target1, &target2, target);
+void minus256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
+    uint32_t a[8], b[8];
+    uint32_t borrow = 0;
+    load_limbs(number1, a);
+    load_limbs(number2, b);
+    for (int i = 0; i < 8; i++) {
+        uint64_t difference = (uint64_t)a[i] - b[i] - borrow;
+        a[i] = (uint32_t)difference;
+        borrow = (uint32_t)(difference >> 32) & 1;
+    }
+    store_limbs(a, target);
 }
 
+// Schoolbook, keeping only the 36 products that reach the low 256 bits.
+// a[i] * b[j] + r[i + j] + carry always fits in 64 bits.
+void mul256(uint256_t *number1, uint256_t *number2, uint256_t *target) {
+    uint32_t a[8], b[8], r[8] = {0};
+    load_limbs(number1, a);
+    load_limbs(number2, b);
+    for (int i = 0; i < 8; i++) {
+        uint64_t carry = 0;
+        if (a[i] == 0) {
+            continue;
+        }
+        for (int j = 0; i + j < 8; j++) {
+            carry += (uint64_t)a[i] * b[j] + r[i + j];
+            r[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+    }
+    store_limbs(r, target);
+}
+
+#endif /* EVM_UINT256_LIMB32 */
+
 void divmod128(uint128_t *l, uint128_t *r, uint128_t *retDiv,
                uint128_t *retMod) {
     uint128_t copyd, adder, resDiv, resMod;
@@ -484,37 +594,139 @@ void divmod128(uint128_t *l, uint128_t *r, uint128_t *retDiv,
     }
 }
 
+// Limbs up to the top nonzero one, 0 if the number is zero
+static int limb_count(const uint32_t *limb) {
+    int count = 8;
+    while (count > 0 && limb[count - 1] == 0) {
+        count--;
+    }
+    return count;
+}
+
+// Knuth's algorithm D on 32-bit limbs (TAOCP 4.3.1), with the divisor
+// normalised so that its top bit is set. A power of two divides by a
+// shift, a single-limb divisor by short division.
 void divmod256(uint256_t *l, uint256_t *r, uint256_t *retDiv,
                uint256_t *retMod) {
-    uint256_t copyd, adder, resDiv, resMod;
-    uint256_t one;
-    clear256(&one);
-    UPPER(LOWER(one)) = 0;
-    LOWER(LOWER(one)) = 1;
-    uint32_t diffBits = bits256(l) - bits256(r);
-    clear256(&resDiv);
-    copy256(&resMod, l);
+    uint32_t u[9], v[8], q[8] = {0};
+    int m, n, shift;
+
+    load_limbs(l, u);
+    load_limbs(r, v);
+    u[8] = 0;
+    n = limb_count(v);
+    m = limb_count(u);
+    if (n == 0) {
+        clear256(retDiv);
+        clear256(retMod);
+        return;
+    }
     if (gt256(r, l)) {
         copy256(retMod, l);
         clear256(retDiv);
-    } else {
-        shiftl256(r, diffBits, &copyd);
-        shiftl256(&one, diffBits, &adder);
-        if (gt256(&copyd, &resMod)) {
-            shiftr256(&copyd, 1, &copyd);
-            shiftr256(&adder, 1, &adder);
+        return;
+    }
+    // a power of two: a shift and a mask, e.g. the selector of a call
+    // taken from the call data with DIV by 2^224
+    if ((v[n - 1] & (v[n - 1] - 1)) == 0) {
+        uint32_t lower = 0;
+        for (int i = 0; i < n - 1; i++) {
+            lower |= v[i];
+        }
+        if (lower == 0) {
+            uint32_t bits = 32 * (n - 1) + 31 - __builtin_clz(v[n - 1]);
+            u[n - 1] &= v[n - 1] - 1;
+            for (int i = n; i < 8; i++) {
+                u[i] = 0;
+            }
+            shiftr256(l, bits, retDiv);
+            store_limbs(u, retMod);
+            return;
+        }
+    }
+    if (n == 1) {
+        uint64_t rest = 0;
+        for (int i = m - 1; i >= 0; i--) {
+            uint64_t part = rest << 32 | u[i];
+            q[i] = (uint32_t)(part / v[0]);
+            rest = part % v[0];
+        }
+        memset(u, 0, sizeof(u));
+        u[0] = (uint32_t)rest;
+        store_limbs(q, retDiv);
+        store_limbs(u, retMod);
+        return;
+    }
+
+    // normalise: the top limb of v gets its top bit set
+    shift = __builtin_clz(v[n - 1]);
+    if (shift != 0) {
+        for (int i = n - 1; i > 0; i--) {
+            v[i] = v[i] << shift | v[i - 1] >> (32 - shift);
         }
-        while (gte256(&resMod, r)) {
-            if (gte256(&resMod, &copyd)) {
-                minus256(&resMod, &copyd, &resMod);
-                or256(&resDiv, &adder, &resDiv);
+        v[0] <<= shift;
+        u[m] = u[m - 1] >> (32 - shift);
+        for (int i = m - 1; i > 0; i--) {
+            u[i] = u[i] << shift | u[i - 1] >> (32 - shift);
+        }
+        u[0] <<= shift;
+    }
+
+    for (int j = m - n; j >= 0; j--) {
+        uint64_t top = (uint64_t)u[j + n] << 32 | u[j + n - 1];
+        uint64_t qhat = top / v[n - 1];
+        uint64_t rhat = top % v[n - 1];
+        uint64_t carry = 0;
+        uint32_t borrow = 0;
+        uint64_t difference;
+
+        // qhat is at most two too large, and only once it exceeds a limb
+        // or the next limb shows it
+        while (qhat > 0xffffffff ||
+               qhat * v[n - 2] > (rhat << 32 | u[j + n - 2])) {
+            qhat--;
+            rhat += v[n - 1];
+            if (rhat > 0xffffffff) {
+                break;
+            }
+        }
+        // u[j..j+n] -= qhat * v
+        for (int i = 0; i < n; i++) {
+            uint64_t product = qhat * v[i] + carry;
+            carry = product >> 32;
+            difference = (uint64_t)u[i + j] - (uint32_t)product - borrow;
+            u[i + j] = (uint32_t)difference;
+            borrow = (uint32_t)(difference >> 32) & 1;
+        }
+        difference = (uint64_t)u[j + n] - carry - borrow;
+        u[j + n] = (uint32_t)difference;
+        q[j] = (uint32_t)qhat;
+        if ((difference >> 32) != 0) {
+            // qhat was one too large: add v back
+            carry = 0;
+            q[j]--;
+            for (int i = 0; i < n; i++) {
+                carry += (uint64_t)u[i + j] + v[i];
+                u[i + j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            u[j + n] += (uint32_t)carry;
+        }
+    }
+
+    // the remainder is in u[0..n-1], still shifted
+    for (int i = 0; i < 8; i++) {
+        uint32_t limb = 0;
+        if (i < n) {
+            limb = u[i] >> shift;
+            if (shift != 0) {
+                limb |= u[i + 1] << (32 - shift);
             }
-            shiftr256(&copyd, 1, &copyd);
-            shiftr256(&adder, 1, &adder);
         }
-        copy256(retDiv, &resDiv);
-        copy256(retMod, &resMod);
+        v[i] = limb;
     }
+    store_limbs(q, retDiv);
+    store_limbs(v, retMod);
 }
 
 static void reverseString(char *str, uint32_t length) {
@@ -23,6 +23,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// Carry the arithmetic of uint256_t over eight 32-bit limbs instead of
+// 64-bit halves: add and subtract with a carry chain, multiply row by row
+// with one 32x32->64 product per limb pair (UMULL/UMLAL on Cortex-M3).
+// The layout and the API stay the same. On by default where pointers have
+// 32 bits (cc2538).
+#ifdef EVM_CONF_UINT256_LIMB32
+#define EVM_UINT256_LIMB32 EVM_CONF_UINT256_LIMB32
+#elif UINTPTR_MAX > 0xFFFFFFFF
+#define EVM_UINT256_LIMB32 0
+#else
+#define EVM_UINT256_LIMB32 1
+#endif
+
 typedef struct uint128_t { uint64_t elements[2]; } uint128_t;
 
 typedef struct uint256_t { uint128_t elements[2]; } uint256_t;
@@ -34,6 +47,8 @@ typedef struct uint256_t { uint128_t elements[2]; } uint256_t;
 
 void readu128BE(uint8_t *buffer, uint128_t *target);
 void readu256BE(uint8_t *buffer, uint256_t *target);
+void writeu128BE(uint128_t *number, uint8_t *buffer);
+void writeu256BE(uint256_t *number, uint8_t *buffer);
 bool zero128(uint128_t *number);
 bool zero256(uint256_t *number);
 void copy128(uint128_t *target, uint128_t *number);
@@ -85,6 +85,31 @@ ecc_curve_info_t nist_p_192 = {
   .y       = nist_p_192_y
 };
 
+/* [SEC 2 secp256k1] */
+static const uint32_t secp256k1_p[8] = { 0xFFFFFC2F, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF,
+                                         0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+static const uint32_t secp256k1_n[8] = { 0xD0364141, 0xBFD25E8C, 0xAF48A03B, 0xBAAEDCE6,
+                                         0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+static const uint32_t secp256k1_a[8] = { 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+                                         0x00000000, 0x00000000, 0x00000000, 0x00000000 };
+static const uint32_t secp256k1_b[8] = { 0x00000007, 0x00000000, 0x00000000, 0x00000000,
+                                         0x00000000, 0x00000000, 0x00000000, 0x00000000 };
+static const uint32_t secp256k1_x[8] = { 0x16F81798, 0x59F2815B, 0x2DCE28D9, 0x029BFCDB,
+                                         0xCE870B07, 0x55A06295, 0xF9DCBBAC, 0x79BE667E };
+static const uint32_t secp256k1_y[8] = { 0xFB10D4B8, 0x9C47D08F, 0xA6855419, 0xFD17B448,
+                                         0x0E1108A8, 0x5DA4FBFC, 0x26A3C465, 0x483ADA77 };
+
+ecc_curve_info_t secp256k1 = {
+  .name    = "secp256k1",
+  .size    = 8,
+  .prime   = secp256k1_p,
+  .n       = secp256k1_n,
+  .a       = secp256k1_a,
+  .b       = secp256k1_b,
+  .x       = secp256k1_x,
+  .y       = secp256k1_y
+};
+
 /**
  * @}
  * @}
@@ -38,7 +38,7 @@
  *
  * \defgroup cc2538-ecc-curves cc2538 NIST curves
  *
- * NIST curves for various key sizes
+ * NIST curves for various key sizes, and secp256k1
  * @{
  *
  * \file
@@ -57,6 +57,11 @@ ecc_curve_info_t nist_p_256;
  */
 ecc_curve_info_t nist_p_192;
 
+/*
+ * SEC 2 secp256k1, the curve of Ethereum and Bitcoin signatures
+ */
+ecc_curve_info_t secp256k1;
+
 #endif /* CURVE_INFO_H_ */
 
 /**